@@ -0,0 +1,145 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file BoundedQueue.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+ * @file BoundedQueue.h
+ * declares a queue of bounded capacity between the threads of a pipeline:
+ * a stage waits when the queue to the next stage is full (backpressure),
+ * so that the items in flight, and the memory they hold, stay bounded.
+ */
+
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <cstddef>
+#include <deque>
+#include <pthread.h>
+
+/**@class BoundedQueue
+ * first in, first out queue shared by a producer and a consumer thread
+ */
+template<class T>
+class BoundedQueue
+{
+  public :
+
+  /**constructor
+   * @param capacity largest number of items waiting in the queue
+   */
+  BoundedQueue(size_t capacity);
+
+  /**destructor*/
+  ~BoundedQueue();
+
+  /**add an item, waiting while the queue is full
+   * @param item item to add
+   * @return false if the queue is closed (the item is not added)
+   */
+  bool push(const T &item);
+
+  /**remove the oldest item, waiting while the queue is empty
+   * @param[out] item item removed
+   * @return false once the queue is closed and empty
+   */
+  bool pop(T &item);
+
+  /**close the queue: push fails from now on, pop returns the items left
+   * then fails. Wakes up the waiting threads.
+   */
+  void close();
+
+  private :
+
+  std::deque<T> m_items;
+
+  size_t m_capacity;
+
+  bool m_closed;
+
+  pthread_mutex_t m_mutex;
+
+  pthread_cond_t m_not_empty;
+
+  pthread_cond_t m_not_full;
+};
+
+template<class T>
+BoundedQueue<T>::BoundedQueue(size_t capacity)
+{
+  m_capacity = capacity > 0 ? capacity : 1;
+  m_closed = false;
+  pthread_mutex_init(&m_mutex, NULL);
+  pthread_cond_init(&m_not_empty, NULL);
+  pthread_cond_init(&m_not_full, NULL);
+}
+
+template<class T>
+BoundedQueue<T>::~BoundedQueue()
+{
+  pthread_cond_destroy(&m_not_full);
+  pthread_cond_destroy(&m_not_empty);
+  pthread_mutex_destroy(&m_mutex);
+}
+
+template<class T>
+bool BoundedQueue<T>::push(const T &item)
+{
+  pthread_mutex_lock(&m_mutex);
+  while(!m_closed && m_items.size() >= m_capacity)
+    pthread_cond_wait(&m_not_full, &m_mutex);
+  bool ok = !m_closed;
+  if(ok)
+  {
+    m_items.push_back(item);
+    pthread_cond_signal(&m_not_empty);
+  }
+  pthread_mutex_unlock(&m_mutex);
+  return ok;
+}
+
+template<class T>
+bool BoundedQueue<T>::pop(T &item)
+{
+  pthread_mutex_lock(&m_mutex);
+  while(!m_closed && m_items.empty())
+    pthread_cond_wait(&m_not_empty, &m_mutex);
+  bool ok = !m_items.empty();
+  if(ok)
+  {
+    item = m_items.front();
+    m_items.pop_front();
+    pthread_cond_signal(&m_not_full);
+  }
+  pthread_mutex_unlock(&m_mutex);
+  return ok;
+}
+
+template<class T>
+void BoundedQueue<T>::close()
+{
+  pthread_mutex_lock(&m_mutex);
+  m_closed = true;
+  pthread_cond_broadcast(&m_not_empty);
+  pthread_cond_broadcast(&m_not_full);
+  pthread_mutex_unlock(&m_mutex);
+}
+
+#endif
@@ -0,0 +1,84 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file CellIndex.cpp
+* @author Julie Digne
+* hash table of the cells of an octree level, see CellIndex.h
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CellIndex.h"
+
+//Morton codes have at most 63 bits: the all-ones code marks empty slots
+static const uint64_t EMPTY_CODE = ~(uint64_t)0;
+
+CellIndex::CellIndex()
+{
+    m_mask = 0;
+    m_bits = 0;
+}
+
+void CellIndex::initialize(size_t ncells)
+{
+    //at most half full, so that the probes stay short
+    unsigned int bits = 1;
+    while(((size_t)1 << bits) < 2 * ncells)
+      bits++;
+    m_mask = ((size_t)1 << bits) - 1;
+    m_bits = bits;
+
+    IndexedCell empty = {EMPTY_CODE, 0, 0, 0};
+    m_slots.assign(m_mask + 1, empty);
+}
+
+void CellIndex::clear()
+{
+    std::vector<IndexedCell>().swap(m_slots);
+    m_mask = 0;
+    m_bits = 0;
+}
+
+size_t CellIndex::getSlot(uint64_t code) const
+{
+    //the low bits of the Morton codes keep the neighbouring cells in
+    //neighbouring slots (the queries of a cell hit a few cache lines), the
+    //high bits are folded in so that distant cells are spread
+    return (size_t)(code ^ (code >> m_bits)) & m_mask;
+}
+
+void CellIndex::insert(const IndexedCell &cell)
+{
+    size_t i = getSlot(cell.code);
+    while(m_slots[i].code != EMPTY_CODE)
+      i = (i + 1) & m_mask;
+    m_slots[i] = cell;
+}
+
+const IndexedCell* CellIndex::find(uint64_t code) const
+{
+    if(m_slots.empty())
+      return NULL;
+
+    size_t i = getSlot(code);
+    while(m_slots[i].code != EMPTY_CODE)
+    {
+      if(m_slots[i].code == code)
+        return &m_slots[i];
+      i = (i + 1) & m_mask;
+    }
+    return NULL;
+}
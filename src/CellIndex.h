@@ -0,0 +1,99 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file CellIndex.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+ * @file CellIndex.h
+ * declares a hash table from the Morton codes of the cells of one level of
+ * an octree to their nodes (hashed linear octree): the cell of a query and
+ * its neighbours are found in constant time instead of walking down from
+ * the root.
+ */
+
+#ifndef CELL_INDEX_H
+#define CELL_INDEX_H
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+/**cell of an octree level: its node and the range of its points, so that
+ * the neighbour queries read the points without touching the node*/
+struct IndexedCell
+{
+  /**Morton code of the cell*/
+  uint64_t code;
+
+  /**index of the node in the nodes of the octree*/
+  unsigned int node;
+
+  /**range of the points of the cell in the points of the octree*/
+  unsigned int begin, end;
+};
+
+/**@class CellIndex
+ * open addressing hash table (linear probing) of cells keyed by their
+ * Morton codes
+ */
+class CellIndex
+{
+  public :
+
+  /**constructor (empty index)*/
+  CellIndex();
+
+  /**empty the index and size it for a number of cells
+   * @param ncells number of cells to insert
+   */
+  void initialize(size_t ncells);
+
+  /**empty the index and free its memory*/
+  void clear();
+
+  /**add a cell
+   * PREREQUISITE: no cell with the same code is in the index
+   * @param cell cell to add
+   */
+  void insert(const IndexedCell &cell);
+
+  /**find a cell
+   * @param code Morton code of the cell
+   * @return cell, NULL if it is not in the index
+   */
+  const IndexedCell* find(uint64_t code) const;
+
+  private :
+
+  /**first slot probed for a code
+   * @param code Morton code
+   * @return slot index
+   */
+  size_t getSlot(uint64_t code) const;
+
+  std::vector<IndexedCell> m_slots;
+
+  /**number of slots minus one (a power of two minus one)*/
+  size_t m_mask;
+
+  /**number of bits of the slot indices*/
+  unsigned int m_bits;
+};
+
+#endif
@@ -0,0 +1,138 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file CellScheduler.cpp
+* @author Julie Digne
+* scheduler of tasks with dependencies, see CellScheduler.h
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CellScheduler.h"
+
+#include <algorithm>
+
+#ifdef OMP
+#include <sched.h>
+#endif
+
+/**orders the heap of the ready tasks: the most expensive on top, the
+ * smallest index first among equal costs*/
+struct CheaperTask
+{
+    const std::vector<unsigned long> &costs;
+
+    CheaperTask(const std::vector<unsigned long> &c) : costs(c) {}
+
+    bool operator()(unsigned int a, unsigned int b) const
+    {
+      if(costs[a] != costs[b])
+        return costs[a] < costs[b];
+      return a > b;
+    }
+};
+
+CellScheduler::CellScheduler()
+{
+    m_ntaken = 0;
+}
+
+void CellScheduler::initialize(unsigned int ntasks)
+{
+    m_costs.assign(ntasks, 0);
+    m_successors.assign(ntasks, std::vector<unsigned int>());
+    m_npredecessors.assign(ntasks, 0);
+    m_nwaiting.clear();
+    m_ready.clear();
+    m_ntaken = 0;
+}
+
+unsigned int CellScheduler::getNTasks() const
+{
+    return m_costs.size();
+}
+
+void CellScheduler::setCost(unsigned int task, unsigned long cost)
+{
+    m_costs[task] = cost;
+}
+
+void CellScheduler::addDependency(unsigned int before, unsigned int after)
+{
+    m_successors[before].push_back(after);
+    m_npredecessors[after]++;
+}
+
+void CellScheduler::start()
+{
+    m_nwaiting = m_npredecessors;
+    m_ready.clear();
+    m_ntaken = 0;
+    for(unsigned int t = 0; t < m_costs.size(); ++t)
+      if(m_nwaiting[t] == 0)
+        push(t);
+}
+
+void CellScheduler::push(unsigned int task)
+{
+    m_ready.push_back(task);
+    std::push_heap(m_ready.begin(), m_ready.end(), CheaperTask(m_costs));
+}
+
+int CellScheduler::next()
+{
+    while(true)
+    {
+      int task = -1;
+      bool done = false;
+#ifdef OMP
+      #pragma omp critical(cell_scheduler)
+#endif
+      {
+        if(!m_ready.empty())
+        {
+          std::pop_heap(m_ready.begin(), m_ready.end(), CheaperTask(m_costs));
+          task = (int)m_ready.back();
+          m_ready.pop_back();
+          m_ntaken++;
+        }
+        else if(m_ntaken == m_costs.size())
+          done = true;
+      }
+      if(task >= 0)
+        return task;
+      if(done)
+        return -1;
+      //the ready tasks are all taken: wait for the running ones to release
+      //their successors (never reached by a single thread)
+#ifdef OMP
+      sched_yield();
+#endif
+    }
+}
+
+void CellScheduler::finish(unsigned int task)
+{
+#ifdef OMP
+    #pragma omp critical(cell_scheduler)
+#endif
+    {
+      const std::vector<unsigned int> &successors = m_successors[task];
+      for(size_t i = 0; i < successors.size(); ++i)
+        if(--m_nwaiting[successors[i]] == 0)
+          push(successors[i]);
+    }
+}
@@ -0,0 +1,138 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file CellScheduler.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+ * @file CellScheduler.h
+ * declares a scheduler of tasks with dependencies (a directed acyclic
+ * graph), run by the threads of an OpenMP team. A task is ready once all
+ * the tasks it depends on are finished; the threads take the most
+ * expensive ready task first, so that the large tasks do not end up
+ * alone at the end of the run. The dart throwing uses it to process a
+ * cell as soon as its neighbours of the previous colours are done,
+ * instead of waiting for whole colours. On a single core the dart
+ * throwing takes about as long as with 8 colour loops and barriers (the
+ * heap and its lock cost nothing measurable); the gain is expected with
+ * many threads and cells of very different sizes.
+ */
+
+#ifndef CELL_SCHEDULER_H
+#define CELL_SCHEDULER_H
+
+#include <cstddef>
+#include <vector>
+
+/**@class CellScheduler
+ * dependency-tracked scheduler of tasks identified by their indices
+ */
+class CellScheduler
+{
+  public :
+
+  /**constructor (no task)*/
+  CellScheduler();
+
+  /**remove all tasks and create new ones without dependencies
+   * @param ntasks number of tasks
+   */
+  void initialize(unsigned int ntasks);
+
+  /**get the number of tasks
+   * @return number of tasks
+   */
+  unsigned int getNTasks() const;
+
+  /**set the estimated cost of a task (default 0)
+   * @param task task index
+   * @param cost estimated cost
+   */
+  void setCost(unsigned int task, unsigned long cost);
+
+  /**make a task wait for another one
+   * PREREQUISITE: the dependencies do not form a cycle
+   * @param before task to finish first
+   * @param after task started after it
+   */
+  void addDependency(unsigned int before, unsigned int after);
+
+  /**run all tasks, in parallel if OpenMP is enabled
+   * @param task functor called with the index of each task
+   */
+  template<class Task>
+  void run(Task &task);
+
+  private :
+
+  /**reset the dependency counters and queue the tasks without dependency*/
+  void start();
+
+  /**take the most expensive ready task, waiting for one if needed
+   * @return task index, -1 once all tasks are taken
+   */
+  int next();
+
+  /**release the tasks waiting for a task
+   * @param task finished task
+   */
+  void finish(unsigned int task);
+
+  /**queue a ready task (under the lock of the scheduler)
+   * @param task task index
+   */
+  void push(unsigned int task);
+
+  /**estimated cost of the tasks*/
+  std::vector<unsigned long> m_costs;
+
+  /**tasks waiting for each task*/
+  std::vector<std::vector<unsigned int> > m_successors;
+
+  /**number of tasks each task waits for*/
+  std::vector<unsigned int> m_npredecessors;
+
+  /**number of unfinished tasks each task still waits for (during a run)*/
+  std::vector<unsigned int> m_nwaiting;
+
+  /**heap of the ready tasks, the most expensive first*/
+  std::vector<unsigned int> m_ready;
+
+  /**number of tasks taken by the threads*/
+  unsigned int m_ntaken;
+};
+
+
+template<class Task>
+void CellScheduler::run(Task &task)
+{
+    start();
+#ifdef OMP
+    #pragma omp parallel default(shared)
+#endif
+    {
+      int t;
+      while((t = next()) >= 0)
+      {
+        task((unsigned int)t);
+        finish((unsigned int)t);
+      }
+    }
+}
+
+#endif
@@ -0,0 +1,204 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file CloudGenerator.cpp
+* @author Julie Digne
+* synthetic point clouds, see CloudGenerator.h
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CloudGenerator.h"
+#include "Random.h"
+
+#include <cmath>
+#include <string>
+
+using namespace std;
+
+/**number of points generated from the same random stream*/
+static const size_t chunk_size = 1 << 16;
+
+static const int nclusters = 32;
+
+static const double pi = 3.14159265358979323846;
+
+/**get a normally distributed value (Box-Muller)
+ * @param generator random generator
+ * @return random value
+ */
+static double gaussian(RandomGenerator &generator)
+{
+    double u = 1.0 - generator.uniformReal();
+    double v = generator.uniformReal();
+    return sqrt(-2.0 * log(u)) * cos(2.0 * pi * v);
+}
+
+/**get a direction uniformly distributed on the unit sphere (Marsaglia)
+ * @param generator random generator
+ * @param[out] d direction
+ */
+static void randomDirection(RandomGenerator &generator, double d[3])
+{
+    double u, v, s;
+    do
+    {
+      u = 2.0 * generator.uniformReal() - 1.0;
+      v = 2.0 * generator.uniformReal() - 1.0;
+      s = u * u + v * v;
+    }
+    while(s >= 1.0 || s == 0.0);
+    double t = 2.0 * sqrt(1.0 - s);
+    d[0] = u * t;
+    d[1] = v * t;
+    d[2] = 1.0 - 2.0 * s;
+}
+
+/**generate a point seen by a scanner
+ * @param generator random generator
+ * @return sample on a face of the unit cube, normal towards the scanner
+ */
+static Sample scanPoint(RandomGenerator &generator)
+{
+    const double scanner[3] = {0.35, 0.45, 0.15};
+    
+    //uniform azimuth and elevation: the density decreases with the
+    //distance and the incidence angle, as in a terrestrial scan
+    double azimuth = 2.0 * pi * generator.uniformReal();
+    double elevation = pi * (generator.uniformReal() * 0.75 - 0.25);
+    double d[3] = {cos(elevation) * cos(azimuth),
+                   cos(elevation) * sin(azimuth),
+                   sin(elevation)};
+    
+    double t = HUGE_VAL;
+    int face = 0;
+    for(int k = 0; k < 3; ++k)
+    {
+      if(d[k] == 0.0)
+        continue;
+      double tk = ((d[k] > 0 ? 1.0 : 0.0) - scanner[k]) / d[k];
+      if(tk < t)
+      {
+        t = tk;
+        face = k;
+      }
+    }
+    //range noise of the scanner
+    t += 2e-4 * gaussian(generator);
+    
+    double n[3] = {0, 0, 0};
+    n[face] = d[face] > 0 ? -1.0 : 1.0;
+    return Sample(scanner[0] + t * d[0], scanner[1] + t * d[1],
+                  scanner[2] + t * d[2], n[0], n[1], n[2]);
+}
+
+CloudGenerator::Distribution CloudGenerator::parseDistribution(const char *name)
+{
+    string s(name);
+    if(s == "cube")
+      return DISTRIBUTION_CUBE;
+    if(s == "sphere")
+      return DISTRIBUTION_SPHERE;
+    if(s == "scan")
+      return DISTRIBUTION_SCAN;
+    if(s == "clusters")
+      return DISTRIBUTION_CLUSTERS;
+    return DISTRIBUTION_UNKNOWN;
+}
+
+const char* CloudGenerator::getName(Distribution distribution)
+{
+    switch(distribution)
+    {
+      case DISTRIBUTION_CUBE: return "cube";
+      case DISTRIBUTION_SPHERE: return "sphere";
+      case DISTRIBUTION_SCAN: return "scan";
+      case DISTRIBUTION_CLUSTERS: return "clusters";
+      default: return "unknown";
+    }
+}
+
+void CloudGenerator::generate(Distribution distribution, size_t npoints,
+                              uint64_t seed, vector<Sample> &samples,
+                              double bbox[6])
+{
+    samples.resize(npoints);
+    
+    //clusters: center, axis scales and weight from the seed only
+    double clusters[nclusters][6];
+    RandomGenerator cluster_generator(seed, 0xffffffff);
+    for(int c = 0; c < nclusters; ++c)
+    {
+      for(int k = 0; k < 3; ++k)
+        clusters[c][k] = 0.1 + 0.8 * cluster_generator.uniformReal();
+      double sigma = 0.005 * pow(10.0, cluster_generator.uniformReal());
+      clusters[c][3] = sigma;
+      clusters[c][4] = sigma * (0.1 + 0.9 * cluster_generator.uniformReal());
+      clusters[c][5] = sigma * (0.01 + 0.2 * cluster_generator.uniformReal());
+    }
+    
+    long nchunks = (long)((npoints + chunk_size - 1) / chunk_size);
+#ifdef OMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for(long c = 0; c < nchunks; ++c)
+    {
+      RandomGenerator generator(seed, (unsigned int)c, distribution);
+      size_t end = (c + 1) * chunk_size < npoints ? (c + 1) * chunk_size : npoints;
+      for(size_t i = c * chunk_size; i < end; ++i)
+      {
+        switch(distribution)
+        {
+          case DISTRIBUTION_SPHERE:
+          {
+            double d[3];
+            randomDirection(generator, d);
+            samples[i] = Sample(0.5 + 0.45 * d[0], 0.5 + 0.45 * d[1],
+                                0.5 + 0.45 * d[2], d[0], d[1], d[2]);
+            break;
+          }
+          case DISTRIBUTION_SCAN:
+            samples[i] = scanPoint(generator);
+            break;
+          case DISTRIBUTION_CLUSTERS:
+          {
+            //squared uniform index: a few clusters hold most points
+            double u = generator.uniformReal();
+            const double *cluster = clusters[(int)(u * u * nclusters)];
+            samples[i] = Sample(cluster[0] + cluster[3] * gaussian(generator),
+                                cluster[1] + cluster[4] * gaussian(generator),
+                                cluster[2] + cluster[5] * gaussian(generator));
+            break;
+          }
+          default:
+            samples[i] = Sample(generator.uniformReal(), generator.uniformReal(),
+                                generator.uniformReal());
+        }
+      }
+    }
+    
+    bbox[0] = bbox[1] = bbox[2] = HUGE_VAL;
+    bbox[3] = bbox[4] = bbox[5] = -HUGE_VAL;
+    for(size_t i = 0; i < npoints; ++i)
+    {
+      const double p[3] = {samples[i].x(), samples[i].y(), samples[i].z()};
+      for(int k = 0; k < 3; ++k)
+      {
+        bbox[k] = p[k] < bbox[k] ? p[k] : bbox[k];
+        bbox[k + 3] = p[k] > bbox[k + 3] ? p[k] : bbox[k + 3];
+      }
+    }
+}
@@ -0,0 +1,82 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file CloudGenerator.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+ * @file CloudGenerator.h
+ * declares generators of synthetic point clouds (benchmarks).
+ * The clouds fill the unit cube (up to the noise of the clusters and of the
+ * scanner) and only depend on their size and seed.
+ */
+
+#ifndef CLOUD_GENERATOR_H
+#define CLOUD_GENERATOR_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+#include "Sample.h"
+
+class CloudGenerator
+{
+  public :
+
+  /**kinds of synthetic clouds*/
+  enum Distribution
+  {
+    /**uniform in the unit cube*/
+    DISTRIBUTION_CUBE,
+    /**uniform on a sphere, with normals*/
+    DISTRIBUTION_SPHERE,
+    /**room seen from a terrestrial scanner: rays uniform in angles hitting
+     * the faces of the cube, dense close to the scanner, sparse far away*/
+    DISTRIBUTION_SCAN,
+    /**anisotropic gaussian clusters of various sizes and densities*/
+    DISTRIBUTION_CLUSTERS,
+    DISTRIBUTION_UNKNOWN
+  };
+
+  /**get a distribution from its name (cube, sphere, scan, clusters)
+   * @param name name of the distribution
+   * @return distribution, DISTRIBUTION_UNKNOWN if the name is not known
+   */
+  static Distribution parseDistribution(const char *name);
+
+  /**get the name of a distribution
+   * @param distribution distribution
+   * @return name
+   */
+  static const char* getName(Distribution distribution);
+
+  /**generate a cloud (in parallel, the result does not depend on the
+   * number of threads)
+   * @param distribution kind of cloud
+   * @param npoints number of points
+   * @param seed seed of the generator
+   * @param[out] samples generated points
+   * @param[out] bbox bounding box of the points (xmin ymin zmin xmax ymax zmax)
+   */
+  static void generate(Distribution distribution, size_t npoints,
+                       uint64_t seed, std::vector<Sample> &samples,
+                       double bbox[6]);
+};
+
+#endif
@@ -0,0 +1,254 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file DistanceKernel.cpp
+* @author Julie Digne
+* SIMD distance kernels, see DistanceKernel.h
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DistanceKernel.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define PDSS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define PDSS_NEON_KERNEL
+#include <arm_neon.h>
+#endif
+
+static uint64_t distanceMaskScalar(const Scalar *x, const Scalar *y,
+                                   const Scalar *z, unsigned int n,
+                                   double qx, double qy, double qz,
+                                   double sqradius)
+{
+    uint64_t mask = 0;
+    for(unsigned int i = 0; i < n; ++i)
+    {
+      double dx = qx - x[i];
+      double dy = qy - y[i];
+      double dz = qz - z[i];
+      double dist = dx * dx + dy * dy + dz * dz;
+      if(dist < sqradius)
+        mask |= (uint64_t)1 << i;
+    }
+    return mask;
+}
+
+#ifdef PDSS_X86_KERNELS
+
+/**load 4 coordinates as doubles*/
+__attribute__((target("avx2")))
+static inline __m256d load4(const double *p)
+{
+    return _mm256_loadu_pd(p);
+}
+
+__attribute__((target("avx2")))
+static inline __m256d load4(const float *p)
+{
+    return _mm256_cvtps_pd(_mm_loadu_ps(p));
+}
+
+/**load the active ones of 8 coordinates as doubles (0 for the others)*/
+__attribute__((target("avx512f")))
+static inline __m512d load8(__mmask8 active, const double *p)
+{
+    return _mm512_maskz_loadu_pd(active, p);
+}
+
+__attribute__((target("avx512f")))
+static inline __m512d load8(__mmask8 active, const float *p)
+{
+    //a masked 256 bits load needs AVX-512VL: the last run is copied instead
+    //(the zero-masking conversion also avoids the undefined source of
+    //_mm512_cvtps_pd, which gcc reports as uninitialized)
+    if(active == (__mmask8)0xff)
+      return _mm512_maskz_cvtps_pd(active, _mm256_loadu_ps(p));
+    float last[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    for(unsigned int i = 0; i < 8; ++i)
+      if(active & (1u << i))
+        last[i] = p[i];
+    return _mm512_maskz_cvtps_pd(active, _mm256_loadu_ps(last));
+}
+
+__attribute__((target("avx2")))
+static uint64_t distanceMaskAVX2(const Scalar *x, const Scalar *y,
+                                 const Scalar *z, unsigned int n,
+                                 double qx, double qy, double qz,
+                                 double sqradius)
+{
+    const __m256d vqx = _mm256_set1_pd(qx);
+    const __m256d vqy = _mm256_set1_pd(qy);
+    const __m256d vqz = _mm256_set1_pd(qz);
+    const __m256d vr = _mm256_set1_pd(sqradius);
+    uint64_t mask = 0;
+    unsigned int i = 0;
+    for(; i + 4 <= n; i += 4)
+    {
+      __m256d dx = _mm256_sub_pd(vqx, load4(x + i));
+      __m256d dy = _mm256_sub_pd(vqy, load4(y + i));
+      __m256d dz = _mm256_sub_pd(vqz, load4(z + i));
+      __m256d dist = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(dx, dx),
+                                                 _mm256_mul_pd(dy, dy)),
+                                   _mm256_mul_pd(dz, dz));
+      uint64_t hits = _mm256_movemask_pd(_mm256_cmp_pd(dist, vr, _CMP_LT_OQ));
+      mask |= hits << i;
+    }
+    if(i < n)
+      mask |= distanceMaskScalar(x + i, y + i, z + i, n - i, qx, qy, qz,
+                                 sqradius) << i;
+    return mask;
+}
+
+__attribute__((target("avx512f")))
+static uint64_t distanceMaskAVX512(const Scalar *x, const Scalar *y,
+                                   const Scalar *z, unsigned int n,
+                                   double qx, double qy, double qz,
+                                   double sqradius)
+{
+    const __m512d vqx = _mm512_set1_pd(qx);
+    const __m512d vqy = _mm512_set1_pd(qy);
+    const __m512d vqz = _mm512_set1_pd(qz);
+    const __m512d vr = _mm512_set1_pd(sqradius);
+    uint64_t mask = 0;
+    for(unsigned int i = 0; i < n; i += 8)
+    {
+      //the last run is masked instead of finished in scalar
+      __mmask8 active = (n - i >= 8) ? (__mmask8)0xff
+                                     : (__mmask8)((1u << (n - i)) - 1);
+      __m512d dx = _mm512_sub_pd(vqx, load8(active, x + i));
+      __m512d dy = _mm512_sub_pd(vqy, load8(active, y + i));
+      __m512d dz = _mm512_sub_pd(vqz, load8(active, z + i));
+      __m512d dist = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(dx, dx),
+                                                 _mm512_mul_pd(dy, dy)),
+                                   _mm512_mul_pd(dz, dz));
+      uint64_t hits = _mm512_mask_cmp_pd_mask(active, dist, vr, _CMP_LT_OQ);
+      mask |= hits << i;
+    }
+    return mask;
+}
+
+#endif
+
+#ifdef PDSS_NEON_KERNEL
+
+/**load 2 coordinates as doubles*/
+static inline float64x2_t load2(const double *p)
+{
+    return vld1q_f64(p);
+}
+
+static inline float64x2_t load2(const float *p)
+{
+    return vcvt_f64_f32(vld1_f32(p));
+}
+
+static uint64_t distanceMaskNEON(const Scalar *x, const Scalar *y,
+                                 const Scalar *z, unsigned int n,
+                                 double qx, double qy, double qz,
+                                 double sqradius)
+{
+    const float64x2_t vqx = vdupq_n_f64(qx);
+    const float64x2_t vqy = vdupq_n_f64(qy);
+    const float64x2_t vqz = vdupq_n_f64(qz);
+    const float64x2_t vr = vdupq_n_f64(sqradius);
+    uint64_t mask = 0;
+    unsigned int i = 0;
+    for(; i + 2 <= n; i += 2)
+    {
+      float64x2_t dx = vsubq_f64(vqx, load2(x + i));
+      float64x2_t dy = vsubq_f64(vqy, load2(y + i));
+      float64x2_t dz = vsubq_f64(vqz, load2(z + i));
+      float64x2_t dist = vaddq_f64(vaddq_f64(vmulq_f64(dx, dx),
+                                             vmulq_f64(dy, dy)),
+                                   vmulq_f64(dz, dz));
+      uint64x2_t hits = vcltq_f64(dist, vr);
+      mask |= (vgetq_lane_u64(hits, 0) & 1) << i;
+      mask |= (vgetq_lane_u64(hits, 1) & 1) << (i + 1);
+    }
+    if(i < n)
+      mask |= distanceMaskScalar(x + i, y + i, z + i, n - i, qx, qy, qz,
+                                 sqradius) << i;
+    return mask;
+}
+
+#endif
+
+/**name and function of a kernel*/
+struct KernelEntry
+{
+  const char *name;
+
+  Distance_kernel kernel;
+};
+
+/**select the kernel once for all
+ * @return fastest supported kernel, or the one forced by PDSS_DISTANCE_KERNEL
+ */
+static KernelEntry selectKernel()
+{
+    KernelEntry entries[3];
+    int nentries = 0;
+#ifdef PDSS_X86_KERNELS
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx512f"))
+    {
+      entries[nentries].name = "avx512";
+      entries[nentries++].kernel = distanceMaskAVX512;
+    }
+    if(__builtin_cpu_supports("avx2"))
+    {
+      entries[nentries].name = "avx2";
+      entries[nentries++].kernel = distanceMaskAVX2;
+    }
+#endif
+#ifdef PDSS_NEON_KERNEL
+    entries[nentries].name = "neon";
+    entries[nentries++].kernel = distanceMaskNEON;
+#endif
+    entries[nentries].name = "scalar";
+    entries[nentries++].kernel = distanceMaskScalar;
+
+    const char *forced = getenv("PDSS_DISTANCE_KERNEL");
+    if(forced != NULL)
+      for(int i = 0; i < nentries; ++i)
+        if(strcmp(forced, entries[i].name) == 0)
+          return entries[i];
+    return entries[0];
+}
+
+static const KernelEntry& getKernelEntry()
+{
+    static const KernelEntry entry = selectKernel();
+    return entry;
+}
+
+Distance_kernel getDistanceKernel()
+{
+    return getKernelEntry().kernel;
+}
+
+const char* getDistanceKernelName()
+{
+    return getKernelEntry().name;
+}
@@ -0,0 +1,71 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file DistanceKernel.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+ * @file DistanceKernel.h
+ * declares the kernels testing the square distances from a query to a run
+ * of points stored as separate x, y and z arrays of Scalar (float with
+ * PDSS_FLOAT32, which halves the memory read per test). The kernels widen
+ * the coordinates to double and compute (qx-x)^2 + (qy-y)^2 + (qz-z)^2 in
+ * the same order as dist2 and without fused operations, so that all of them
+ * give the same hits.
+ * The kernel is chosen once at run time from the instruction sets of the
+ * cpu (AVX-512, AVX2, NEON or scalar); the PDSS_DISTANCE_KERNEL environment
+ * variable (scalar, avx2, avx512) forces a supported one.
+ */
+
+#ifndef DISTANCE_KERNEL_H
+#define DISTANCE_KERNEL_H
+
+#include <stdint.h>
+
+#include "Point.h"
+
+/**maximum number of points tested by one call of a kernel*/
+#define DISTANCE_KERNEL_WIDTH 64
+
+/**test the points closer than a radius to a query
+ * @param x x coordinates of the points
+ * @param y y coordinates of the points
+ * @param z z coordinates of the points
+ * @param n number of points (at most DISTANCE_KERNEL_WIDTH)
+ * @param qx x coordinate of the query
+ * @param qy y coordinate of the query
+ * @param qz z coordinate of the query
+ * @param sqradius square radius
+ * @return mask of the points such that dist2 < sqradius (bit i for point i)
+ */
+typedef uint64_t (*Distance_kernel)(const Scalar *x, const Scalar *y,
+                                    const Scalar *z, unsigned int n,
+                                    double qx, double qy, double qz,
+                                    double sqradius);
+
+/**get the fastest kernel supported by the cpu
+ * @return kernel
+ */
+Distance_kernel getDistanceKernel();
+
+/**get the name of the kernel returned by getDistanceKernel
+ * @return name (scalar, avx2, avx512 or neon)
+ */
+const char* getDistanceKernelName();
+
+#endif
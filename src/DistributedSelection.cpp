@@ -0,0 +1,387 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file DistributedSelection.cpp
+* @author Julie Digne
+* selection by slabs across MPI processes, see DistributedSelection.h
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DistributedSelection.h"
+
+#include "Random.h"
+
+#include <cfloat>
+#include <cmath>
+
+using namespace std;
+
+/**get a coordinate of a point
+ * @param p point
+ * @param axis 0 for x, 1 for y, 2 for z
+ * @return coordinate
+ */
+static double getCoordinate(const Point &p, int axis)
+{
+    return axis == 0 ? p.x() : (axis == 1 ? p.y() : p.z());
+}
+
+DistributedSelection::DistributedSelection(double radius, uint64_t seed,
+                                           MPI_Comm comm)
+{
+    m_radius = radius;
+    m_seed = seed;
+    m_comm = comm;
+    MPI_Comm_rank(comm, &m_rank);
+    MPI_Comm_size(comm, &m_nprocesses);
+    for(int k = 0; k < 3; ++k)
+    {
+      m_bbox[k] = DBL_MAX;
+      m_bbox[k + 3] = -DBL_MAX;
+      m_origin[k] = 0;
+    }
+    m_axis = 0;
+    m_slab_size = 0;
+    m_nslabs = 0;
+    m_npoints = 0;
+}
+
+bool DistributedSelection::performSelection(const char *filename,
+                                            FileIO::Format format,
+                                            const std::string &method)
+{
+    int ok = FileIO::streamPoints(filename, format, *this, 1 << 28,
+                                  m_rank, m_nprocesses);
+    int all_ok = 0;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, m_comm);
+    if(!all_ok)
+      return false;
+
+    computeSlabs();
+    distributePoints();
+
+    //first colour: the even slabs, then their halos go to the odd slabs
+    bool has_slab = m_rank < m_nslabs;
+    Values halos;
+    if(has_slab && m_rank % 2 == 0)
+    {
+      selectSlab(method, halos);
+      Values halo;
+      if(m_rank > 0)
+      {
+        getHalo(false, halo);
+        sendValues(halo, m_rank - 1, m_comm);
+      }
+      if(m_rank + 1 < m_nslabs)
+      {
+        halo.clear();
+        getHalo(true, halo);
+        sendValues(halo, m_rank + 1, m_comm);
+      }
+    }
+
+    //second colour: the odd slabs, covered by the halos of both neighbours
+    if(has_slab && m_rank % 2 == 1)
+    {
+      receiveValues(halos, m_rank - 1, m_comm);
+      if(m_rank + 1 < m_nslabs)
+        receiveValues(halos, m_rank + 1, m_comm);
+      selectSlab(method, halos);
+    }
+    return true;
+}
+
+void DistributedSelection::process(std::vector<Sample> &samples,
+                                   const double origin[3])
+{
+    //the same origin for all the windows of the file
+    for(int k = 0; k < 3; ++k)
+      m_origin[k] = origin[k];
+    std::vector<Sample>::const_iterator si;
+    for(si = samples.begin(); si != samples.end(); ++si)
+    {
+      double p[3] = {origin[0] + si->x(), origin[1] + si->y(),
+                     origin[2] + si->z()};
+      for(int k = 0; k < 3; ++k)
+      {
+        m_bbox[k] = p[k] < m_bbox[k] ? p[k] : m_bbox[k];
+        m_bbox[k + 3] = p[k] > m_bbox[k + 3] ? p[k] : m_bbox[k + 3];
+      }
+    }
+    m_points.insert(m_points.end(), samples.begin(), samples.end());
+}
+
+bool DistributedSelection::save(const char *filename, FileIO::Format format)
+{
+    PointWriter writer;
+    if(!writer.open(filename, format, m_selected.size()))
+      return false;
+    if(!m_selected.empty())
+      writer.writeSamples(m_octree, m_selected);
+    return writer.close();
+}
+
+bool DistributedSelection::gather(const char *filename, FileIO::Format format)
+{
+    unsigned long nselected = m_selected.size();
+    unsigned long total = 0;
+    MPI_Reduce(&nselected, &total, 1, MPI_UNSIGNED_LONG, MPI_SUM, 0, m_comm);
+
+    int ok = 1;
+    if(m_rank != 0)
+    {
+      Values values;
+      for(size_t i = 0; i < m_selected.size(); ++i)
+        pack(m_octree.points_begin()[m_selected[i]], m_origin, values);
+      sendValues(values, 0, m_comm);
+    }
+    else
+    {
+      //the parts are received even if the file cannot be written, so that
+      //the other processes do not wait forever
+      PointWriter writer;
+      ok = writer.open(filename, format, total);
+      if(ok && !m_selected.empty())
+        writer.writeSamples(m_octree, m_selected);
+      for(int source = 1; source < m_nprocesses; ++source)
+      {
+        Values values;
+        receiveValues(values, source, m_comm);
+        for(size_t i = 0; ok && i + 6 <= values.size(); i += 6)
+          writer.write(Sample(values[i] - m_origin[0],
+                              values[i + 1] - m_origin[1],
+                              values[i + 2] - m_origin[2],
+                              values[i + 3], values[i + 4], values[i + 5]),
+                       m_origin);
+      }
+      ok = writer.close() && ok;
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, m_comm);
+    return ok;
+}
+
+unsigned int DistributedSelection::getNSlabs() const
+{
+    return m_nslabs;
+}
+
+unsigned long DistributedSelection::getNPoints() const
+{
+    return m_npoints;
+}
+
+unsigned long DistributedSelection::getNSelected() const
+{
+    return m_selected.size();
+}
+
+int DistributedSelection::getSlab(double coordinate) const
+{
+    if(m_slab_size <= 0)
+      return 0;
+    double slab = floor((coordinate - m_bbox[m_axis]) / m_slab_size);
+    if(slab < 0)
+      return 0;
+    return slab >= m_nslabs ? m_nslabs - 1 : (int)slab;
+}
+
+void DistributedSelection::computeSlabs()
+{
+    double bbox[6];
+    MPI_Allreduce(m_bbox, bbox, 3, MPI_DOUBLE, MPI_MIN, m_comm);
+    MPI_Allreduce(m_bbox + 3, bbox + 3, 3, MPI_DOUBLE, MPI_MAX, m_comm);
+    for(int k = 0; k < 6; ++k)
+      m_bbox[k] = bbox[k];
+    if(m_bbox[0] > m_bbox[3])
+    {
+      //no points at all
+      m_nslabs = 0;
+      return;
+    }
+
+    m_axis = 0;
+    for(int k = 1; k < 3; ++k)
+      if(m_bbox[k + 3] - m_bbox[k] > m_bbox[m_axis + 3] - m_bbox[m_axis])
+        m_axis = k;
+    double extent = m_bbox[m_axis + 3] - m_bbox[m_axis];
+
+    //as the tiles, a slab holds at least two processing cells
+    double min_size = 2.0 * SampleSelection::getProcessingCellSize(m_radius);
+    double nslabs = floor(extent / min_size);
+    m_nslabs = nslabs < 1 ? 1 : (nslabs > m_nprocesses ? m_nprocesses
+                                                        : (int)nslabs);
+    m_slab_size = extent / m_nslabs;
+}
+
+void DistributedSelection::distributePoints()
+{
+    std::vector<Values> outboxes(m_nprocesses);
+    std::vector<Sample>::const_iterator si;
+    if(m_nslabs > 0)
+      for(si = m_points.begin(); si != m_points.end(); ++si)
+        pack(*si, m_origin, outboxes[getSlab(m_origin[m_axis]
+                                             + getCoordinate(*si, m_axis))]);
+    std::vector<Sample>().swap(m_points);
+
+    Values inbox;
+    exchangeValues(outboxes, inbox, m_comm);
+    //the points of the slab are stored relative to the corner of the cloud
+    Point::chooseStorageOrigin(m_bbox[0], m_bbox[1], m_bbox[2], m_origin);
+    m_points.reserve(inbox.size() / 6);
+    for(size_t i = 0; i + 6 <= inbox.size(); i += 6)
+      m_points.push_back(Sample(inbox[i] - m_origin[0],
+                                inbox[i + 1] - m_origin[1],
+                                inbox[i + 2] - m_origin[2],
+                                inbox[i + 3], inbox[i + 4], inbox[i + 5]));
+}
+
+void DistributedSelection::selectSlab(const std::string &method,
+                                      const Values &halos)
+{
+    //the octree covers the slab and one radius around it
+    double bbox[6];
+    for(int k = 0; k < 6; ++k)
+      bbox[k] = m_bbox[k];
+    bbox[m_axis] += m_rank * m_slab_size - m_radius;
+    bbox[m_axis + 3] = m_bbox[m_axis] + (m_rank + 1) * m_slab_size + m_radius;
+
+    m_octree.initialize(bbox, m_radius, m_origin);
+    m_octree.setPoints(m_points);
+    m_npoints = m_octree.getNpoints();
+
+    OctreeIterator iterator(&m_octree);
+    iterator.setR(m_radius);
+    SampleSelection selection(m_radius, &m_octree, &iterator);
+    RandomGenerator generator(m_seed, m_rank);
+    selection.setSeed(generator.next());
+    selection.setVerbose(false);
+
+    for(size_t i = 0; i + 6 <= halos.size(); i += 6)
+      selection.cover(Sample(halos[i] - m_origin[0],
+                             halos[i + 1] - m_origin[1],
+                             halos[i + 2] - m_origin[2],
+                             halos[i + 3], halos[i + 4], halos[i + 5]));
+
+    if(method == "scan")
+      selection.performParallelSelection();
+    else if(method == "grid")
+      selection.performGridSelection();
+    else
+      selection.performDartThrowingSelection();
+    m_selected = selection.getSelectedSamples();
+}
+
+void DistributedSelection::getHalo(bool high, Values &values)
+{
+    double low_border = m_bbox[m_axis] + m_rank * m_slab_size;
+    double high_border = low_border + m_slab_size;
+    for(size_t i = 0; i < m_selected.size(); ++i)
+    {
+      const Sample &s = m_octree.points_begin()[m_selected[i]];
+      double c = m_origin[m_axis] + getCoordinate(s, m_axis);
+      if(high ? c >= high_border - m_radius : c < low_border + m_radius)
+        pack(s, m_origin, values);
+    }
+}
+
+void DistributedSelection::pack(const Sample &s, const double origin[3],
+                                Values &values)
+{
+    values.push_back(origin[0] + s.x());
+    values.push_back(origin[1] + s.y());
+    values.push_back(origin[2] + s.z());
+    values.push_back(s.nx());
+    values.push_back(s.ny());
+    values.push_back(s.nz());
+}
+
+void DistributedSelection::exchangeValues(std::vector<Values> &outboxes,
+                                          Values &inbox, MPI_Comm comm)
+{
+    const int nprocesses = outboxes.size();
+    //whole samples per round, less than 2^27 values received by round so
+    //that the displacements fit in an int
+    int chunk = (1 << 27) / nprocesses / 6 * 6;
+    chunk = chunk < 6 ? 6 : chunk;
+
+    std::vector<size_t> sent(nprocesses, 0);
+    std::vector<int> send_counts(nprocesses), send_displs(nprocesses);
+    std::vector<int> recv_counts(nprocesses), recv_displs(nprocesses);
+    Values send_buffer;
+    for(;;)
+    {
+      int remaining = 0;
+      send_buffer.clear();
+      for(int p = 0; p < nprocesses; ++p)
+      {
+        size_t left = outboxes[p].size() - sent[p];
+        send_counts[p] = left < (size_t)chunk ? (int)left : chunk;
+        send_displs[p] = send_buffer.size();
+        send_buffer.insert(send_buffer.end(), outboxes[p].begin() + sent[p],
+                           outboxes[p].begin() + sent[p] + send_counts[p]);
+        sent[p] += send_counts[p];
+        remaining = remaining || sent[p] < outboxes[p].size();
+      }
+
+      MPI_Alltoall(&send_counts[0], 1, MPI_INT, &recv_counts[0], 1, MPI_INT,
+                   comm);
+      int nreceived = 0;
+      for(int p = 0; p < nprocesses; ++p)
+      {
+        recv_displs[p] = nreceived;
+        nreceived += recv_counts[p];
+      }
+      size_t offset = inbox.size();
+      inbox.resize(offset + nreceived);
+      MPI_Alltoallv(send_buffer.empty() ? NULL : &send_buffer[0],
+                    &send_counts[0], &send_displs[0], MPI_DOUBLE,
+                    nreceived == 0 ? NULL : &inbox[offset],
+                    &recv_counts[0], &recv_displs[0], MPI_DOUBLE, comm);
+
+      int any_remaining = 0;
+      MPI_Allreduce(&remaining, &any_remaining, 1, MPI_INT, MPI_MAX, comm);
+      if(!any_remaining)
+        break;
+    }
+
+    for(int p = 0; p < nprocesses; ++p)
+      Values().swap(outboxes[p]);
+}
+
+void DistributedSelection::sendValues(const Values &values, int destination,
+                                      MPI_Comm comm)
+{
+    uint64_t n = values.size();
+    MPI_Send(&n, 1, MPI_UINT64_T, destination, 0, comm);
+    const uint64_t chunk = 1 << 26;
+    for(uint64_t i = 0; i < n; i += chunk)
+      MPI_Send((void*)&values[i], (int)(n - i < chunk ? n - i : chunk),
+               MPI_DOUBLE, destination, 0, comm);
+}
+
+void DistributedSelection::receiveValues(Values &values, int source,
+                                         MPI_Comm comm)
+{
+    uint64_t n = 0;
+    MPI_Recv(&n, 1, MPI_UINT64_T, source, 0, comm, MPI_STATUS_IGNORE);
+    size_t offset = values.size();
+    values.resize(offset + n);
+    const uint64_t chunk = 1 << 26;
+    for(uint64_t i = 0; i < n; i += chunk)
+      MPI_Recv(&values[offset + i], (int)(n - i < chunk ? n - i : chunk),
+               MPI_DOUBLE, source, 0, comm, MPI_STATUS_IGNORE);
+}
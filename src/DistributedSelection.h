@@ -0,0 +1,203 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file DistributedSelection.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+ * @file DistributedSelection.h
+ * declares the selection of a point cloud across the processes of an MPI
+ * communicator. Each process reads its part of the input file, the bounding
+ * box of the cloud is reduced over all processes and split along its
+ * longest side into slabs, one per process, and the points are sent to the
+ * process of their slab. The slabs are then subsampled in two colours, as
+ * the cells of the dart throwing: the even slabs first, all at once, then
+ * the odd slabs, whose points are first covered by the samples selected
+ * within one radius of their borders by their even neighbours. The slabs
+ * being at least two processing cells wide, the slabs of a colour are more
+ * than one radius apart: the selection is globally conflict-free.
+ */
+
+#ifndef DISTRIBUTED_SELECTION_H
+#define DISTRIBUTED_SELECTION_H
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include <mpi.h>
+
+#include "types.h"
+#include "FileIO.h"
+#include "Sample.h"
+
+/**@class DistributedSelection
+ * Poisson disk subsampling by slabs, one per MPI process
+ */
+class DistributedSelection : public PointHandler
+{
+  public :
+
+  /**constructor
+   * @param radius selection radius
+   * @param seed seed of the dart throwing
+   * @param comm communicator of the processes sharing the cloud
+   */
+  DistributedSelection(double radius, uint64_t seed,
+                       MPI_Comm comm = MPI_COMM_WORLD);
+
+  /**read the part of a file of this process, distribute the points to the
+   * slabs and subsample the slab of this process (collective)
+   * @param filename name of the file to read points from
+   * @param format format of the file
+   * @param method selection of the slabs: dart, grid or scan
+   * @return false if something went wrong on any process
+   */
+  bool performSelection(const char *filename, FileIO::Format format,
+                        const std::string &method);
+
+  /**keep the points read
+   * @param samples points read
+   * @param origin origin the points are stored relative to
+   */
+  void process(std::vector<Sample> &samples, const double origin[3]);
+
+  /**write the samples of the slab of this process
+   * @param filename name of the file to write to
+   * @param format format of the file
+   * @return false if something went wrong
+   */
+  bool save(const char *filename, FileIO::Format format);
+
+  /**write the samples of all the slabs, in order, from the first process
+   * (collective)
+   * @param filename name of the file to write to
+   * @param format format of the file
+   * @return false if something went wrong on any process
+   */
+  bool gather(const char *filename, FileIO::Format format);
+
+  /**get the number of non empty slabs (at most the number of processes)
+   * @return number of slabs
+   */
+  unsigned int getNSlabs() const;
+
+  /**get the number of points of the slab of this process
+   * @return number of points
+   */
+  unsigned long getNPoints() const;
+
+  /**get the number of points selected in the slab of this process
+   * @return number of points
+   */
+  unsigned long getNSelected() const;
+
+  private :
+
+  typedef std::vector<double> Values;
+
+  /**get the slab of a position along the split axis
+   * @param coordinate coordinate along the split axis
+   * @return index of the slab
+   */
+  int getSlab(double coordinate) const;
+
+  /**compute the slabs from the bounding boxes of all processes*/
+  void computeSlabs();
+
+  /**send the points read to the processes of their slabs*/
+  void distributePoints();
+
+  /**build the octree of the slab of this process and subsample it
+   * @param method selection method
+   * @param halos samples selected by the neighbouring slabs
+   */
+  void selectSlab(const std::string &method, const Values &halos);
+
+  /**get the samples selected within one radius of a border of the slab
+   * @param high true for the border of the largest coordinates
+   * @param[out] values packed samples
+   */
+  void getHalo(bool high, Values &values);
+
+  /**append a sample to packed values (6 doubles per sample, absolute
+   * coordinates)
+   * @param s sample
+   * @param origin origin the sample is stored relative to
+   * @param[in,out] values packed values
+   */
+  static void pack(const Sample &s, const double origin[3], Values &values);
+
+  /**exchange packed values between all processes, in chunks
+   * @param outboxes values to send to each process
+   * @param[out] inbox values received from all processes (whole samples)
+   * @param comm communicator
+   */
+  static void exchangeValues(std::vector<Values> &outboxes, Values &inbox,
+                             MPI_Comm comm);
+
+  /**send packed values to a process
+   * @param values values to send
+   * @param destination rank of the receiving process
+   * @param comm communicator
+   */
+  static void sendValues(const Values &values, int destination, MPI_Comm comm);
+
+  /**receive packed values sent by sendValues
+   * @param[out] values values received (appended)
+   * @param source rank of the sending process
+   * @param comm communicator
+   */
+  static void receiveValues(Values &values, int source, MPI_Comm comm);
+
+  double m_radius;
+
+  uint64_t m_seed;
+
+  MPI_Comm m_comm;
+
+  int m_rank;
+
+  int m_nprocesses;
+
+  /**points read, then points of the slab*/
+  std::vector<Sample> m_points;
+
+  /**origin m_points are stored relative to: the one of the file read,
+   * then the one of the octree*/
+  double m_origin[3];
+
+  /**bounding box of the points read, then of the whole cloud*/
+  double m_bbox[6];
+
+  /**split axis (0 for x, 1 for y, 2 for z)*/
+  int m_axis;
+
+  double m_slab_size;
+
+  int m_nslabs;
+
+  Octree m_octree;
+
+  /**ids of the samples of the slab in the octree*/
+  std::vector<size_t> m_selected;
+
+  unsigned long m_npoints;
+};
+
+#endif
@@ -29,6 +29,20 @@
 #include<ostream>
 #include<sstream>
 #include <iomanip>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#ifdef OMP
+#include <omp.h>
+#endif
 
 using namespace std;
 
@@ -43,256 +57,1199 @@ FileIO::~FileIO()
 
 bool FileIO::readAndSortPoints(const char* filename, Octree& octree, double min_radius)
 {
-      ifstream in;
-      in.open(filename);
+      size_t length;
+      const char *data = mapFile(filename, length);
       
-      if(!in)
+      if(data == NULL)
       {
 	std::cerr<<"File "<<filename<<" could not be opened"<<std::endl;
 	return false;
       }
       
-	string firstline;
-	
-	getline(in, firstline);
-	
-	 istringstream line_in(firstline);
-	 string word;
-	int nword = 0;
-	 while (line_in>> word)
-	   nword++;
-	
-	in.clear() ;
-	in.seekg(0, ios::beg);
-	
-	double x,y,z;
-	in >> x >> y >> z;
-
-	list<Sample> input_samples;
-	input_samples.push_back(Sample(x,y,z));
-	
-	double xmin, ymin, zmin, xmax, ymax, zmax;
-	xmin = xmax = x;
-	ymin = ymax = y;
-	zmin = zmax = z;
-	
-	while( in >> x >> y >> z)
-	{
-	    input_samples.push_back(Sample(x,y,z));
-	 
-	    xmin = x < xmin ? x : xmin;
-	    xmax = x > xmax ? x : xmax;
-	    ymin = y < ymin ? y : ymin;
-	    ymax = y > ymax ? y : ymax;
-	    zmin = z < zmin ? z : zmin;
-	    zmax = z > zmax ? z : zmax;
-	}
-	in.close();
+	vector<Sample> input_samples;
+	double bbox[6], origin[3];
+	getStorageOrigin(data, length, 3, origin);
+	parsePoints(data, length, 3, origin, input_samples, bbox);
+	unmapFile(data, length);
 	
 	std::cout<<input_samples.size()<<" points read"<<std::endl;
+	if(input_samples.empty())
+	  return false;
 	
-	double lx = xmax - xmin;
-	double ly = ymax - ymin;
-	double lz = zmax - zmin;
-	
-	double size = lx > ly ? lx : ly;
-	size = size > lz ? size : lz;
-
-	
-	size = 1.1 * size;
-	double margin;
-	
-	
-	if(min_radius > 0)
-	{
-	  unsigned int depth = (unsigned int)ceil( log2( size / (min_radius) ));
-	  double adapted_size = pow2(depth) * min_radius;
-	  margin = 0.5 * (adapted_size - size);
-	  size = adapted_size;
-	  octree.setDepth(depth);
-	}
-	else
-	{
-	  margin = 0.05 * size;
-	}
-	
-	double ox = xmin - margin;
-	double oy = ymin - margin;
-	double oz = zmin - margin;
-	Point origin(ox,oy,oz);
-
-	octree.initialize(origin, size);
-
-	octree.addPoints(input_samples.begin(), input_samples.end());
-	
+	octree.initialize(bbox, min_radius, origin);
+	octree.setPoints(input_samples);
 	return true;
 }
 
 bool FileIO::readAndSortOrientedPoints(const char* filename, Octree& octree, double min_radius)
 {
-      ifstream in;
-      in.open(filename);
+      size_t length;
+      const char *data = mapFile(filename, length);
       
-      if(!in)
+      if(data == NULL)
       {
 	std::cerr<<"File "<<filename<<" could not be opened"<<std::endl;
 	return false;
       }
       
-	string firstline;
-	
-	getline(in, firstline);
-	
-	 istringstream line_in(firstline);
-	 string word;
-	int nword = 0;
-	 while (line_in>> word)
-	   nword++;
-	
-	if(nword == 3)
-	{
-	  cerr<< "Only three doubles per line: unoriented points"<<endl;
-        readAndSortPoints(filename, octree, min_radius);
-        return true;
-	}
-	
-//	if( nword != 6)
-//	{
-//	  cerr<<"each point must be given by 6 values (position + normal) : x y z nx 
-//ny nz"<<endl;
-//	  return false;
-//	}
-	
-	in.clear() ;
-	in.seekg(0, ios::beg);
-	
-	double x,y,z,nx,ny,nz;
-	in >> x >> y >> z >> nx >> ny >> nz;
-
-	list<Sample> input_samples;
-	input_samples.push_back(Sample(x,y,z,nx,ny,nz));
+	unsigned int ncols = getPointColumns(data, length);
 	
-	double xmin, ymin, zmin, xmax, ymax, zmax;
-	xmin = xmax = x;
-	ymin = ymax = y;
-	zmin = zmax = z;
+	if(ncols == 3)
+	  cerr<< "Less than six doubles per line: unoriented points"<<endl;
 	
-	while( in >> x >> y >> z >> nx >> ny >> nz)
-	{
-	    input_samples.push_back(Sample(x,y,z,nx,ny,nz));
-	 
-	    xmin = x < xmin ? x : xmin;
-	    xmax = x > xmax ? x : xmax;
-	    ymin = y < ymin ? y : ymin;
-	    ymax = y > ymax ? y : ymax;
-	    zmin = z < zmin ? z : zmin;
-	    zmax = z > zmax ? z : zmax;
-	}
-	in.close();
+	vector<Sample> input_samples;
+	double bbox[6], origin[3];
+	getStorageOrigin(data, length, ncols, origin);
+	parsePoints(data, length, ncols, origin, input_samples, bbox);
+	unmapFile(data, length);
 	
 	std::cout<<input_samples.size()<<" points read"<<std::endl;
+	if(input_samples.empty())
+	  return false;
 	
-	double lx = xmax - xmin;
-	double ly = ymax - ymin;
-	double lz = zmax - zmin;
-	
-	double size = lx > ly ? lx : ly;
-	size = size > lz ? size : lz;
+	octree.initialize(bbox, min_radius, origin);
+	octree.setPoints(input_samples);
+	return true;
+}
 
-	
-	size = 1.1 * size;
-	double margin;
-	
-	
-	if(min_radius > 0)
-	{
-	  unsigned int depth = (unsigned int)ceil( log2( size / (min_radius) ));
-	  double adapted_size = pow2(depth) * min_radius;
-	  margin = 0.5 * (adapted_size - size);
-	  size = adapted_size;
-	  octree.setDepth(depth);
-	}
-	else
-	{
-	  margin = 0.05 * size;
-	}
-	
-	double ox = xmin - margin;
-	double oy = ymin - margin;
-	double oz = zmin - margin;
-	Point origin(ox,oy,oz);
+const char* FileIO::mapFile(const char *filename, size_t &length)
+{
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0)
+      return NULL;
+    
+    struct stat st;
+    if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+      close(fd);
+      return NULL;
+    }
+    
+    length = st.st_size;
+    if(length == 0)
+    {
+      close(fd);
+      return "";
+    }
+    
+    void *data = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+      return NULL;
+    madvise(data, length, MADV_SEQUENTIAL);
+    return (const char*)data;
+}
+
+void FileIO::unmapFile(const char *data, size_t length)
+{
+    if(length != 0)
+      munmap((void*)data, length);
+}
 
-	octree.initialize(origin, size);
+unsigned int FileIO::countColumns(const char *data, size_t length)
+{
+    const char *end = data + length;
+    const char *p = data;
+    unsigned int nword = 0;
+    while(p != end && *p != '\n')
+    {
+      while(p != end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+      if(p == end || *p == '\n')
+        break;
+      nword++;
+      while(p != end && !isspace((unsigned char)*p))
+        ++p;
+    }
+    return nword;
+}
 
-	octree.addPoints(input_samples.begin(), input_samples.end());
-	
-	return true;
+unsigned int FileIO::getPointColumns(const char *data, size_t length)
+{
+    return countColumns(data, length) < 6 ? 3 : 6;
 }
 
- bool FileIO::savePoints(const char* filename, Octree& octree)
-{ 
-    unsigned int ncovered = 0;
-      ofstream out;
-      out.open(filename);
-      
-      if(!out)
-	return false;
+void FileIO::getStorageOrigin(const char *data, size_t length,
+                              unsigned int ncols, double origin[3])
+{
+    //the first point read
+    const char *end = data + length;
+    double v[6] = {0, 0, 0, 0, 0, 0};
+    for(const char *p = data; p != end;)
+    {
+      bool ok;
+      p = parseLine(p, end, ncols, v, ok);
+      if(ok)
+        break;
+      v[0] = v[1] = v[2] = 0;
+    }
+    Point::chooseStorageOrigin(v[0], v[1], v[2], origin);
+}
+
+void FileIO::parsePoints(const char *data, size_t length, unsigned int ncols,
+                         const double origin[3], vector<Sample> &samples,
+                         double bbox[6])
+{
+    const char *end = data + length;
+    
+    //split the buffer into chunks starting at line beginnings
+    int nchunks = 1;
+#ifdef OMP
+    nchunks = 8 * omp_get_max_threads();
+#endif
+    const size_t min_chunk_size = 1 << 20;
+    if(length / nchunks < min_chunk_size)
+      nchunks = (int)(length / min_chunk_size) + 1;
+    
+    vector<const char*> chunks(nchunks + 1);
+    chunks[0] = data;
+    for(int c = 1; c < nchunks; ++c)
+    {
+      const char *p = data + length * c / nchunks;
+      if(p < chunks[c - 1])
+        p = chunks[c - 1];
+      const char *eol = (const char*)memchr(p, '\n', end - p);
+      chunks[c] = eol == NULL ? end : eol + 1;
+    }
+    chunks[nchunks] = end;
+    
+    //count the lines of each chunk to know where its samples go
+    vector<size_t> first(nchunks + 1, 0);
+#ifdef OMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for(int c = 0; c < nchunks; ++c)
+    {
+      size_t nlines = 0;
+      const char *p = chunks[c];
+      while(p != chunks[c + 1])
+      {
+        const char *eol = (const char*)memchr(p, '\n', chunks[c + 1] - p);
+        p = eol == NULL ? chunks[c + 1] : eol + 1;
+        nlines++;
+      }
+      first[c + 1] = nlines;
+    }
+    for(int c = 0; c < nchunks; ++c)
+      first[c + 1] += first[c];
+    
+    samples.resize(first[nchunks]);
+    
+    //parse the chunks (lines without enough values are skipped)
+    vector<size_t> nparsed(nchunks, 0);
+    vector<double> chunk_bbox(6 * nchunks);
+#ifdef OMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for(int c = 0; c < nchunks; ++c)
+    {
+      double *box = &chunk_bbox[6 * c];
+      box[0] = box[1] = box[2] = HUGE_VAL;
+      box[3] = box[4] = box[5] = -HUGE_VAL;
       
-      OctreeNode *node = octree.getRoot();
-      saveContent(node, out, ncovered);
- 
-      out.close();
+      Sample *out = samples.empty() ? NULL : &samples[first[c]];
+      size_t n = 0;
+      double v[6];
+      const char *p = chunks[c];
+      while(p != chunks[c + 1])
+      {
+        bool ok;
+        p = parseLine(p, chunks[c + 1], ncols, v, ok);
+        if(!ok)
+          continue;
+        
+        if(ncols == 6)
+          out[n] = Sample(v[0] - origin[0], v[1] - origin[1],
+                          v[2] - origin[2], v[3], v[4], v[5]);
+        else
+          out[n] = Sample(v[0] - origin[0], v[1] - origin[1],
+                          v[2] - origin[2]);
+        n++;
+        
+        for(int k = 0; k < 3; ++k)
+        {
+          box[k] = v[k] < box[k] ? v[k] : box[k];
+          box[k + 3] = v[k] > box[k + 3] ? v[k] : box[k + 3];
+        }
+      }
+      nparsed[c] = n;
+    }
+    
+    //remove the holes left by skipped lines and reduce the bounding boxes
+    bbox[0] = bbox[1] = bbox[2] = HUGE_VAL;
+    bbox[3] = bbox[4] = bbox[5] = -HUGE_VAL;
+    size_t nsamples = 0;
+    for(int c = 0; c < nchunks; ++c)
+    {
+      if(nsamples != first[c])
+        std::copy(samples.begin() + first[c],
+                  samples.begin() + first[c] + nparsed[c],
+                  samples.begin() + nsamples);
+      nsamples += nparsed[c];
       
-      std::cout<<"Cover rate (average number of time a point is covered)"
-               <<((double)ncovered)/((double)octree.getNpoints())<<std::endl;
+      for(int k = 0; k < 3; ++k)
+      {
+        double *box = &chunk_bbox[6 * c];
+        bbox[k] = box[k] < bbox[k] ? box[k] : bbox[k];
+        bbox[k + 3] = box[k + 3] > bbox[k + 3] ? box[k + 3] : bbox[k + 3];
+      }
+    }
+    samples.resize(nsamples);
+}
+
+const char* FileIO::parseLine(const char *p, const char *end,
+                              unsigned int ncols, double *values, bool &ok)
+{
+    ok = true;
+    for(unsigned int k = 0; k < ncols && ok; ++k)
+    {
+      while(p != end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+      const char *q = (p == end || *p == '\n') ? NULL : parseDouble(p, end, values[k]);
+      if(q == NULL)
+        ok = false;
+      else
+        p = q;
+    }
+    
+    //skip the remaining columns
+    const char *eol = (const char*)memchr(p, '\n', end - p);
+    return eol == NULL ? end : eol + 1;
+}
+
+const char* FileIO::parseDouble(const char *p, const char *end, double &value)
+{
+    //exact powers of ten
+    static const double powers[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    
+    const char *start = p;
+    bool negative = false;
+    if(p != end && (*p == '-' || *p == '+'))
+    {
+      negative = (*p == '-');
+      ++p;
+    }
+    
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int ndigits = 0;
+    bool exact = true;
+    for(; p != end && *p >= '0' && *p <= '9'; ++p, ++ndigits)
+    {
+      if(mantissa < 100000000000000000ULL)
+        mantissa = 10 * mantissa + (*p - '0');
+      else
+      {
+        exact = false;
+        exponent++;
+      }
+    }
+    if(p != end && *p == '.')
+    {
+      ++p;
+      for(; p != end && *p >= '0' && *p <= '9'; ++p, ++ndigits)
+      {
+        if(mantissa < 100000000000000000ULL)
+        {
+          mantissa = 10 * mantissa + (*p - '0');
+          exponent--;
+        }
+        else
+          exact = false;
+      }
+    }
+    if(ndigits > 0 && p != end && (*p == 'e' || *p == 'E'))
+    {
+      const char *q = p + 1;
+      bool negative_exponent = false;
+      if(q != end && (*q == '-' || *q == '+'))
+      {
+        negative_exponent = (*q == '-');
+        ++q;
+      }
+      if(q != end && *q >= '0' && *q <= '9')
+      {
+        int e = 0;
+        for(; q != end && *q >= '0' && *q <= '9'; ++q)
+          if(e < 100000)
+            e = 10 * e + (*q - '0');
+        exponent += negative_exponent ? -e : e;
+        p = q;
+      }
+    }
+    
+    if(ndigits > 0 && (p == end || isspace((unsigned char)*p))
+       && exact && mantissa < (1ULL << 53) && exponent >= -22 && exponent <= 22)
+    {
+      //one correctly rounded operation: same result as strtod
+      double v = (double)mantissa;
+      v = exponent < 0 ? v / powers[-exponent] : v * powers[exponent];
+      value = negative ? -v : v;
+      return p;
+    }
+    
+    //slow path (long mantissas, large exponents, inf, nan...)
+    char buffer[128];
+    size_t n = 0;
+    for(p = start; p != end && !isspace((unsigned char)*p) && n < sizeof(buffer) - 1; ++p)
+      buffer[n++] = *p;
+    buffer[n] = '\0';
+    char *stop;
+    value = strtod(buffer, &stop);
+    if(stop == buffer || *stop != '\0')
+      return NULL;
+    return p;
+}
+
+bool FileIO::savePoints(const char* filename, Octree& octree)
+{
+    PointWriter writer;
+    if(!writer.open(filename, FORMAT_ASCII))
+      return false;
+    return saveSelected(writer, octree);
+}
+
+bool FileIO::savePointsOFF(const char* filename, Octree& octree, int nselected)
+{
+    PointWriter writer;
+    if(!writer.open(filename, FORMAT_OFF, nselected))
+      return false;
+    return saveSelected(writer, octree);
+}
+
+bool FileIO::saveSelected(PointWriter &writer, Octree &octree)
+{
+    writer.writeSelected(octree);
+    bool ok = writer.close();
+    
+    std::cout<<"Cover rate (average number of time a point is covered)"
+             <<((double)writer.getNCovered())/((double)writer.getNPoints())<<std::endl;
+    return ok;
+}
+
+FileIO::Format FileIO::getFormat(const char *filename)
+{
+    string name(filename);
+    size_t dot = name.rfind('.');
+    if(dot == string::npos)
+      return FORMAT_ASCII;
+    
+    string extension = name.substr(dot + 1);
+    for(size_t i = 0; i < extension.size(); ++i)
+      extension[i] = tolower((unsigned char)extension[i]);
+    
+    Format format = parseFormat(extension.c_str());
+    return format == FORMAT_UNKNOWN ? FORMAT_ASCII : format;
+}
+
+FileIO::Format FileIO::parseFormat(const char *name)
+{
+    string s(name);
+    if(s == "ascii" || s == "xyz" || s == "txt")
+      return FORMAT_ASCII;
+    if(s == "off")
+      return FORMAT_OFF;
+    if(s == "ply")
+      return FORMAT_PLY;
+    if(s == "raw32")
+      return FORMAT_RAW32;
+    if(s == "raw64")
+      return FORMAT_RAW64;
+    return FORMAT_UNKNOWN;
+}
+
+bool FileIO::readAndSort(const char *filename, Format format,
+                         Octree &octree, double min_radius)
+{
+    switch(format)
+    {
+      case FORMAT_PLY:
+        return readAndSortPointsPLY(filename, octree, min_radius);
+      case FORMAT_RAW32:
+        return readAndSortPointsRaw(filename, octree, false, min_radius);
+      case FORMAT_RAW64:
+        return readAndSortPointsRaw(filename, octree, true, min_radius);
+      case FORMAT_OFF:
+        std::cerr<<"OFF is an output format only"<<std::endl;
+        return false;
+      default:
+        return readAndSortOrientedPoints(filename, octree, min_radius);
+    }
+}
+
+bool FileIO::save(const char *filename, Format format, Octree &octree,
+                  unsigned int nselected)
+{
+    switch(format)
+    {
+      case FORMAT_OFF:
+        return savePointsOFF(filename, octree, nselected);
+      case FORMAT_PLY:
+        return savePointsPLY(filename, octree, nselected);
+      case FORMAT_RAW32:
+        return savePointsRaw(filename, octree, false);
+      case FORMAT_RAW64:
+        return savePointsRaw(filename, octree, true);
+      default:
+        return savePoints(filename, octree);
+    }
+}
+
+bool FileIO::save(const char *filename, Format format, Octree &octree,
+                  const std::vector<size_t> &ids)
+{
+    PointWriter writer;
+    if(!writer.open(filename, format, ids.size()))
+      return false;
+    writer.writeSamples(octree, ids);
+    bool ok = writer.close();
+    
+    std::cout<<"Cover rate (average number of time a point is covered)"
+             <<((double)writer.getNCovered())/((double)writer.getNPoints())<<std::endl;
+    return ok;
+}
+
+bool FileIO::readAndSortPointsPLY(const char *filename, Octree &octree, double min_radius)
+{
+    size_t length;
+    const char *data = mapFile(filename, length);
+    
+    if(data == NULL)
+    {
+      std::cerr<<"File "<<filename<<" could not be opened"<<std::endl;
+      return false;
+    }
+    
+    BinaryLayout layout;
+    size_t nvertices, header_length;
+    if(!parsePLYHeader(data, length, layout, nvertices, header_length)
+       || length - header_length < nvertices * layout.stride)
+    {
+      std::cerr<<"Could not read the vertices of "<<filename<<std::endl;
+      unmapFile(data, length);
+      return false;
+    }
+    
+    vector<Sample> input_samples;
+    double bbox[6], origin[3];
+    getStorageOrigin(data + header_length, nvertices, layout, origin);
+    decodePoints(data + header_length, nvertices, layout, origin,
+                 input_samples, bbox);
+    unmapFile(data, length);
+    
+    std::cout<<input_samples.size()<<" points read"<<std::endl;
+    if(input_samples.empty())
+      return false;
+    
+    octree.initialize(bbox, min_radius, origin);
+    octree.setPoints(input_samples);
+    return true;
+}
+
+bool FileIO::readAndSortPointsRaw(const char *filename, Octree &octree,
+                                  bool doubles, double min_radius)
+{
+    size_t length;
+    const char *data = mapFile(filename, length);
+    
+    if(data == NULL)
+    {
+      std::cerr<<"File "<<filename<<" could not be opened"<<std::endl;
+      return false;
+    }
+    
+    BinaryLayout layout;
+    getRawLayout(doubles, layout);
+    
+    if(length % layout.stride != 0)
+      std::cerr<<"Warning: "<<filename<<" does not contain a whole number of points"<<std::endl;
+    
+    vector<Sample> input_samples;
+    double bbox[6], origin[3];
+    getStorageOrigin(data, length / layout.stride, layout, origin);
+    decodePoints(data, length / layout.stride, layout, origin, input_samples,
+                 bbox);
+    unmapFile(data, length);
+    
+    std::cout<<input_samples.size()<<" points read"<<std::endl;
+    if(input_samples.empty())
+      return false;
+    
+    octree.initialize(bbox, min_radius, origin);
+    octree.setPoints(input_samples);
+    return true;
+}
+
+bool FileIO::savePointsPLY(const char* filename, Octree &octree,
+                           unsigned int nselected)
+{
+    PointWriter writer;
+    if(!writer.open(filename, FORMAT_PLY, nselected))
+      return false;
+    return saveSelected(writer, octree);
+}
+
+bool FileIO::savePointsRaw(const char* filename, Octree &octree, bool doubles)
+{
+    PointWriter writer;
+    if(!writer.open(filename, doubles ? FORMAT_RAW64 : FORMAT_RAW32))
+      return false;
+    return saveSelected(writer, octree);
+}
+
+bool FileIO::parsePLYHeader(const char *data, size_t length,
+                            BinaryLayout &layout, size_t &nvertices,
+                            size_t &header_length)
+{
+    //parse the header
+    const char *end = data + length;
+    const char *p = data;
+    bool ok = true;
+    bool in_vertex = false;
+    bool header_done = false;
+    int nelements = 0;
+    nvertices = 0;
+    string format;
+    layout.stride = 0;
+    layout.nvalues = 0;
+    const char *names[6] = {"x", "y", "z", "nx", "ny", "nz"};
+    for(int k = 0; k < 6; ++k)
+      layout.types[k] = TYPE_NONE;
+    
+    while(ok && !header_done && p != end)
+    {
+      const char *eol = (const char*)memchr(p, '\n', end - p);
+      if(eol == NULL)
+        break;
+      istringstream line(string(p, eol));
+      p = eol + 1;
       
-      return true;
+      string keyword;
+      line >> keyword;
+      if(keyword == "ply" || keyword == "comment" || keyword == "obj_info" || keyword.empty())
+        continue;
+      else if(keyword == "format")
+        line >> format;
+      else if(keyword == "element")
+      {
+        string name;
+        size_t count;
+        line >> name >> count;
+        in_vertex = (name == "vertex");
+        if(in_vertex)
+        {
+          //only leading vertex elements can be read without parsing the others
+          ok = (nelements == 0);
+          nvertices = count;
+        }
+        nelements++;
+      }
+      else if(keyword == "property")
+      {
+        string type, name;
+        line >> type;
+        if(type == "list")
+        {
+          ok = !in_vertex;
+          continue;
+        }
+        line >> name;
+        ValueType value_type = parsePLYType(type);
+        if(value_type == TYPE_NONE)
+          ok = false;
+        else if(in_vertex)
+        {
+          for(int k = 0; k < 6; ++k)
+            if(name == names[k])
+            {
+              layout.offsets[k] = layout.stride;
+              layout.types[k] = value_type;
+            }
+          layout.stride += typeSize(value_type);
+        }
+      }
+      else if(keyword == "end_header")
+        header_done = true;
+      else
+        ok = false;
+    }
+    
+    if(format == "binary_little_endian" || format == "binary_big_endian")
+      layout.little_endian = (format == "binary_little_endian");
+    else
+    {
+      std::cerr<<"Only binary PLY files are supported"<<std::endl;
+      ok = false;
+    }
+    
+    if(layout.types[0] == TYPE_NONE || layout.types[1] == TYPE_NONE
+       || layout.types[2] == TYPE_NONE || !header_done)
+      ok = false;
+    
+    layout.nvalues = 6;
+    for(int k = 3; k < 6; ++k)
+      if(layout.types[k] == TYPE_NONE)
+        layout.nvalues = 3;
+    
+    header_length = p - data;
+    return ok;
+}
+
+void FileIO::getRawLayout(bool doubles, BinaryLayout &layout)
+{
+    ValueType type = doubles ? TYPE_FLOAT64 : TYPE_FLOAT32;
+    layout.nvalues = 6;
+    layout.little_endian = true;
+    layout.stride = 6 * typeSize(type);
+    for(int k = 0; k < 6; ++k)
+    {
+      layout.offsets[k] = k * typeSize(type);
+      layout.types[k] = type;
+    }
 }
 
+bool FileIO::isLittleEndian()
+{
+    const unsigned int one = 1;
+    return *(const unsigned char*)&one == 1;
+}
 
+size_t FileIO::typeSize(ValueType type)
+{
+    switch(type)
+    {
+      case TYPE_INT8: case TYPE_UINT8: return 1;
+      case TYPE_INT16: case TYPE_UINT16: return 2;
+      case TYPE_INT32: case TYPE_UINT32: case TYPE_FLOAT32: return 4;
+      case TYPE_FLOAT64: return 8;
+      default: return 0;
+    }
+}
 
- bool FileIO::savePointsOFF(const char* filename, Octree& octree, int nselected)
-{ 
-    unsigned int ncovered = 0;
-      ofstream out;
-      out.open(filename);
+FileIO::ValueType FileIO::parsePLYType(const string &name)
+{
+    if(name == "char" || name == "int8") return TYPE_INT8;
+    if(name == "uchar" || name == "uint8") return TYPE_UINT8;
+    if(name == "short" || name == "int16") return TYPE_INT16;
+    if(name == "ushort" || name == "uint16") return TYPE_UINT16;
+    if(name == "int" || name == "int32") return TYPE_INT32;
+    if(name == "uint" || name == "uint32") return TYPE_UINT32;
+    if(name == "float" || name == "float32") return TYPE_FLOAT32;
+    if(name == "double" || name == "float64") return TYPE_FLOAT64;
+    return TYPE_NONE;
+}
+
+double FileIO::decodeValue(const char *p, ValueType type, bool swap)
+{
+    char bytes[8];
+    size_t size = typeSize(type);
+    memcpy(bytes, p, size);
+    if(swap)
+      std::reverse(bytes, bytes + size);
+    
+    switch(type)
+    {
+      case TYPE_INT8: { int8_t v; memcpy(&v, bytes, 1); return v; }
+      case TYPE_UINT8: { uint8_t v; memcpy(&v, bytes, 1); return v; }
+      case TYPE_INT16: { int16_t v; memcpy(&v, bytes, 2); return v; }
+      case TYPE_UINT16: { uint16_t v; memcpy(&v, bytes, 2); return v; }
+      case TYPE_INT32: { int32_t v; memcpy(&v, bytes, 4); return v; }
+      case TYPE_UINT32: { uint32_t v; memcpy(&v, bytes, 4); return v; }
+      case TYPE_FLOAT32: { float v; memcpy(&v, bytes, 4); return v; }
+      case TYPE_FLOAT64: { double v; memcpy(&v, bytes, 8); return v; }
+      default: return 0;
+    }
+}
+
+void FileIO::getStorageOrigin(const char *data, size_t npoints,
+                              const BinaryLayout &layout, double origin[3])
+{
+    //the first point
+    const bool swap = (layout.little_endian != isLittleEndian());
+    double v[3] = {0, 0, 0};
+    if(npoints > 0)
+      for(int k = 0; k < 3; ++k)
+        v[k] = decodeValue(data + layout.offsets[k], layout.types[k], swap);
+    Point::chooseStorageOrigin(v[0], v[1], v[2], origin);
+}
+
+void FileIO::decodePoints(const char *data, size_t npoints,
+                          const BinaryLayout &layout, const double origin[3],
+                          vector<Sample> &samples, double bbox[6])
+{
+    const bool swap = (layout.little_endian != isLittleEndian());
+    samples.resize(npoints);
+    
+    int nchunks = 1;
+#ifdef OMP
+    nchunks = 8 * omp_get_max_threads();
+#endif
+    vector<double> chunk_bbox(6 * nchunks);
+    
+#ifdef OMP
+    #pragma omp parallel for schedule(dynamic)
+#endif
+    for(int c = 0; c < nchunks; ++c)
+    {
+      double *box = &chunk_bbox[6 * c];
+      box[0] = box[1] = box[2] = HUGE_VAL;
+      box[3] = box[4] = box[5] = -HUGE_VAL;
+      
+      size_t begin = npoints * c / nchunks;
+      size_t end = npoints * (c + 1) / nchunks;
+      for(size_t i = begin; i < end; ++i)
+      {
+        const char *p = data + i * layout.stride;
+        double v[6];
+        for(unsigned int k = 0; k < layout.nvalues; ++k)
+          v[k] = decodeValue(p + layout.offsets[k], layout.types[k], swap);
+        
+        if(layout.nvalues == 6)
+          samples[i] = Sample(v[0] - origin[0], v[1] - origin[1],
+                              v[2] - origin[2], v[3], v[4], v[5]);
+        else
+          samples[i] = Sample(v[0] - origin[0], v[1] - origin[1],
+                              v[2] - origin[2]);
+        
+        for(int k = 0; k < 3; ++k)
+        {
+          box[k] = v[k] < box[k] ? v[k] : box[k];
+          box[k + 3] = v[k] > box[k + 3] ? v[k] : box[k + 3];
+        }
+      }
+    }
+    
+    bbox[0] = bbox[1] = bbox[2] = HUGE_VAL;
+    bbox[3] = bbox[4] = bbox[5] = -HUGE_VAL;
+    for(int c = 0; c < nchunks; ++c)
+      for(int k = 0; k < 3; ++k)
+      {
+        double *box = &chunk_bbox[6 * c];
+        bbox[k] = box[k] < bbox[k] ? box[k] : bbox[k];
+        bbox[k + 3] = box[k + 3] > bbox[k + 3] ? box[k + 3] : bbox[k + 3];
+      }
+}
+
+bool FileIO::streamPoints(const char *filename, Format format,
+                          PointHandler &handler, size_t window_size,
+                          unsigned int part, unsigned int nparts)
+{
+    if(format == FORMAT_OFF)
+    {
+      std::cerr<<"OFF is an output format only"<<std::endl;
+      return false;
+    }
+    
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0)
+    {
+      std::cerr<<"File "<<filename<<" could not be opened"<<std::endl;
+      return false;
+    }
+    
+    struct stat st;
+    if(fstat(fd, &st) != 0)
+    {
+      close(fd);
+      return false;
+    }
+    const size_t length = st.st_size;
+    
+    //windows start on a page boundary and cover at least two pages
+    const size_t page = sysconf(_SC_PAGESIZE);
+    window_size = window_size - window_size % page;
+    if(window_size < 2 * page)
+      window_size = 2 * page;
+    
+    BinaryLayout layout = BinaryLayout();
+    size_t begin = 0;
+    size_t end = length;
+    unsigned int ncols = 0;
+    bool ok = true;
+    
+    if(format == FORMAT_PLY)
+    {
+      //the header is expected to fit in the first window
+      size_t header_window = length < window_size ? length : window_size;
+      void *header = mmap(NULL, header_window, PROT_READ, MAP_PRIVATE, fd, 0);
+      size_t nvertices = 0;
+      ok = (header != MAP_FAILED)
+        && parsePLYHeader((const char*)header, header_window, layout,
+                          nvertices, begin)
+        && length - begin >= nvertices * layout.stride;
+      if(header != MAP_FAILED)
+        munmap(header, header_window);
+      end = begin + nvertices * layout.stride;
+    }
+    else if(format == FORMAT_RAW32 || format == FORMAT_RAW64)
+    {
+      getRawLayout(format == FORMAT_RAW64, layout);
+      if(length % layout.stride != 0)
+        std::cerr<<"Warning: "<<filename<<" does not contain a whole number of points"<<std::endl;
+      end = length - length % layout.stride;
+    }
+    
+    if(!ok)
+    {
+      std::cerr<<"Could not read the vertices of "<<filename<<std::endl;
+      close(fd);
+      return false;
+    }
+    
+    //range of the part: whole points, or lines starting in the range
+    if(nparts > 1)
+    {
+      size_t first = begin;
+      if(format == FORMAT_ASCII)
+      {
+        size_t size = end - first;
+        end = findLineStart(fd, first + size / nparts * (part + 1)
+                                + size % nparts * (part + 1) / nparts, end);
+        begin = findLineStart(fd, first + size / nparts * part
+                                  + size % nparts * part / nparts, end);
+      }
+      else
+      {
+        size_t n = (end - first) / layout.stride;
+        end = first + layout.stride * (n / nparts * (part + 1)
+                                       + n % nparts * (part + 1) / nparts);
+        begin = first + layout.stride * (n / nparts * part
+                                         + n % nparts * part / nparts);
+      }
+    }
+    
+    size_t npoints = 0;
+    size_t offset = begin;
+    vector<Sample> samples;
+    //the points of all the windows are stored relative to the first one
+    double origin[3];
+    bool has_origin = false;
+    while(ok && offset < end)
+    {
+      size_t map_begin = offset - offset % page;
+      size_t map_length = end - map_begin < window_size ? end - map_begin
+                                                        : window_size;
+      void *window = mmap(NULL, map_length, PROT_READ, MAP_PRIVATE, fd, map_begin);
+      if(window == MAP_FAILED)
+      {
+        ok = false;
+        break;
+      }
+      madvise(window, map_length, MADV_SEQUENTIAL);
       
-      if(!out)
-    return false;
-      out<<"OFF"<<std::endl;
-      out<<nselected<<"\t"<<0<<"\t"<<0<<std::endl;
-      OctreeNode *node = octree.getRoot();
-      saveContent(node, out, ncovered);
- 
-      out.close();
+      const char *data = (const char*)window + (offset - map_begin);
+      size_t available = map_begin + map_length - offset;
+      size_t used = available;
+      double bbox[6];
       
-      std::cout<<"Cover rate (average number of time a point is covered)"
-               <<((double)ncovered)/((double)octree.getNpoints())<<std::endl;
+      if(format == FORMAT_PLY || format == FORMAT_RAW32 || format == FORMAT_RAW64)
+      {
+        used = available - available % layout.stride;
+        if(!has_origin)
+          getStorageOrigin(data, used / layout.stride, layout, origin);
+        has_origin = true;
+        decodePoints(data, used / layout.stride, layout, origin, samples,
+                     bbox);
+      }
+      else
+      {
+        //cut the window after its last complete line
+        if(map_begin + map_length < end)
+        {
+          const char *p = data + available;
+          while(p != data && p[-1] != '\n')
+            --p;
+          used = p - data;
+        }
+        if(used == 0)
+        {
+          std::cerr<<"Line longer than the window in "<<filename<<std::endl;
+          ok = false;
+        }
+        else
+        {
+          if(ncols == 0)
+            ncols = getPointColumns(data, used);
+          if(!has_origin)
+            getStorageOrigin(data, used, ncols, origin);
+          has_origin = true;
+          parsePoints(data, used, ncols, origin, samples, bbox);
+        }
+      }
+      munmap(window, map_length);
       
-      return true;
+      if(ok)
+      {
+        offset += used;
+        npoints += samples.size();
+        handler.process(samples, origin);
+      }
+    }
+    close(fd);
+    
+    std::cout<<npoints<<" points read"<<std::endl;
+    return ok;
+}
+
+
+size_t FileIO::findLineStart(int fd, size_t position, size_t end)
+{
+    //the line starts after the last end of line before the position
+    if(position == 0)
+      return 0;
+    char buffer[4096];
+    size_t offset = position - 1;
+    while(offset < end)
+    {
+      size_t n = end - offset < sizeof(buffer) ? end - offset : sizeof(buffer);
+      ssize_t nread = pread(fd, buffer, n, offset);
+      if(nread <= 0)
+        return end;
+      const char *eol = (const char*)memchr(buffer, '\n', nread);
+      if(eol != NULL)
+        return offset + (eol - buffer) + 1;
+      offset += nread;
+    }
+    return end;
+}
+
+
+PointWriter::PointWriter()
+{
+    m_file = NULL;
+    m_format = FileIO::FORMAT_ASCII;
+    m_count_position = -1;
+    m_nwritten = 0;
+    m_npoints = 0;
+    m_ncovered = 0;
+    m_ok = true;
+}
+
+PointWriter::~PointWriter()
+{
+    if(m_file != NULL)
+      close();
+}
+
+bool PointWriter::open(const char *filename, FileIO::Format format, long npoints)
+{
+    if(m_file != NULL)
+      close();
+    
+    m_file = fopen(filename, "wb");
+    if(m_file == NULL)
+      return false;
+    
+    m_format = format;
+    m_count_position = -1;
+    m_nwritten = 0;
+    m_npoints = 0;
+    m_ncovered = 0;
+    m_ok = true;
+    m_buffer.reserve((1 << 22) + 4096);
+    
+    //unknown counts are padded so that they can be patched in place
+    char count[32];
+    if(npoints >= 0)
+      snprintf(count, sizeof(count), "%ld", npoints);
+    else
+      snprintf(count, sizeof(count), "%20d", 0);
+    
+    if(format == FileIO::FORMAT_OFF)
+    {
+      fprintf(m_file, "OFF\n");
+      if(npoints < 0)
+        m_count_position = ftell(m_file);
+      fprintf(m_file, "%s\t0\t0\n", count);
+    }
+    else if(format == FileIO::FORMAT_PLY)
+    {
+      fprintf(m_file, "ply\nformat binary_little_endian 1.0\n"
+                      "comment generated by pdss\n"
+                      "element vertex ");
+      if(npoints < 0)
+        m_count_position = ftell(m_file);
+      fprintf(m_file, "%s\n"
+                      "property double x\nproperty double y\nproperty double z\n"
+                      "property float nx\nproperty float ny\nproperty float nz\n"
+                      "end_header\n", count);
+    }
+    m_ok = !ferror(m_file);
+    return m_ok;
 }
 
+template<class V>
+void PointWriter::append(V value, std::vector<char> &buffer)
+{
+    char bytes[sizeof(V)];
+    memcpy(bytes, &value, sizeof(V));
+    if(!FileIO::isLittleEndian())
+      std::reverse(bytes, bytes + sizeof(V));
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(V));
+}
 
+bool PointWriter::format(const Sample &s, const double origin[3],
+                         FileIO::Format format, std::vector<char> &buffer)
+{
+    const double x = origin[0] + s.x();
+    const double y = origin[1] + s.y();
+    const double z = origin[2] + s.z();
+    switch(format)
+    {
+      case FileIO::FORMAT_PLY:
+        append<double>(x, buffer);
+        append<double>(y, buffer);
+        append<double>(z, buffer);
+        append<float>((float)s.nx(), buffer);
+        append<float>((float)s.ny(), buffer);
+        append<float>((float)s.nz(), buffer);
+        break;
+      case FileIO::FORMAT_RAW32:
+        append<float>((float)x, buffer);
+        append<float>((float)y, buffer);
+        append<float>((float)z, buffer);
+        append<float>((float)s.nx(), buffer);
+        append<float>((float)s.ny(), buffer);
+        append<float>((float)s.nz(), buffer);
+        break;
+      case FileIO::FORMAT_RAW64:
+        append<double>(x, buffer);
+        append<double>(y, buffer);
+        append<double>(z, buffer);
+        append<double>(s.nx(), buffer);
+        append<double>(s.ny(), buffer);
+        append<double>(s.nz(), buffer);
+        break;
+      default:
+        {
+          //same formatting as std::fixed with a precision of 8
+          char line[2048];
+          int n = snprintf(line, sizeof(line),
+                           "%.8f\t%.8f\t%.8f\t%.8f\t%.8f\t%.8f\n",
+                           x, y, z, s.nx(), s.ny(), s.nz());
+          if(n < 0 || n >= (int)sizeof(line))
+            return false;
+          buffer.insert(buffer.end(), line, line + n);
+        }
+    }
+    return true;
+}
 
-void FileIO::saveContent(OctreeNode* node, ofstream& f,unsigned int &ncover)
+void PointWriter::write(const Sample &s, const double origin[3])
 {
-      if(node->getDepth() != 0)
+    if(!format(s, origin, m_format, m_buffer))
+    {
+      m_ok = false;
+      return;
+    }
+    m_nwritten++;
+    
+    if(m_buffer.size() >= (1 << 22))
+      flush();
+}
+
+unsigned int PointWriter::writeSelected(Octree &octree)
+{
+    std::vector<size_t> ids;
+    const size_t npoints = octree.points_end() - octree.points_begin();
+    for(size_t i = 0; i < npoints; ++i)
+      if(octree.isSelected(i))
+        ids.push_back(i);
+    return writeSamples(octree, ids);
+}
+
+unsigned int PointWriter::writeSamples(Octree &octree,
+                                       const std::vector<size_t> &ids)
+{
+    //points formatted at once: a few chunks per thread, written before
+    //the next ones are formatted
+    const size_t chunk_size = 1 << 14;
+    const long nchunks = (ids.size() + chunk_size - 1) / chunk_size;
+    int nthreads = 1;
+#ifdef OMP
+    nthreads = omp_get_max_threads();
+#endif
+    std::vector<std::vector<char> > buffers(4 * nthreads);
+    const Sample *points = octree.points_begin();
+    double origin[3];
+    octree.getStorageOrigin(origin);
+    
+    //the points written one by one go first
+    flush();
+    for(long first = 0; first < nchunks; first += buffers.size())
+    {
+      long last = first + (long)buffers.size() < nchunks
+                  ? first + (long)buffers.size() : nchunks;
+      bool ok = true;
+#ifdef OMP
+      #pragma omp parallel for schedule(dynamic) reduction(&&:ok)
+#endif
+      for(long c = first; c < last; ++c)
       {
-	for(int i = 0; i < 8 ;i++)
-	if(node->getChild(i) != NULL)
-	  saveContent(node->getChild(i), f, ncover);
+        std::vector<char> &buffer = buffers[c - first];
+        buffer.clear();
+        size_t end = (c + 1) * chunk_size < ids.size() ? (c + 1) * chunk_size
+                                                       : ids.size();
+        for(size_t i = c * chunk_size; i < end; ++i)
+          ok = format(points[ids[i]], origin, m_format, buffer) && ok;
       }
-      else if(node->getNpts() != 0)
-	{
-		Sample_list::const_iterator iter;
-		for(iter = node->points_begin(); iter != node->points_end(); iter++)
-		{
-		  if(iter->isSelected())
-		    f << std::fixed << std::setprecision(8)
-          << iter->x() << "\t" << iter->y() << "\t" << iter->z() << "\t"
-          << iter->nx() << "\t" << iter->ny() << "\t" << iter->nz()<<std::endl;
-        ncover +=iter->getNCovered();
-		}
-	}
+      m_ok = m_ok && ok;
+      
+      for(long c = first; c < last; ++c)
+      {
+        std::vector<char> &buffer = buffers[c - first];
+        if(!buffer.empty()
+           && fwrite(&buffer[0], 1, buffer.size(), m_file) != buffer.size())
+          m_ok = false;
+      }
+    }
+    
+    m_nwritten += ids.size();
+    m_ncovered += octree.getNCovers();
+    m_npoints += octree.getNpoints();
+    return ids.size();
+}
+
+void PointWriter::flush()
+{
+    if(!m_buffer.empty()
+       && fwrite(&m_buffer[0], 1, m_buffer.size(), m_file) != m_buffer.size())
+      m_ok = false;
+    m_buffer.clear();
 }
 
+bool PointWriter::close()
+{
+    if(m_file == NULL)
+      return false;
+    
+    flush();
+    if(m_count_position >= 0)
+    {
+      if(fseek(m_file, m_count_position, SEEK_SET) != 0)
+        m_ok = false;
+      else
+        fprintf(m_file, "%20lu", m_nwritten);
+    }
+    if(fclose(m_file) != 0)
+      m_ok = false;
+    m_file = NULL;
+    return m_ok;
+}
+
+unsigned long PointWriter::getNWritten() const
+{
+    return m_nwritten;
+}
+
+unsigned long PointWriter::getNPoints() const
+{
+    return m_npoints;
+}
+
+unsigned long PointWriter::getNCovered() const
+{
+    return m_ncovered;
+}
@@ -26,17 +26,39 @@
 
 #include <fstream>
 #include <iostream>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdio>
 
 #include "Octree.h"
 
 #include "types.h"
 #include "Sample.h"
 
+class PointHandler;
+class PointWriter;
 
 class FileIO
 {
    public :
    
+   /**point file formats*/
+   enum Format
+   {
+     /**one point per line: x y z [nx ny nz]*/
+     FORMAT_ASCII,
+     /**ascii with an OFF header*/
+     FORMAT_OFF,
+     /**binary PLY (x y z and optionally nx ny nz vertex properties)*/
+     FORMAT_PLY,
+     /**packed little-endian float32: x y z nx ny nz*/
+     FORMAT_RAW32,
+     /**packed little-endian float64: x y z nx ny nz*/
+     FORMAT_RAW64,
+     FORMAT_UNKNOWN
+   };
+   
    /**constructor*/
    FileIO();
    
@@ -76,17 +98,425 @@ class FileIO
    static bool savePointsOFF(const char* filename,
                              Octree &octree,
                              const int nselected);
+   
+   /**get the format of a file from its extension
+    * (.ply, .off, .raw32, .raw64, anything else is ascii)
+    * @param filename name of the file
+    * @return format
+    */
+   static Format getFormat(const char *filename);
+   
+   /**get a format from its name (ascii, off, ply, raw32, raw64)
+    * @param name name of the format
+    * @return format, FORMAT_UNKNOWN if the name is not known
+    */
+   static Format parseFormat(const char *name);
+   
+   /**read points from a file of any format
+    * @param filename name of the file to read points from
+    * @param format format of the file
+    * @param octree to sort and store the points in
+    * @param min_radius if positive, create the octree such that the smallest cell has size 2*min_radius
+    * @return false if the file could not be read
+    */
+   static bool readAndSort(const char *filename, Format format,
+                           Octree &octree, double min_radius = -1);
+   
+   /**save the selected points of an octree to a file of any format
+    * @param filename name of the file to save to
+    * @param format format of the file
+    * @param octree octree to save the points from
+    * @param nselected number of selected points
+    * @return false if something went wrong
+    */
+   static bool save(const char *filename, Format format, Octree &octree,
+                    unsigned int nselected);
+   
+   /**save samples of an octree to a file of any format, formatted in
+    * parallel (PointWriter::writeSamples)
+    * @param filename name of the file to save to
+    * @param format format of the file
+    * @param octree octree to save the points from
+    * @param ids ids of the samples to save, e.g.
+    * TSampleSelection::getSelectedSamples
+    * @return false if something went wrong
+    */
+   static bool save(const char *filename, Format format, Octree &octree,
+                    const std::vector<size_t> &ids);
+   
+   /**read points from a binary PLY file (little or big endian)
+    * @param filename name of the file to read points from
+    * @param octree to sort and store the points in
+    * @param min_radius if positive, create the octree such that the smallest cell has size 2*min_radius
+    * @return false if the file could not be read
+    */
+   static bool readAndSortPointsPLY(const char *filename, Octree &octree, double min_radius = -1);
+   
+   /**read points from a packed binary file (x y z nx ny nz per point)
+    * @param filename name of the file to read points from
+    * @param octree to sort and store the points in
+    * @param doubles true for float64 values, false for float32 values
+    * @param min_radius if positive, create the octree such that the smallest cell has size 2*min_radius
+    * @return false if the file could not be read
+    */
+   static bool readAndSortPointsRaw(const char *filename, Octree &octree,
+                                    bool doubles, double min_radius = -1);
+   
+   /**save the selected points of an octree to a binary little-endian PLY file
+    * (double positions, float normals)
+    * @param filename name of the file to save to
+    * @param octree octree to save the points from
+    * @param nselected number of selected points
+    * @return false if something went wrong
+    */
+   static bool savePointsPLY(const char* filename, Octree &octree,
+                             unsigned int nselected);
+   
+   /**save the selected points of an octree to a packed binary file
+    * (x y z nx ny nz per point, little-endian)
+    * @param filename name of the file to save to
+    * @param octree octree to save the points from
+    * @param doubles true for float64 values, false for float32 values
+    * @return false if something went wrong
+    */
+   static bool savePointsRaw(const char* filename, Octree &octree, bool doubles);
+   
+   /**read the points of a file window by window, without holding the whole
+    * file in memory: each window of the file is mapped, parsed and handed to
+    * the handler before the next one is mapped
+    * @param filename name of the file to read points from
+    * @param format format of the file (ascii, ply, raw32 or raw64)
+    * @param handler handler receiving the points of each window
+    * @param window_size size of the mapped windows in bytes
+    * @param part part of the file to read, e.g. the rank of a process
+    * @param nparts number of parts: the points are split into nparts
+    * contiguous ranges of (about) the same size, on line boundaries for
+    * ascii files; each point belongs to exactly one part
+    * @return false if the file could not be read
+    */
+   static bool streamPoints(const char *filename, Format format,
+                            PointHandler &handler,
+                            size_t window_size = 1 << 28,
+                            unsigned int part = 0, unsigned int nparts = 1);
 
+    friend class PointWriter;
+    friend class ResultCache;
+    
     private :
+    
+    /**scalar types of binary files*/
+    enum ValueType
+    {
+      TYPE_INT8, TYPE_UINT8, TYPE_INT16, TYPE_UINT16,
+      TYPE_INT32, TYPE_UINT32, TYPE_FLOAT32, TYPE_FLOAT64, TYPE_NONE
+    };
+    
+    /**layout of the points in a binary buffer*/
+    struct BinaryLayout
+    {
+      /**size of a point in bytes*/
+      size_t stride;
+      
+      /**number of values to read: 3 (positions) or 6 (positions+normals)*/
+      unsigned int nvalues;
+      
+      /**byte offset of x y z nx ny nz in a point*/
+      size_t offsets[6];
+      
+      /**type of x y z nx ny nz*/
+      ValueType types[6];
+      
+      /**true if the values are stored in little-endian order*/
+      bool little_endian;
+    };
+    
+    /**get the size of a scalar type
+     * @param type scalar type
+     * @return size in bytes
+     */
+    static size_t typeSize(ValueType type);
+    
+    /**get a scalar type from its PLY name
+     * @param name PLY type name
+     * @return type, TYPE_NONE if the name is not known
+     */
+    static ValueType parsePLYType(const std::string &name);
+    
+    /**read a binary value
+     * @param p pointer to the value
+     * @param type type of the value
+     * @param swap true if the bytes must be swapped
+     * @return value
+     */
+    static double decodeValue(const char *p, ValueType type, bool swap);
+    
+    /**get the origin binary points are stored relative to: their first
+     * point (see Point::chooseStorageOrigin)
+     * @param data pointer to the first point
+     * @param npoints number of points
+     * @param layout layout of the points
+     * @param[out] origin x y z of the origin
+     */
+    static void getStorageOrigin(const char *data, size_t npoints,
+                                 const BinaryLayout &layout, double origin[3]);
+    
+    /**decode binary points in parallel
+     * @param data pointer to the first point
+     * @param npoints number of points
+     * @param layout layout of the points
+     * @param origin origin the samples are stored relative to
+     * @param[out] samples decoded samples
+     * @param[out] bbox bounding box of the samples (xmin ymin zmin xmax ymax
+     * zmax), absolute
+     */
+    static void decodePoints(const char *data, size_t npoints,
+                             const BinaryLayout &layout, const double origin[3],
+                             std::vector<Sample> &samples, double bbox[6]);
+    
+    /**parse the header of a binary PLY file
+     * @param data beginning of the file
+     * @param length length of the buffer
+     * @param[out] layout layout of the vertices
+     * @param[out] nvertices number of vertices
+     * @param[out] header_length length of the header in bytes
+     * @return false if the vertices cannot be read
+     */
+    static bool parsePLYHeader(const char *data, size_t length,
+                               BinaryLayout &layout, size_t &nvertices,
+                               size_t &header_length);
+    
+    /**get the layout of a packed binary file
+     * @param doubles true for float64 values, false for float32 values
+     * @param[out] layout layout of the points
+     */
+    static void getRawLayout(bool doubles, BinaryLayout &layout);
+    
+    /**check if the host stores values in little-endian order
+     * @return true on little-endian hosts
+     */
+    static bool isLittleEndian();
       
-    /**save all samples contained in a node
-     * @param node node to save from
-     * @param f stream to save to
+    /**map a whole file in memory (read only)
+     * @param filename name of the file to map
+     * @param[out] length length of the file
+     * @return pointer to the mapped file, NULL if the file could not be mapped
+     */
+    static const char* mapFile(const char *filename, size_t &length);
+    
+    /**unmap a file mapped by mapFile
+     * @param data pointer to the mapped file
+     * @param length length of the file
+     */
+    static void unmapFile(const char *data, size_t length);
+    
+    /**find the first line starting at or after a position of a file
+     * @param fd descriptor of the file
+     * @param position position in the file
+     * @param end end of the lines of the file
+     * @return position of the line, end if none
+     */
+    static size_t findLineStart(int fd, size_t position, size_t end);
+    
+    /**count the number of values on the first line of a buffer
+     * @param data buffer
+     * @param length length of the buffer
+     * @return number of values
+     */
+    static unsigned int countColumns(const char *data, size_t length);
+    
+    /**number of columns to parse in an ascii file, from its first line: the
+     * positions and normals if it holds at least six values, the positions
+     * otherwise (the extra columns, e.g. an intensity, are ignored). Shared
+     * by the in-core and the streaming readers
+     * @param data buffer
+     * @param length length of the buffer
+     * @return 3 or 6
+     */
+    static unsigned int getPointColumns(const char *data, size_t length);
+    
+    /**get the origin ascii points are stored relative to: their first
+     * point (see Point::chooseStorageOrigin)
+     * @param data buffer
+     * @param length length of the buffer
+     * @param ncols number of values of a point
+     * @param[out] origin x y z of the origin
+     */
+    static void getStorageOrigin(const char *data, size_t length,
+                                 unsigned int ncols, double origin[3]);
+    
+    /**parse whitespace separated points, one per line, in parallel
+     * the buffer is split into chunks at line boundaries, each thread parses
+     * its chunks directly into the output vector
+     * @param data buffer
+     * @param length length of the buffer
+     * @param ncols 3 (positions) or 6 (positions and normals), extra columns are ignored
+     * @param origin origin the samples are stored relative to
+     * @param[out] samples parsed samples
+     * @param[out] bbox bounding box of the samples (xmin ymin zmin xmax ymax
+     * zmax), absolute
+     */
+    static void parsePoints(const char *data, size_t length, unsigned int ncols,
+                            const double origin[3],
+                            std::vector<Sample> &samples, double bbox[6]);
+    
+    /**parse one line of values
+     * @param p beginning of the line
+     * @param end end of the buffer
+     * @param ncols number of values to read
+     * @param[out] values parsed values
+     * @param[out] ok false if the line does not contain ncols values
+     * @return pointer to the beginning of the next line
+     */
+    static const char* parseLine(const char *p, const char *end,
+                                 unsigned int ncols, double *values, bool &ok);
+    
+    /**parse a double (C locale format)
+     * @param p beginning of the number
+     * @param end end of the buffer
+     * @param[out] value parsed value
+     * @return pointer past the number, NULL if no number could be parsed
      */
-    static void saveContent(OctreeNode *node, std::ofstream &f,
-                            unsigned int &ncover);
+    static const char* parseDouble(const char *p, const char *end, double &value);
+    
+    /**save the selected samples of an octree with a writer and print the
+     * cover rate
+     * @param writer opened writer
+     * @param octree octree to save the points from
+     * @return false if something went wrong
+     */
+    static bool saveSelected(PointWriter &writer, Octree &octree);
    
 };
 
 
+/**@class PointHandler
+ * receives the points read by FileIO::streamPoints, one window at a time
+ */
+class PointHandler
+{
+  public :
+  
+  /**destructor*/
+  virtual ~PointHandler() {}
+  
+  /**process the points of a window
+   * @param samples points of the window (may be modified or swapped)
+   * @param origin origin the points are stored relative to, the same for
+   * all the windows of a file (see Point::chooseStorageOrigin)
+   */
+  virtual void process(std::vector<Sample> &samples,
+                       const double origin[3]) = 0;
+};
+
+
+/**@class PointWriter
+ * writes points to a file of any output format
+ * the points are formatted in a large buffer written when full, so that
+ * several octrees (e.g. tiles) can be appended one after the other.
+ * If the number of points is not known when the file is opened, a padded
+ * count is written in the OFF/PLY header and patched when the file is
+ * closed.
+ */
+class PointWriter
+{
+  public :
+  
+  /**constructor*/
+  PointWriter();
+  
+  /**destructor (closes the file)*/
+  ~PointWriter();
+  
+  /**open a file and write its header
+   * @param filename name of the file to write to
+   * @param format format of the file
+   * @param npoints number of points that will be written, negative if unknown
+   * @return false if the file could not be opened
+   */
+  bool open(const char *filename, FileIO::Format format, long npoints = -1);
+  
+  /**write a point
+   * @param s point to write
+   * @param origin origin the point is stored relative to
+   */
+  void write(const Sample &s, const double origin[3]);
+  
+  /**write the selected samples of an octree (FLAG_SELECTED)
+   * @param octree octree to write the points from
+   * @return number of points written
+   */
+  unsigned int writeSelected(Octree &octree);
+  
+  /**write samples of an octree. The samples are split into chunks
+   * formatted in parallel into their own buffers, then written in order,
+   * so that the file does not depend on the number of threads
+   * @param octree octree to write the points from
+   * @param ids ids of the samples to write, in the order of the file
+   * @return number of points written
+   */
+  unsigned int writeSamples(Octree &octree, const std::vector<size_t> &ids);
+  
+  /**write the remaining points, patch the header and close the file
+   * @return false if something went wrong
+   */
+  bool close();
+  
+  /**get the number of points written
+   * @return number of points
+   */
+  unsigned long getNWritten() const;
+  
+  /**get the number of points seen by writeSelected and writeSamples
+   * @return number of points
+   */
+  unsigned long getNPoints() const;
+  
+  /**get the sum of the cover counts of the points seen by writeSelected and
+   * writeSamples (counted by the selection)
+   * @return cover count
+   */
+  unsigned long getNCovered() const;
+  
+  private :
+  
+  /**write the buffer to the file*/
+  void flush();
+  
+  /**append a value in little-endian order to a buffer
+   * @param value value to append
+   * @param[in,out] buffer buffer
+   */
+  template<class V>
+  static void append(V value, std::vector<char> &buffer);
+  
+  /**append a point to a buffer
+   * @param s point to append
+   * @param origin origin the point is stored relative to
+   * @param format format of the file
+   * @param[in,out] buffer buffer
+   * @return false if the point could not be formatted
+   */
+  static bool format(const Sample &s, const double origin[3],
+                     FileIO::Format format, std::vector<char> &buffer);
+  
+  FILE *m_file;
+  
+  FileIO::Format m_format;
+  
+  std::vector<char> m_buffer;
+  
+  /**position of the padded point count in the header, -1 if none*/
+  long m_count_position;
+  
+  unsigned long m_nwritten;
+  
+  unsigned long m_npoints;
+  
+  unsigned long m_ncovered;
+  
+  /**false once a write failed*/
+  bool m_ok;
+};
+
+
 #endif
@@ -0,0 +1,190 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file IncrementalSelection.cpp
+* @author Julie Digne
+* incremental selection by batches, see IncrementalSelection.h
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "IncrementalSelection.h"
+
+#include "types.h"
+#include "Random.h"
+
+#include <cmath>
+#include <set>
+
+using namespace std;
+
+bool IncrementalSelection::CellKey::operator<(const CellKey &other) const
+{
+    if(x != other.x)
+      return x < other.x;
+    if(y != other.y)
+      return y < other.y;
+    return z < other.z;
+}
+
+IncrementalSelection::IncrementalSelection(double radius, uint64_t seed)
+{
+    m_radius = radius;
+    m_seed = seed;
+    m_nbatches = 0;
+    m_origin[0] = m_origin[1] = m_origin[2] = 0;
+    m_has_origin = false;
+}
+
+void IncrementalSelection::setStorageOrigin(const double origin[3])
+{
+    for(int k = 0; k < 3; ++k)
+      m_origin[k] = origin[k];
+    m_has_origin = true;
+}
+
+void IncrementalSelection::getStorageOrigin(double origin[3]) const
+{
+    for(int k = 0; k < 3; ++k)
+      origin[k] = m_origin[k];
+}
+
+Sample IncrementalSelection::makeSample(double x, double y, double z,
+                                        double nx, double ny, double nz)
+{
+    if(!m_has_origin)
+    {
+      Point::chooseStorageOrigin(x, y, z, m_origin);
+      m_has_origin = true;
+    }
+    return Sample(x - m_origin[0], y - m_origin[1], z - m_origin[2],
+                  nx, ny, nz);
+}
+
+void IncrementalSelection::addSamples(const std::vector<Sample> &samples)
+{
+    std::vector<Sample>::const_iterator si;
+    for(si = samples.begin(); si != samples.end(); ++si)
+      addSample(*si);
+}
+
+unsigned int IncrementalSelection::insert(std::vector<Sample> &points)
+{
+    if(points.empty())
+      return 0;
+
+    //the octree covers the batch and the samples that may cover it (stored
+    //coordinates)
+    double bbox[6] = {HUGE_VAL, HUGE_VAL, HUGE_VAL,
+                      -HUGE_VAL, -HUGE_VAL, -HUGE_VAL};
+    std::set<CellKey> cells;
+    std::vector<Sample>::const_iterator pi;
+    for(pi = points.begin(); pi != points.end(); ++pi)
+    {
+      double x[3] = {pi->x(), pi->y(), pi->z()};
+      for(int k = 0; k < 3; ++k)
+      {
+        bbox[k] = x[k] < bbox[k] ? x[k] : bbox[k];
+        bbox[k + 3] = x[k] > bbox[k + 3] ? x[k] : bbox[k + 3];
+      }
+      cells.insert(getCellKey(*pi));
+    }
+    for(int k = 0; k < 3; ++k)
+    {
+      bbox[k] -= m_radius;
+      bbox[k + 3] += m_radius;
+    }
+
+    double absolute_bbox[6];
+    for(int k = 0; k < 6; ++k)
+      absolute_bbox[k] = m_origin[k % 3] + bbox[k];
+    Octree octree;
+    octree.initialize(absolute_bbox, m_radius, m_origin);
+    octree.setPoints(points);
+
+    OctreeIterator iterator(&octree);
+    iterator.setR(m_radius);
+    SampleSelection selection(m_radius, &octree, &iterator);
+    RandomGenerator generator(m_seed, m_nbatches);
+    selection.setSeed(generator.next());
+    selection.setVerbose(false);
+
+    //cover the points of the batch close to the previous samples, found in
+    //the cells of the batch and their neighbours (the cells are one radius
+    //wide); each cell is visited once
+    std::set<CellKey> visited;
+    std::set<CellKey>::const_iterator ci;
+    for(ci = cells.begin(); ci != cells.end(); ++ci)
+      for(int dx = -1; dx <= 1; ++dx)
+        for(int dy = -1; dy <= 1; ++dy)
+          for(int dz = -1; dz <= 1; ++dz)
+          {
+            CellKey key = {ci->x + dx, ci->y + dy, ci->z + dz};
+            Sample_grid::const_iterator gi = m_grid.find(key);
+            if(gi == m_grid.end() || !visited.insert(key).second)
+              continue;
+
+            const std::vector<size_t> &ids = gi->second;
+            for(size_t i = 0; i < ids.size(); ++i)
+            {
+              const Sample &s = m_samples[ids[i]];
+              //out of the margin, it cannot cover a point of the batch
+              if(s.x() < bbox[0] || s.y() < bbox[1] || s.z() < bbox[2]
+                 || s.x() > bbox[3] || s.y() > bbox[4] || s.z() > bbox[5])
+                continue;
+              selection.cover(s);
+            }
+          }
+
+    selection.performDartThrowingSelection();
+
+    const std::vector<size_t> &ids = selection.getSelectedSamples();
+    for(size_t i = 0; i < ids.size(); ++i)
+      addSample(octree.points_begin()[ids[i]]);
+
+    m_nbatches++;
+    return selection.getNSelected();
+}
+
+const std::vector<Sample>& IncrementalSelection::getSamples() const
+{
+    return m_samples;
+}
+
+unsigned long IncrementalSelection::getNSelected() const
+{
+    return m_samples.size();
+}
+
+unsigned int IncrementalSelection::getNBatches() const
+{
+    return m_nbatches;
+}
+
+IncrementalSelection::CellKey IncrementalSelection::getCellKey(const Point &p) const
+{
+    CellKey key;
+    key.x = (int)floor(p.x() / m_radius);
+    key.y = (int)floor(p.y() / m_radius);
+    key.z = (int)floor(p.z() / m_radius);
+    return key;
+}
+
+void IncrementalSelection::addSample(const Sample &sample)
+{
+    m_grid[getCellKey(sample)].push_back(m_samples.size());
+    m_samples.push_back(sample);
+}
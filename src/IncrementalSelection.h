@@ -0,0 +1,156 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file IncrementalSelection.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+ * @file IncrementalSelection.h
+ * declares the incremental selection of point clouds received in batches
+ * (e.g. scan strips streamed into an area already subsampled). The
+ * selected samples are kept in a grid of cells of one radius. A batch is
+ * sorted in an octree of its own, its points closer than the radius to a
+ * sample already selected are covered by the samples of the grid cells
+ * around the batch, and the dart throwing runs on the batch only: the
+ * cost of a batch does not depend on the number of points inserted
+ * before, and the union of the samples stays a Poisson disk sampling.
+ */
+
+#ifndef INCREMENTAL_SELECTION_H
+#define INCREMENTAL_SELECTION_H
+
+#include <map>
+#include <vector>
+#include <stdint.h>
+
+#include "Sample.h"
+
+/**@class IncrementalSelection
+ * Poisson disk subsampling of a cloud received in batches
+ */
+class IncrementalSelection
+{
+  public :
+
+  /**constructor (no sample)
+   * @param radius selection radius
+   * @param seed seed of the dart throwing (each batch draws from its own
+   * generator keyed by this seed and the number of batches before it)
+   */
+  IncrementalSelection(double radius, uint64_t seed = 0);
+
+  /**set the origin the points of the batches and the samples are stored
+   * relative to, instead of the first point built by makeSample
+   * PREREQUISITE: no point built yet
+   * @param origin x y z of the origin
+   */
+  void setStorageOrigin(const double origin[3]);
+
+  /**get the origin the points and the samples are stored relative to
+   * @param[out] origin x y z of the origin
+   */
+  void getStorageOrigin(double origin[3]) const;
+
+  /**build a point of a batch (or a sample to add) from its absolute
+   * coordinates, relative to the storage origin. The first point built
+   * sets the origin (see Point::chooseStorageOrigin): with PDSS_FLOAT32 the
+   * points of a georeferenced cloud keep their precision.
+   * @param x
+   * @param y
+   * @param z
+   * @param nx
+   * @param ny
+   * @param nz
+   * @return point to insert
+   */
+  Sample makeSample(double x, double y, double z,
+                    double nx = 0, double ny = 0, double nz = 0);
+
+  /**add samples selected beforehand (e.g. the output of a previous run),
+   * without any check
+   * PREREQUISITE: the samples are at least one radius apart, built by
+   * makeSample
+   * @param samples samples to add
+   */
+  void addSamples(const std::vector<Sample> &samples);
+
+  /**subsample a batch of points: the points closer than the radius to a
+   * sample are dropped, the other ones are subsampled by dart throwing
+   * @param points points of the batch, built by makeSample (moved into the
+   * octree of the batch, the vector is emptied)
+   * @return number of new samples
+   */
+  unsigned int insert(std::vector<Sample> &points);
+
+  /**get the samples, in the order of their selection
+   * @return samples, relative to the storage origin
+   */
+  const std::vector<Sample>& getSamples() const;
+
+  /**get the number of samples
+   * @return number of samples
+   */
+  unsigned long getNSelected() const;
+
+  /**get the number of batches inserted
+   * @return number of batches
+   */
+  unsigned int getNBatches() const;
+
+  private :
+
+  /**integer coordinates of a cell of the grid*/
+  struct CellKey
+  {
+    int x, y, z;
+
+    bool operator<(const CellKey &other) const;
+  };
+
+  typedef std::map<CellKey, std::vector<size_t> > Sample_grid;
+
+  /**get the cell of a point
+   * @param p point
+   * @return key of the cell
+   */
+  CellKey getCellKey(const Point &p) const;
+
+  /**add a sample to the samples and to the grid
+   * @param sample sample to add
+   */
+  void addSample(const Sample &sample);
+
+  double m_radius;
+
+  uint64_t m_seed;
+
+  /**origin the points and the samples are stored relative to*/
+  double m_origin[3];
+
+  /**false until the origin is set or chosen*/
+  bool m_has_origin;
+
+  unsigned int m_nbatches;
+
+  std::vector<Sample> m_samples;
+
+  /**indices of the samples in each cell (of side the radius)*/
+  Sample_grid m_grid;
+};
+
+#endif
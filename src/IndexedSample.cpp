@@ -0,0 +1,38 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file IndexedSample.cpp 
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/  
+#include "IndexedSample.h"
+
+IndexedSample::IndexedSample() :Point()
+{
+  m_index = 0;
+}
+
+IndexedSample::IndexedSample(double x, double y, double z, size_t index)
+  : Point(x, y, z)
+{
+  m_index = index;
+}
+
+size_t IndexedSample::getIndex() const
+{
+  return m_index;
+}
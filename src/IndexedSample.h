@@ -0,0 +1,55 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file IndexedSample.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/  
+#ifndef INDEXED_SAMPLE_H
+#define INDEXED_SAMPLE_H
+
+#include <cstddef>
+#include "Point.h"
+
+/**
+ * Sample referring to a point of a caller's buffer: only the position and the
+ * index of the point in the buffer are stored
+ */
+class IndexedSample : public Point
+{
+  private :
+  size_t m_index;
+  
+  public :
+  /**constructor*/
+  IndexedSample();
+
+  /**constructor
+   * @param x
+   * @param y
+   * @param z
+   * @param index index of the point in the buffer
+   */
+  IndexedSample(double x, double y, double z, size_t index);
+  
+  public :
+
+  size_t getIndex() const;
+};
+
+
+#endif
@@ -0,0 +1,147 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file Metrics.cpp
+* @author Julie Digne
+* metrics of a run, see Metrics.h
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Metrics.h"
+
+#include "Timer.h"
+
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+const unsigned int Metrics::MAX_THREADS;
+Metrics::ThreadMetrics Metrics::s_threads[Metrics::MAX_THREADS];
+double Metrics::s_parallel_time = 0;
+std::vector<std::pair<std::string, double> > Metrics::s_stages;
+std::vector<std::pair<std::string, double> > Metrics::s_values;
+
+/**add to a named value, or append it
+ * @param values named values
+ * @param name name of the value
+ * @param value value to add
+ * @param accumulate add to the previous value instead of replacing it
+ */
+static void updateValue(std::vector<std::pair<std::string, double> > &values,
+                        const std::string &name, double value, bool accumulate)
+{
+    for(size_t i = 0; i < values.size(); ++i)
+      if(values[i].first == name)
+      {
+        values[i].second = accumulate ? values[i].second + value : value;
+        return;
+      }
+    values.push_back(std::make_pair(name, value));
+}
+
+/**write named values as the members of a JSON object
+ * @param f file
+ * @param values named values
+ */
+static void writeValues(FILE *f, const std::vector<std::pair<std::string, double> > &values)
+{
+    fprintf(f, "{");
+    for(size_t i = 0; i < values.size(); ++i)
+      fprintf(f, "%s\"%s\": %.9g", i > 0 ? ", " : "", values[i].first.c_str(),
+              values[i].second);
+    fprintf(f, "}");
+}
+
+void Metrics::addParallelTime(double seconds)
+{
+    s_parallel_time += seconds;
+}
+
+void Metrics::addStage(const std::string &name, double seconds)
+{
+    updateValue(s_stages, name, seconds, true);
+}
+
+void Metrics::setValue(const std::string &name, double value)
+{
+    updateValue(s_values, name, value, false);
+}
+
+void Metrics::reset()
+{
+    memset(s_threads, 0, sizeof(s_threads));
+    s_parallel_time = 0;
+    s_stages.clear();
+    s_values.clear();
+}
+
+bool Metrics::write(const char *filename)
+{
+    FILE *f = fopen(filename, "w");
+    if(f == NULL)
+      return false;
+
+    setValue("peak_memory_MB", getPeakMemory());
+#ifdef PDSS_METRICS
+    fprintf(f, "{\n  \"instrumented\": true,\n");
+#else
+    fprintf(f, "{\n  \"instrumented\": false,\n");
+#endif
+    fprintf(f, "  \"stages_s\": ");
+    writeValues(f, s_stages);
+    fprintf(f, ",\n  \"values\": ");
+    writeValues(f, s_values);
+
+#ifdef PDSS_METRICS
+    unsigned int nthreads = 1;
+#ifdef OMP
+    nthreads = omp_get_max_threads();
+#endif
+    nthreads = nthreads < MAX_THREADS ? nthreads : MAX_THREADS;
+
+    const char *names[NCOUNTERS] = {"neighbor_queries", "nodes_visited",
+                                    "distance_tests"};
+    fprintf(f, ",\n  \"counters\": {");
+    for(int c = 0; c < NCOUNTERS; ++c)
+    {
+      unsigned long total = 0;
+      for(unsigned int t = 0; t < MAX_THREADS; ++t)
+        total += s_threads[t].counters[c];
+      fprintf(f, "%s\"%s\": %lu", c > 0 ? ", " : "", names[c], total);
+    }
+
+    //a thread is idle whenever it does not process a cell (waiting for a
+    //ready cell or for the end of the run)
+    fprintf(f, "},\n  \"dart_throwing\": {\"wall_s\": %.9g, \"threads\": [",
+            s_parallel_time);
+    for(unsigned int t = 0; t < nthreads; ++t)
+    {
+      double busy = 0;
+      for(int k = 0; k < 8; ++k)
+        busy += s_threads[t].busy[k];
+      fprintf(f, "%s\n    {\"busy_s\": %.9g, \"idle_s\": %.9g, \"colour_busy_s\": [",
+              t > 0 ? "," : "", busy, s_parallel_time - busy);
+      for(int k = 0; k < 8; ++k)
+        fprintf(f, "%s%.9g", k > 0 ? ", " : "", s_threads[t].busy[k]);
+      fprintf(f, "]}");
+    }
+    fprintf(f, "]}");
+#endif
+    fprintf(f, "\n}\n");
+    return fclose(f) == 0;
+}
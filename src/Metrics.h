@@ -0,0 +1,157 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file Metrics.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+ * @file Metrics.h
+ * declares the metrics of a run, written as JSON (pdss --metrics). The
+ * timings of the stages and the values of the run (number of points,
+ * peak memory...) are always recorded. The counters of the neighbour
+ * queries and the busy time of the threads of the dart throwing are only
+ * recorded in builds with PDSS_METRICS (cmake -DPDSS_METRICS=ON):
+ * otherwise the PDSS_COUNT and PDSS_BUSY macros expand to nothing and the
+ * hot loops are unchanged. The counters are kept per thread, in separate
+ * cache lines, so that counting does not synchronize the threads.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+#include <vector>
+
+#ifdef OMP
+#include <omp.h>
+#endif
+
+#ifdef PDSS_METRICS
+#define PDSS_COUNT(counter, n) Metrics::count(Metrics::counter, (n))
+#define PDSS_BUSY(colour, seconds) Metrics::addBusyTime((colour), (seconds))
+#else
+#define PDSS_COUNT(counter, n) ((void)0)
+#define PDSS_BUSY(colour, seconds) ((void)0)
+#endif
+
+/**@class Metrics
+ * metrics of the run of the process
+ */
+class Metrics
+{
+  public :
+
+  /**counters of the neighbour queries*/
+  enum Counter
+  {
+    /**calls of TOctreeIterator::visitNeighbors*/
+    NEIGHBOR_QUERIES,
+    /**cells whose points were tested*/
+    NODES_VISITED,
+    /**points whose distance to a query was tested*/
+    DISTANCE_TESTS,
+    NCOUNTERS
+  };
+
+  /**number of threads with their own counters, the threads beyond share
+   * the last ones*/
+  static const unsigned int MAX_THREADS = 256;
+
+  /**add to a counter of the calling thread
+   * @param counter counter
+   * @param n value to add
+   */
+  static void count(Counter counter, unsigned long n);
+
+  /**add to the time spent by the calling thread on the cells of a colour
+   * @param colour colour of the cell (0 to 7)
+   * @param seconds time spent
+   */
+  static void addBusyTime(unsigned int colour, double seconds);
+
+  /**add to the wall time of the parallel dart throwing
+   * @param seconds elapsed time
+   */
+  static void addParallelTime(double seconds);
+
+  /**add to the time of a stage (accumulated over the calls of a name)
+   * @param name name of the stage
+   * @param seconds elapsed time
+   */
+  static void addStage(const std::string &name, double seconds);
+
+  /**set a value of the run
+   * @param name name of the value
+   * @param value value
+   */
+  static void setValue(const std::string &name, double value);
+
+  /**reset all metrics*/
+  static void reset();
+
+  /**write the metrics as a JSON object
+   * @param filename name of the file to write
+   * @return false if the file could not be written
+   */
+  static bool write(const char *filename);
+
+  private :
+
+  /**metrics of one thread, one cache line apart*/
+  struct ThreadMetrics
+  {
+    unsigned long counters[NCOUNTERS];
+    double busy[8];
+    char padding[64];
+  };
+
+  /**get the slot of the calling thread
+   * @return slot index
+   */
+  static unsigned int getThread();
+
+  static ThreadMetrics s_threads[MAX_THREADS];
+
+  static double s_parallel_time;
+
+  static std::vector<std::pair<std::string, double> > s_stages;
+
+  static std::vector<std::pair<std::string, double> > s_values;
+};
+
+inline unsigned int Metrics::getThread()
+{
+#ifdef OMP
+  unsigned int thread = omp_get_thread_num();
+  return thread < MAX_THREADS ? thread : MAX_THREADS - 1;
+#else
+  return 0;
+#endif
+}
+
+inline void Metrics::count(Counter counter, unsigned long n)
+{
+  s_threads[getThread()].counters[counter] += n;
+}
+
+inline void Metrics::addBusyTime(unsigned int colour, double seconds)
+{
+  s_threads[getThread()].busy[colour & 7] += seconds;
+}
+
+#endif
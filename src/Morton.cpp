@@ -0,0 +1,102 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file Morton.cpp
+* @author Julie Digne
+* radix sort of Morton keys, see Morton.h
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Morton.h"
+
+#include <cstddef>
+
+#ifdef OMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+void radixSort(vector<MortonKey> &keys, unsigned int nbits)
+{
+    const size_t n = keys.size();
+    const unsigned int nbuckets = 256;
+    vector<MortonKey> buffer(n);
+
+    int max_threads = 1;
+#ifdef OMP
+    max_threads = omp_get_max_threads();
+#endif
+    //one histogram per thread, the prefix sum goes through the digits
+    //then through the threads so that the sort is stable
+    vector<size_t> histograms(max_threads * nbuckets);
+
+    for(unsigned int shift = 0; shift < nbits; shift += 8)
+    {
+        bool constant_digit = false;
+#ifdef OMP
+        #pragma omp parallel num_threads(max_threads)
+#endif
+        {
+            int nthreads = 1;
+            int thread = 0;
+#ifdef OMP
+            nthreads = omp_get_num_threads();
+            thread = omp_get_thread_num();
+#endif
+            size_t begin = n * thread / nthreads;
+            size_t end = n * (thread + 1) / nthreads;
+            size_t *histogram = &histograms[thread * nbuckets];
+
+            for(unsigned int b = 0; b < nbuckets; ++b)
+                histogram[b] = 0;
+            for(size_t i = begin; i < end; ++i)
+                histogram[(keys[i].code >> shift) & 0xff]++;
+
+#ifdef OMP
+            #pragma omp barrier
+            #pragma omp single
+#endif
+            {
+                size_t offset = 0;
+                for(unsigned int b = 0; b < nbuckets; ++b)
+                {
+                    size_t bucket_size = 0;
+                    for(int t = 0; t < nthreads; ++t)
+                    {
+                        size_t count = histograms[t * nbuckets + b];
+                        histograms[t * nbuckets + b] = offset;
+                        offset += count;
+                        bucket_size += count;
+                    }
+                    if(bucket_size == n)
+                        constant_digit = true;
+                }
+            }
+
+            //all codes share this digit: the pass would not move anything
+            if(!constant_digit)
+            {
+                for(size_t i = begin; i < end; ++i)
+                  buffer[histogram[(keys[i].code >> shift) & 0xff]++] = keys[i];
+            }
+        }
+
+        if(!constant_digit)
+            keys.swap(buffer);
+    }
+}
@@ -0,0 +1,222 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file Morton.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+ * @file Morton.h
+ * declares Morton (Z-order) codes of locational codes and their sorting.
+ * At each level x is the most significant axis and z the least one, which
+ * matches the child numbering of TOctreeNode: once sorted, the points of
+ * any node of the octree are contiguous.
+ */
+
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <stdint.h>
+#include <vector>
+
+/**maximum depth of an octree whose locational codes fit in a 64 bits
+ * Morton code */
+#define MORTON_MAX_DEPTH 21
+
+/**Morton code of a point and index of the point in the input order*/
+struct MortonKey
+{
+  uint64_t code;
+
+  unsigned int index;
+};
+
+/**locational code of a point at the finest level of an octree
+ * (for octrees deeper than MORTON_MAX_DEPTH)
+ */
+struct MortonEntry
+{
+  unsigned int codx, cody, codz;
+
+  /**index of the point in the input order*/
+  unsigned int index;
+};
+
+/**spread the 21 lowest bits of a value, leaving two zeros between
+ * consecutive bits
+ * @param v value to spread
+ * @return spread value
+ */
+inline uint64_t spreadBits(unsigned int v)
+{
+  uint64_t x = v & 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffffULL;
+  x = (x | x << 16) & 0x1f0000ff0000ffULL;
+  x = (x | x << 8) & 0x100f00f00f00f00fULL;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+  x = (x | x << 2) & 0x1249249249249249ULL;
+  return x;
+}
+
+/**interleave three locational codes of at most MORTON_MAX_DEPTH bits
+ * @param codx x locational code
+ * @param cody y locational code
+ * @param codz z locational code
+ * @return Morton code
+ */
+inline uint64_t mortonEncode(unsigned int codx, unsigned int cody, unsigned int codz)
+{
+  return (spreadBits(codx) << 2) | (spreadBits(cody) << 1) | spreadBits(codz);
+}
+
+/**get the index of the most significant bit of a non zero value
+ * @param v value
+ * @return index of the highest bit set
+ */
+inline unsigned int msb64(uint64_t v)
+{
+#ifdef __GNUC__
+  return 63 - __builtin_clzll(v);
+#else
+  unsigned int n = 0;
+  while(v >>= 1)
+    n++;
+  return n;
+#endif
+}
+
+/**get the index of the least significant bit of a non zero value
+ * @param v value
+ * @return index of the lowest bit set
+ */
+inline unsigned int lsb64(uint64_t v)
+{
+#ifdef __GNUC__
+  return __builtin_ctzll(v);
+#else
+  unsigned int n = 0;
+  while(!(v & 1))
+  {
+    v >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+/**check if the most significant bit of a is lower than the one of b
+ * @param a
+ * @param b
+ * @return true if msb(a) < msb(b)
+ */
+inline bool lessMsb(unsigned int a, unsigned int b)
+{
+  return a < b && a < (a ^ b);
+}
+
+/**compare two locational codes along the Morton curve without interleaving
+ * them. Ties are broken by input order.
+ * @param a first code
+ * @param b second code
+ * @return true if a comes before b
+ */
+inline bool mortonLess(const MortonEntry &a, const MortonEntry &b)
+{
+  unsigned int diff = a.codx ^ b.codx;
+  unsigned int ka = a.codx, kb = b.codx;
+  if(lessMsb(diff, a.cody ^ b.cody))
+  {
+    diff = a.cody ^ b.cody;
+    ka = a.cody;
+    kb = b.cody;
+  }
+  if(lessMsb(diff, a.codz ^ b.codz))
+  {
+    diff = a.codz ^ b.codz;
+    ka = a.codz;
+    kb = b.codz;
+  }
+  if(diff == 0)
+    return a.index < b.index;
+  return ka < kb;
+}
+
+/**get the highest level at which two Morton codes differ, i.e. the depth
+ * of the highest node of the octree containing one point and not the other
+ * @param a first code
+ * @param b second code
+ * @return depth, -1 if the codes are equal
+ */
+inline int mortonDiffLevel(const MortonKey &a, const MortonKey &b)
+{
+  uint64_t diff = a.code ^ b.code;
+  return diff == 0 ? -1 : (int)(msb64(diff) / 3);
+}
+
+/**get the highest level at which two locational codes differ
+ * @param a first code
+ * @param b second code
+ * @return depth, -1 if the codes are equal
+ */
+inline int mortonDiffLevel(const MortonEntry &a, const MortonEntry &b)
+{
+  unsigned int diff = (a.codx ^ b.codx) | (a.cody ^ b.cody) | (a.codz ^ b.codz);
+  return diff == 0 ? -1 : (int)msb64(diff);
+}
+
+/**get the child number of the node of depth d containing a point, in its
+ * parent
+ * @param code Morton code of the point
+ * @param d depth of the node
+ * @return child number
+ */
+inline unsigned int mortonChild(uint64_t code, unsigned int d)
+{
+  return (unsigned int)((code >> (3 * d)) & 7);
+}
+
+/**get the child number of the node of depth d containing a point, in its
+ * parent
+ * @param key Morton code of the point
+ * @param d depth of the node
+ * @return child number
+ */
+inline unsigned int mortonChild(const MortonKey &key, unsigned int d)
+{
+  return mortonChild(key.code, d);
+}
+
+/**get the child number of the node of depth d containing a point, in its
+ * parent
+ * @param key locational code of the point
+ * @param d depth of the node
+ * @return child number
+ */
+inline unsigned int mortonChild(const MortonEntry &key, unsigned int d)
+{
+  return (((key.codx >> d) & 1) << 2) | (((key.cody >> d) & 1) << 1)
+         | ((key.codz >> d) & 1);
+}
+
+/**sort Morton keys by code (parallel LSD radix sort, 8 bits per pass)
+ * the sort is stable, so that ties are kept in input order
+ * @param keys keys to sort
+ * @param nbits number of significant bits of the codes
+ */
+void radixSort(std::vector<MortonKey> &keys, unsigned int nbits);
+
+#endif
@@ -37,10 +37,14 @@
 #include "utilities.h"
 #include "Point.h"
 #include "OctreeNode.h"
+#include "Morton.h"
+#include "CellIndex.h"
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
 #include <vector>
+#include <iterator>
+#include <algorithm>
 
 template<class T>
 class TOctree
@@ -79,15 +83,35 @@ class TOctree
 	void setDepth(unsigned int depth);
 	
 	/**get origign
-	 *  @return origin of the octree
+	 *  @return origin of the octree (relative to the storage origin)
 	 */
 	const Point& getOrigin() const;
 	
+	/**get the origin the coordinates of the points, of the nodes and of
+	 * getX, getY and getZ are stored relative to: their absolute
+	 * coordinates are the stored ones plus this origin (0 without
+	 * PDSS_FLOAT32, see Point::chooseStorageOrigin)
+	 * @param[out] origin x y z of the storage origin
+	 */
+	void getStorageOrigin(double origin[3]) const;
+	
+	/**set the storage origin (see getStorageOrigin), e.g. before
+	 * initialize(origin, size) with an origin relative to it
+	 * @param origin x y z of the storage origin
+	 */
+	void setStorageOrigin(const double origin[3]);
+	
 	/**get number of points
 	 * @return number of points
 	 */
 	 unsigned int getNpoints() const;
 	 
+	 /**get the number of non empty cells of a level
+	  * @param depth level (the root has the depth of the octree)
+	  * @return number of cells
+	  */
+	 unsigned int getNCells(unsigned int depth) const;
+	 
 	 /**get side size of the octree
 	  * @return size of the octree
 	  */
@@ -109,6 +133,148 @@ class TOctree
 	  */
 	 TOctreeNode<T>* getRoot() const;
 	 
+	 /**get a pointer to the points of the octree (sorted along the Morton curve)
+	  * @return pointer to the first point
+	  */
+	 T* points_begin();
+	 
+	 /**get a pointer to the end of the points of the octree
+	  * @return pointer past the last point
+	  */
+	 T* points_end();
+	 
+	 /**get the x coordinates of the points, in the order of points_begin
+	  * (structure of arrays view for the distance kernels, in Scalar
+	  * precision relative to the storage origin)
+	  * @return pointer to the x coordinate of the first point
+	  */
+	 const Scalar* getX() const;
+	 
+	 /**get the y coordinates of the points, in the order of points_begin
+	  * @return pointer to the y coordinate of the first point
+	  */
+	 const Scalar* getY() const;
+	 
+	 /**get the z coordinates of the points, in the order of points_begin
+	  * @return pointer to the z coordinate of the first point
+	  */
+	 const Scalar* getZ() const;
+	 
+
+  public : //locational codes
+	 
+	 /**compute the locational codes of a point at the finest level
+	  * @param pt point to locate
+	  * @param[out] codx x locational code
+	  * @param[out] cody y locational code
+	  * @param[out] codz z locational code
+	  */
+	 void computeCode(const Point &pt, unsigned int &codx, unsigned int &cody, unsigned int &codz) const;
+	 
+	 /**compute the Morton code of a point at the finest level: the child
+	  * containing the point at each level is read from 3 bits of it
+	  * (see mortonChild)
+	  * PREREQUISITE: getDepth() <= MORTON_MAX_DEPTH
+	  * @param pt point to locate
+	  * @return interleaved locational codes
+	  */
+	 uint64_t computeKey(const Point &pt) const;
+	 
+
+  public : //hashed access to the nodes of a level
+	 
+	 /**index the nodes of a level by their Morton codes, so that findNode
+	  * finds a node in constant time. The index is dropped when the tree is
+	  * rebuilt.
+	  * @param depth level to index
+	  * @return false if the codes of the level do not fit in a Morton code
+	  * (more than MORTON_MAX_DEPTH levels above it)
+	  */
+	 bool buildCellIndex(unsigned int depth);
+	 
+	 /**check if a level is indexed
+	  * @param depth level
+	  * @return true if buildCellIndex(depth) was called since the last build
+	  */
+	 bool hasCellIndex(unsigned int depth) const;
+	 
+	 /**find the cell of an indexed level containing a locational code
+	  * PREREQUISITE: hasCellIndex(depth)
+	  * @param xloc x locational code (finest level)
+	  * @param yloc y locational code
+	  * @param zloc z locational code
+	  * @param depth indexed level
+	  * @return cell (see getNode), NULL if it is empty (not in the tree)
+	  */
+	 const IndexedCell* findCell(unsigned int xloc, unsigned int yloc,
+	                             unsigned int zloc, unsigned int depth) const;
+	 
+	 /**get a node of an indexed cell
+	  * @param cell cell found by findCell
+	  * @return node
+	  */
+	 TOctreeNode<T>* getNode(const IndexedCell &cell);
+	 
+  public : //selection state
+	 
+	 /**bits of the selection state of a point (see getFlags)*/
+	 enum
+	 {
+	   FLAG_SELECTED = 1,
+	   FLAG_COVERED = 2
+	 };
+	 
+	 /**get the id of a point of the octree: its position in points_begin
+	  * order, which indexes the selection state
+	  * @param pt point stored in the octree
+	  * @return id of the point
+	  */
+	 size_t getId(const T *pt) const;
+	 
+	 /**get the selection state of a point. The states are stored in a byte
+	  * array apart from the points, so that covering a point does not dirty
+	  * the cache line of its coordinates (a byte per point and not a bit,
+	  * so that threads can write to neighbouring points)
+	  * @param id id of the point
+	  * @return FLAG_SELECTED and FLAG_COVERED bits
+	  */
+	 unsigned char getFlags(size_t id) const;
+	 
+	 /**set the selection state of a point
+	  * @param id id of the point
+	  * @param flags FLAG_SELECTED and FLAG_COVERED bits
+	  */
+	 void setFlags(size_t id, unsigned char flags);
+	 
+	 /**is a point selected (all the points are until a selection is run)
+	  * @param id id of the point
+	  * @return true if the point is selected
+	  */
+	 bool isSelected(size_t id) const;
+	 
+	 /**is a point covered by a selected point
+	  * @param id id of the point
+	  * @return true if the point is covered
+	  */
+	 bool isCovered(size_t id) const;
+	 
+	 /**get the number of times the points have been covered, the cover rate
+	  * being this number divided by the number of points
+	  * @return number of covers
+	  */
+	 unsigned long getNCovers() const;
+	 
+	 /**count covers
+	  * @param ncovers number of covers to add
+	  */
+	 void addNCovers(unsigned long ncovers);
+	 
+	 /**restart the selection among the selected points only (coarser
+	  * level of detail): they are uncovered and selected again, the other
+	  * points stay covered so that they cannot be selected anymore
+	  */
+	 void keepSelected();
+	 
 
   public : //adding points
    
@@ -117,15 +283,28 @@ class TOctree
 	 * @param size side size
 	 **/
 	void initialize(Point & origin, double size);
+	
+	/**initialize the octree so that it contains a bounding box
+	 * the cube is enlarged by 10% of the largest side of the box
+	 * @param bbox bounding box (xmin ymin zmin xmax ymax zmax), absolute
+	 * @param min_radius if positive, set the depth such that the smallest cell has size min_radius
+	 * @param storage_origin origin the points to add are stored relative
+	 * to (see getStorageOrigin), NULL for 0
+	 **/
+	void initialize(const double bbox[6], double min_radius = -1,
+	                const double *storage_origin = NULL);
 
 
 	/**Adding a point to the octree
+	 * the points are stored in a single array sorted along the Morton curve,
+	 * so that adding points rebuilds the tree and invalidates pointers to
+	 * the points already stored (prefer addPoints for batches)
 	 * @param pt point to add
 	 */
 	void addPoint(T &pt);
 
 	/**
-	 * Adding a batch of points to the octree
+	 * Adding a batch of points to the octree (copied to the octree storage)
 	 * @param begin begin iterator of the batch
 	 * @param end end iterator of the batch
 	 * @return number of added points
@@ -133,9 +312,56 @@ class TOctree
 	template<class Iterator>
 	unsigned int addPoints(Iterator begin, Iterator end);
 	
+	/**
+	 * Replace the points of the octree by the content of a vector and build
+	 * the tree. The vector is swapped into the octree storage (no copy) and
+	 * left empty.
+	 * @param points points to store, relative to the storage origin
+	 * @return number of added points
+	 */
+	unsigned int setPoints(std::vector<T> &points);
+	
 	/**print the mean number of points per non empty cell at each level*/
 	void printOctreeStat();
 	
+  public : //persistent index (see OctreeIndex.h)
+	
+	/**node of a saved octree, the nodes being listed in storage order*/
+	struct NodeRecord
+	{
+	  /**position of the first child in storage order*/
+	  uint64_t first_child;
+	  
+	  /**number of points of the node*/
+	  uint32_t npts;
+	  
+	  /**bit c is set if the child c exists*/
+	  uint32_t children;
+	};
+	
+	/**get the records of the nodes, to rebuild them with setSortedPoints
+	 * @param[out] records one record per node, in storage order
+	 */
+	void getNodeRecords(std::vector<NodeRecord> &records);
+	
+	/**use points sorted by a previous build and held outside of the octree
+	 * (e.g. in a mapped index file) and rebuild the nodes from their
+	 * records, without sorting nor reading the points. The memory is not
+	 * copied: it must outlive the octree, or the next setPoints.
+	 * PREREQUISITE: the depth, origin and size are the ones of the build
+	 * @param points points of the octree, in points_begin order
+	 * @param xs x coordinates of the points
+	 * @param ys y coordinates of the points
+	 * @param zs z coordinates of the points
+	 * @param npoints number of points
+	 * @param records records of the nodes (see getNodeRecords)
+	 * @param nrecords number of nodes
+	 * @return false if the records do not describe a tree of the points
+	 */
+	bool setSortedPoints(T *points, const Scalar *xs, const Scalar *ys,
+	                     const Scalar *zs, unsigned int npoints,
+	                     const NodeRecord *records, size_t nrecords);
+	
 	/**get all nodes at given depth
 	 * @param depth input depth
 	 * @param starting_node node to start from
@@ -163,6 +389,9 @@ class TOctree
 	/**Origin of the octree*/
 	Point m_origin;
 	
+	/**origin the coordinates are stored relative to*/
+	double m_storage_origin[3];
+	
 	/**size of the side of the octree*/
 	double m_size;
 	
@@ -171,11 +400,88 @@ class TOctree
 	 */
 	unsigned int m_binsize;
 	
-	/**root of the octree*/
+	/**root of the octree (first node of m_nodes)*/
 	TOctreeNode<T> *m_root;
 	
+	/**nodes of the octree, allocated at once and freed at once. The
+	 * children of a node are contiguous and stored before their own
+	 * children (depth first order of the sibling blocks), so that the path
+	 * from the root to a leaf stays local in memory.
+	 */
+	std::vector<TOctreeNode<T> > m_nodes;
+	
+	/**Morton codes of the nodes of one level to their index in m_nodes*/
+	CellIndex m_cell_index;
+	
+	/**level of m_cell_index, -1 if none*/
+	int m_cell_index_depth;
+	
 	/**number of non-empty cells per level*/
 	std::vector<unsigned int> m_nb_non_empty_cells;
+	
+	/**points of the octree sorted along the Morton curve*/
+	std::vector<T> m_points;
+	
+	/**coordinates of m_points, one array per axis, as stored by the points
+	 * (Scalar, relative to m_storage_origin)*/
+	std::vector<Scalar> m_xs, m_ys, m_zs;
+	
+	/**points and coordinates held outside of the octree (setSortedPoints),
+	 * used instead of m_points and m_xs, m_ys, m_zs if not NULL*/
+	T *m_external_points;
+	const Scalar *m_external_xs, *m_external_ys, *m_external_zs;
+	
+	/**selection state of m_points*/
+	std::vector<unsigned char> m_flags;
+	
+	/**number of times the points have been covered*/
+	unsigned long m_ncovers;
+	
+	/**sort the points along the Morton curve and rebuild the nodes from them*/
+	void buildTree();
+	
+	/**copy the points held outside of the octree to m_points*/
+	void copyExternalPoints();
+	
+	/**copy the coordinates of the sorted points to m_xs, m_ys and m_zs*/
+	void buildCoordinates();
+	
+	/**bulk build: sort the points by 64 bits Morton codes (radix sort) and
+	 * emit the nodes in a single pass over the sorted codes
+	 * PREREQUISITE: m_depth <= MORTON_MAX_DEPTH
+	 */
+	void buildTreeFromMortonCodes();
+	
+	/**build the tree from the locational codes sorted along the Morton
+	 * curve without interleaving them (octrees deeper than MORTON_MAX_DEPTH)
+	 */
+	void buildTreeFromLocationalCodes();
+	
+	/**allocate the nodes of the sorted points and link them
+	 * @param keys codes of the points (MortonKey or MortonEntry), sorted
+	 */
+	template<class Key>
+	void buildNodes(const std::vector<Key> &keys);
+	
+	/**build the children of a node, then their descendants
+	 * @param node node whose points are set
+	 * @param keys sorted codes of the points
+	 * @param begin first point of the node
+	 * @param end end of the points of the node
+	 * @param[in,out] next first free node of m_nodes
+	 */
+	template<class Key>
+	void buildChildren(TOctreeNode<T> *node, const std::vector<Key> &keys,
+	                   size_t begin, size_t end, size_t &next);
+	
+	/**create a child of a node and set its locational codes
+	 * @param node parent node
+	 * @param childIndex index of the child
+	 * @param child node of m_nodes to initialize
+	 * @return created child
+	 */
+	TOctreeNode<T>* createChild(TOctreeNode<T> *node, unsigned int childIndex,
+	                            TOctreeNode<T> *child);
 };
 
 template<class T>
@@ -185,8 +491,14 @@ TOctree<T>::TOctree()
   m_depth = 0;
   m_binsize = 0;
   m_npoints = 0;
+  m_ncovers = 0;
+  m_cell_index_depth = -1;
+  m_external_points = NULL;
+  m_external_xs = m_external_ys = m_external_zs = NULL;
   m_origin = Point();
-  m_root = new TOctreeNode<T>();
+  m_storage_origin[0] = m_storage_origin[1] = m_storage_origin[2] = 0;
+  m_nodes.resize(1);
+  m_root = &m_nodes[0];
   m_root->setDepth(0);
 }
 
@@ -198,7 +510,12 @@ TOctree<T>::TOctree(unsigned int depth)
   m_depth = depth;
   m_binsize = pow2(depth);
   m_npoints = 0;
+  m_ncovers = 0;
   m_root = NULL;
+  m_cell_index_depth = -1;
+  m_external_points = NULL;
+  m_external_xs = m_external_ys = m_external_zs = NULL;
+  m_storage_origin[0] = m_storage_origin[1] = m_storage_origin[2] = 0;
   m_nb_non_empty_cells.assign(depth,0);
 }
 
@@ -211,7 +528,12 @@ TOctree<T>::TOctree(Point& origin, double size, unsigned int depth)
   m_binsize = pow2(depth);
   m_origin = origin;
   m_npoints = 0;
+  m_ncovers = 0;
   m_root = NULL;
+  m_cell_index_depth = -1;
+  m_external_points = NULL;
+  m_external_xs = m_external_ys = m_external_zs = NULL;
+  m_storage_origin[0] = m_storage_origin[1] = m_storage_origin[2] = 0;
   m_nb_non_empty_cells.assign(depth,0);
 }
 
@@ -224,11 +546,8 @@ TOctree<T>::~TOctree()
   m_npoints = 0;
   m_origin = Point();
   
-  if(m_root != NULL)
-  {
-    delete m_root;
-    m_root = NULL;
-  }
+  m_root = NULL;
+  m_nodes.clear();
   m_nb_non_empty_cells.clear();
 }
 
@@ -239,7 +558,10 @@ void TOctree<T>::initialize(Point& origin, double size)
     m_size = size;
     m_origin = origin; 
     
-    m_root = new TOctreeNode<T>(m_origin, m_size, m_depth);
+    m_nodes.assign(1, TOctreeNode<T>(m_origin, m_size, m_depth));
+    m_root = &m_nodes[0];
+    m_cell_index.clear();
+    m_cell_index_depth = -1;
     
     m_root->setXLoc(0);
     m_root->setYLoc(0);
@@ -249,6 +571,48 @@ void TOctree<T>::initialize(Point& origin, double size)
 }
 
 
+template<class T>
+void TOctree<T>::initialize(const double bbox[6], double min_radius,
+                            const double *storage_origin)
+{
+	double lx = bbox[3] - bbox[0];
+	double ly = bbox[4] - bbox[1];
+	double lz = bbox[5] - bbox[2];
+	
+	double size = lx > ly ? lx : ly;
+	size = size > lz ? size : lz;
+
+	
+	size = 1.1 * size;
+	double margin;
+	
+	
+	if(min_radius > 0)
+	{
+	  //a radius above the size of the cloud gives a single cell
+	  double levels = ceil( log2( size / (min_radius) ));
+	  unsigned int depth = levels > 0 ? (unsigned int)levels : 0;
+	  double adapted_size = pow2(depth) * min_radius;
+	  margin = 0.5 * (adapted_size - size);
+	  size = adapted_size;
+	  setDepth(depth);
+	}
+	else
+	{
+	  margin = 0.05 * size;
+	}
+	
+	for(int k = 0; k < 3; ++k)
+	  m_storage_origin[k] = storage_origin != NULL ? storage_origin[k] : 0;
+	
+	double ox = bbox[0] - margin - m_storage_origin[0];
+	double oy = bbox[1] - margin - m_storage_origin[1];
+	double oz = bbox[2] - margin - m_storage_origin[2];
+	Point origin(ox,oy,oz);
+
+	initialize(origin, size);
+}
+
 template<class T>
 unsigned int TOctree<T>::getDepth() const
 {
@@ -270,6 +634,14 @@ unsigned int TOctree<T>::getNpoints() const
   return m_npoints;
 }
 
+template<class T>
+unsigned int TOctree<T>::getNCells(unsigned int depth) const
+{
+  if(depth >= m_nb_non_empty_cells.size())
+    return m_root != NULL ? 1 : 0;
+  return m_nb_non_empty_cells[depth];
+}
+
 
 template<class T>
 double TOctree<T>::getSize() const
@@ -297,72 +669,499 @@ const Point& TOctree<T>::getOrigin() const
   return m_origin;
 }
 
+template<class T>
+void TOctree<T>::getStorageOrigin(double origin[3]) const
+{
+  for(int k = 0; k < 3; ++k)
+    origin[k] = m_storage_origin[k];
+}
+
+template<class T>
+void TOctree<T>::setStorageOrigin(const double origin[3])
+{
+  for(int k = 0; k < 3; ++k)
+    m_storage_origin[k] = origin[k];
+}
+
 template<class T>
 TOctreeNode<T>* TOctree<T>::getRoot() const
 {
     return m_root;
 }
 
+template<class T>
+T* TOctree<T>::points_begin()
+{
+    if(m_external_points != NULL)
+      return m_external_points;
+    return m_points.empty() ? NULL : &m_points[0];
+}
+
+template<class T>
+const Scalar* TOctree<T>::getX() const
+{
+    if(m_external_xs != NULL)
+      return m_external_xs;
+    return m_xs.empty() ? NULL : &m_xs[0];
+}
+
+template<class T>
+const Scalar* TOctree<T>::getY() const
+{
+    if(m_external_ys != NULL)
+      return m_external_ys;
+    return m_ys.empty() ? NULL : &m_ys[0];
+}
+
+template<class T>
+const Scalar* TOctree<T>::getZ() const
+{
+    if(m_external_zs != NULL)
+      return m_external_zs;
+    return m_zs.empty() ? NULL : &m_zs[0];
+}
+
+template<class T>
+T* TOctree<T>::points_end()
+{
+    if(m_external_points != NULL)
+      return m_external_points + m_npoints;
+    return points_begin() + m_points.size();
+}
+
+template<class T>
+bool TOctree<T>::buildCellIndex(unsigned int depth)
+{
+    if(m_cell_index_depth == (int)depth)
+      return true;
+    if(depth > m_depth || m_depth - depth > MORTON_MAX_DEPTH || m_root == NULL)
+      return false;
+    
+    std::vector<TOctreeNode<T>*> nodes;
+    getNodes(depth, m_root, nodes);
+    m_cell_index.initialize(nodes.size());
+    for(size_t i = 0; i < nodes.size(); ++i)
+    {
+      TOctreeNode<T> *node = nodes[i];
+      IndexedCell cell;
+      cell.code = mortonEncode(node->getXLoc() >> depth,
+                               node->getYLoc() >> depth,
+                               node->getZLoc() >> depth);
+      cell.node = node - &m_nodes[0];
+      cell.begin = node->points_begin() - points_begin();
+      cell.end = node->points_end() - points_begin();
+      m_cell_index.insert(cell);
+    }
+    m_cell_index_depth = (int)depth;
+    return true;
+}
+
+template<class T>
+bool TOctree<T>::hasCellIndex(unsigned int depth) const
+{
+    return m_cell_index_depth == (int)depth;
+}
+
+template<class T>
+const IndexedCell* TOctree<T>::findCell(unsigned int xloc, unsigned int yloc,
+                                        unsigned int zloc, unsigned int depth) const
+{
+    //codes out of the octree would alias the ones of other cells
+    if(xloc >= m_binsize || yloc >= m_binsize || zloc >= m_binsize)
+      return NULL;
+    return m_cell_index.find(mortonEncode(xloc >> depth, yloc >> depth,
+                                          zloc >> depth));
+}
+
+template<class T>
+TOctreeNode<T>* TOctree<T>::getNode(const IndexedCell &cell)
+{
+    return &m_nodes[cell.node];
+}
+
+template<class T>
+size_t TOctree<T>::getId(const T *pt) const
+{
+    if(m_external_points != NULL)
+      return pt - m_external_points;
+    return pt - &m_points[0];
+}
+
+template<class T>
+unsigned char TOctree<T>::getFlags(size_t id) const
+{
+    return m_flags[id];
+}
+
+template<class T>
+void TOctree<T>::setFlags(size_t id, unsigned char flags)
+{
+    m_flags[id] = flags;
+}
+
+template<class T>
+bool TOctree<T>::isSelected(size_t id) const
+{
+    return (m_flags[id] & FLAG_SELECTED) != 0;
+}
+
+template<class T>
+bool TOctree<T>::isCovered(size_t id) const
+{
+    return (m_flags[id] & FLAG_COVERED) != 0;
+}
+
+template<class T>
+unsigned long TOctree<T>::getNCovers() const
+{
+    return m_ncovers;
+}
+
+template<class T>
+void TOctree<T>::addNCovers(unsigned long ncovers)
+{
+    m_ncovers += ncovers;
+}
+
+template<class T>
+void TOctree<T>::keepSelected()
+{
+    for(size_t id = 0; id < m_flags.size(); ++id)
+      m_flags[id] = (m_flags[id] & FLAG_SELECTED) ? FLAG_SELECTED : FLAG_COVERED;
+    m_ncovers = 0;
+}
+
 template<class T>
 template<class Iterator>
 unsigned int TOctree<T>::addPoints(Iterator begin, Iterator end)
 {
   Iterator it = begin;
   
+  copyExternalPoints();
+  m_points.reserve(m_points.size() + std::distance(begin, end));
   while(it != end)
   {
-    T &a = *it;
-    addPoint(a);
+    m_points.push_back(*it);
     ++it;
   }
+  buildTree();
   return m_npoints;
 }
 
 
+template<class T>
+unsigned int TOctree<T>::setPoints(std::vector<T> &points)
+{
+  m_points.clear();
+  m_points.swap(points);
+  m_external_points = NULL;
+  m_external_xs = m_external_ys = m_external_zs = NULL;
+  buildTree();
+  return m_npoints;
+}
+
 template<class T>
 void TOctree<T>::addPoint(T& pt)
 {
-  unsigned int codx=(unsigned int)((pt.x() - m_origin.x()) / m_size * m_binsize);
-  unsigned int cody=(unsigned int)((pt.y() - m_origin.y()) / m_size * m_binsize);
-  unsigned int codz=(unsigned int)((pt.z() - m_origin.z()) / m_size * m_binsize);
-  TOctreeNode<T> *node=getRoot();
-  unsigned int l=node->getDepth()-1;
+  copyExternalPoints();
+  m_points.push_back(pt);
+  buildTree();
+}
+
+template<class T>
+void TOctree<T>::copyExternalPoints()
+{
+  if(m_external_points == NULL)
+    return;
+  m_points.assign(m_external_points, m_external_points + m_npoints);
+  m_external_points = NULL;
+  m_external_xs = m_external_ys = m_external_zs = NULL;
+}
+
+template<class T>
+void TOctree<T>::getNodeRecords(std::vector<NodeRecord> &records)
+{
+  records.resize(m_nodes.size());
+  for(size_t i = 0; i < m_nodes.size(); ++i)
+  {
+    TOctreeNode<T> *node = &m_nodes[i];
+    NodeRecord &record = records[i];
+    record.first_child = 0;
+    record.npts = node->getNpts();
+    record.children = 0;
+    for(unsigned int c = 0; c < 8; ++c)
+    {
+      TOctreeNode<T> *child = node->getChild(c);
+      if(child == NULL)
+        continue;
+      if(record.children == 0)
+        record.first_child = child - &m_nodes[0];
+      record.children |= 1 << c;
+    }
+  }
+}
+
+template<class T>
+bool TOctree<T>::setSortedPoints(T *points, const Scalar *xs, const Scalar *ys,
+                                 const Scalar *zs, unsigned int npoints,
+                                 const NodeRecord *records, size_t nrecords)
+{
+  m_points.clear();
+  m_xs.clear();
+  m_ys.clear();
+  m_zs.clear();
+  m_external_points = points;
+  m_external_xs = xs;
+  m_external_ys = ys;
+  m_external_zs = zs;
+  m_npoints = npoints;
   
-  //traverse the octree until we reach a leaf
-  while(node->getDepth() != 0)
+  initialize(m_origin, m_size);
+  m_nb_non_empty_cells.assign(m_depth, 0);
+  if(nrecords == 0 || records[0].npts != npoints)
+    return false;
+  m_nodes.resize(nrecords);
+  m_root = &m_nodes[0];
+  m_root->setPoints(points, npoints);
+  
+  //the children are stored after their parent: the nodes are rebuilt in
+  //storage order, as by buildChildren
+  for(size_t i = 0; i < nrecords; ++i)
   {
-    unsigned int childBranchBit=1<<l;
-    unsigned int x = ( ( codx & childBranchBit) >> l );
-    unsigned int y = ( ( cody & childBranchBit) >> l );
-    unsigned int z = ( ( codz & childBranchBit) >> l );
-    unsigned int childIndex = (x<<2) + (y<<1) + z;
-    
-    if(node->getChild(childIndex) == NULL)
+    TOctreeNode<T> *node = &m_nodes[i];
+    T *first = node->points_begin();
+    T *end = node->points_end();
+    uint64_t next = records[i].first_child;
+    for(unsigned int c = 0; c < 8; ++c)
     {
-      double childSize = node->getSize()/2.0;
-      unsigned int childDepth = node->getDepth() - 1; 
-      Point origin = node->getOrigin();
-      Point childOrigin = Point( origin.x()  + x * childSize,
-				   origin.y() + y * childSize,
-				   origin.z() + z * childSize);
-      
-     
-      TOctreeNode<T> *child = node->initializeChild(childIndex, childOrigin); 
-      
-      child->setXLoc( node->getXLoc() + ( x<<(childDepth) ) );
-      child->setYLoc( node->getYLoc() + ( y<<(childDepth) ) );
-      child->setZLoc( node->getZLoc() + ( z<<(childDepth) ) );
-      m_nb_non_empty_cells[childDepth] += 1;
+      if(!(records[i].children & (1 << c)))
+        continue;
+      if(next <= i || next >= nrecords || node->getDepth() == 0
+         || records[next].npts > (size_t)(end - first))
+        return false;
+      TOctreeNode<T> *child = createChild(node, c, &m_nodes[next]);
+      child->setPoints(first, records[next].npts);
+      first += records[next].npts;
+      m_nb_non_empty_cells[child->getDepth()]++;
+      next++;
     }
-    node = node->getChild(childIndex);
-    l--;
+    if(records[i].children != 0 && first != end)
+      return false;
   }
   
-  //add the point to the leaf.
-  node->addPoint(pt);
-  m_npoints++;
+  m_flags.assign(npoints, (unsigned char)FLAG_SELECTED);
+  m_ncovers = 0;
+  return true;
+}
+
+template<class T>
+void TOctree<T>::computeCode(const Point &pt, unsigned int &codx, unsigned int &cody, unsigned int &codz) const
+{
+  codx=(unsigned int)((pt.x() - m_origin.x()) / m_size * m_binsize);
+  cody=(unsigned int)((pt.y() - m_origin.y()) / m_size * m_binsize);
+  codz=(unsigned int)((pt.z() - m_origin.z()) / m_size * m_binsize);
 }
 
+template<class T>
+uint64_t TOctree<T>::computeKey(const Point &pt) const
+{
+  unsigned int codx, cody, codz;
+  computeCode(pt, codx, cody, codz);
+  return mortonEncode(codx, cody, codz);
+}
+
+template<class T>
+void TOctree<T>::buildTree()
+{
+  if(m_depth <= MORTON_MAX_DEPTH)
+    buildTreeFromMortonCodes();
+  else
+    buildTreeFromLocationalCodes();
+  buildCoordinates();
+  m_flags.assign(m_points.size(), (unsigned char)FLAG_SELECTED);
+  m_ncovers = 0;
+}
+
+template<class T>
+void TOctree<T>::buildCoordinates()
+{
+  const int npoints = (int)m_points.size();
+  m_xs.resize(npoints);
+  m_ys.resize(npoints);
+  m_zs.resize(npoints);
+  
+#ifdef OMP
+  #pragma omp parallel for
+#endif
+  for(int i = 0; i < npoints; ++i)
+  {
+    m_xs[i] = (Scalar)m_points[i].x();
+    m_ys[i] = (Scalar)m_points[i].y();
+    m_zs[i] = (Scalar)m_points[i].z();
+  }
+}
+
+template<class T>
+void TOctree<T>::buildTreeFromMortonCodes()
+{
+  const int npoints = (int)m_points.size();
+  std::vector<MortonKey> keys(npoints);
+  
+#ifdef OMP
+  #pragma omp parallel for
+#endif
+  for(int i = 0; i < npoints; ++i)
+  {
+    keys[i].code = computeKey(m_points[i]);
+    keys[i].index = i;
+  }
+  radixSort(keys, 3 * m_depth);
+  
+  //apply the permutation in place, following its cycles
+  for(int i = 0; i < npoints; ++i)
+  {
+    if(keys[i].index == (unsigned int)i)
+      continue;
+    T tmp = m_points[i];
+    unsigned int j = i;
+    while(keys[j].index != (unsigned int)i)
+    {
+      unsigned int k = keys[j].index;
+      m_points[j] = m_points[k];
+      keys[j].index = j;
+      j = k;
+    }
+    m_points[j] = tmp;
+    keys[j].index = j;
+  }
+  
+  buildNodes(keys);
+}
+
+template<class T>
+void TOctree<T>::buildTreeFromLocationalCodes()
+{
+  //sort the points along the Morton curve
+  std::vector<MortonEntry> codes(m_points.size());
+  for(unsigned int i = 0; i < codes.size(); ++i)
+  {
+    computeCode(m_points[i], codes[i].codx, codes[i].cody, codes[i].codz);
+    codes[i].index = i;
+  }
+  std::sort(codes.begin(), codes.end(), mortonLess);
+  
+  //apply the permutation in place, following its cycles
+  for(unsigned int i = 0; i < codes.size(); ++i)
+  {
+    if(codes[i].index == i)
+      continue;
+    T tmp = m_points[i];
+    unsigned int j = i;
+    while(codes[j].index != i)
+    {
+      unsigned int k = codes[j].index;
+      m_points[j] = m_points[k];
+      codes[j].index = j;
+      j = k;
+    }
+    m_points[j] = tmp;
+    codes[j].index = j;
+  }
+  
+  buildNodes(codes);
+}
+
+template<class T>
+template<class Key>
+void TOctree<T>::buildNodes(const std::vector<Key> &keys)
+{
+  const int npoints = (int)keys.size();
+  initialize(m_origin, m_size);
+  m_nb_non_empty_cells.assign(m_depth, 0);
+  m_npoints = npoints;
+  
+  //count the nodes of each level to allocate them at once: a point starts
+  //new nodes at all depths below the highest level at which its code
+  //differs from the previous one
+  std::vector<unsigned int> ntops(m_depth + 1, 0);
+  for(int i = 0; i < npoints; ++i)
+  {
+    int top = i == 0 ? (int)m_depth - 1 : mortonDiffLevel(keys[i], keys[i-1]);
+    ntops[top + 1]++;
+  }
+  size_t nnodes = 1;
+  unsigned int ncells = 0;
+  for(int d = (int)m_depth - 1; d >= 0; --d)
+  {
+    ncells += ntops[d + 1];
+    m_nb_non_empty_cells[d] = ncells;
+    nnodes += ncells;
+  }
+  m_nodes.resize(nnodes);
+  m_root = &m_nodes[0];
+  
+  m_root->setPoints(points_begin(), npoints);
+  size_t next = 1;
+  if(npoints > 0)
+    buildChildren(m_root, keys, 0, npoints, next);
+}
+
+template<class T>
+template<class Key>
+void TOctree<T>::buildChildren(TOctreeNode<T> *node, const std::vector<Key> &keys,
+                               size_t begin, size_t end, size_t &next)
+{
+  if(node->getDepth() == 0)
+    return;
+  unsigned int d = node->getDepth() - 1;
+  
+  //the child numbers of the sorted points are increasing
+  unsigned int index[8];
+  size_t first[9];
+  unsigned int nchildren = 0;
+  for(size_t i = begin; i < end; ++i)
+  {
+    unsigned int c = mortonChild(keys[i], d);
+    if(nchildren == 0 || c != index[nchildren - 1])
+    {
+      index[nchildren] = c;
+      first[nchildren++] = i;
+    }
+  }
+  first[nchildren] = end;
+  
+  TOctreeNode<T> *children = &m_nodes[next];
+  next += nchildren;
+  for(unsigned int k = 0; k < nchildren; ++k)
+  {
+    createChild(node, index[k], children + k);
+    children[k].setPoints(&m_points[first[k]], first[k + 1] - first[k]);
+  }
+  for(unsigned int k = 0; k < nchildren; ++k)
+    buildChildren(children + k, keys, first[k], first[k + 1], next);
+}
+
+template<class T>
+TOctreeNode<T>* TOctree<T>::createChild(TOctreeNode<T> *node, unsigned int childIndex,
+                                        TOctreeNode<T> *child)
+{
+  unsigned int x = (childIndex >> 2) & 1;
+  unsigned int y = (childIndex >> 1) & 1;
+  unsigned int z = childIndex & 1;
+  double childSize = node->getSize()/2.0;
+  unsigned int childDepth = node->getDepth() - 1; 
+  Point origin = node->getOrigin();
+  Point childOrigin = Point( origin.x()  + x * childSize,
+                             origin.y() + y * childSize,
+                             origin.z() + z * childSize);
+  
+  node->initializeChild(childIndex, childOrigin, child);
+  
+  child->setXLoc( node->getXLoc() + ( x<<(childDepth) ) );
+  child->setYLoc( node->getYLoc() + ( y<<(childDepth) ) );
+  child->setZLoc( node->getZLoc() + ( z<<(childDepth) ) );
+  return child;
+}
 
 template<class T>
 void TOctree<T>::getNodes(unsigned int depth, TOctreeNode<T> *starting_node, std::vector< TOctreeNode<T>* >& nodes)
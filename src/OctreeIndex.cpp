@@ -0,0 +1,222 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file OctreeIndex.cpp
+* @author Julie Digne
+* octree saved to a file and mapped back, see OctreeIndex.h
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "OctreeIndex.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const char INDEX_MAGIC[8] = {'P', 'D', 'S', 'S', 'I', 'D', 'X', '\0'};
+
+/**sections start on a page boundary, so that they are mapped aligned*/
+static const uint64_t INDEX_ALIGNMENT = 4096;
+
+/**write a section of an index file, padded to the alignment
+ * @param f file
+ * @param data section
+ * @param length length of the section in bytes
+ * @return false if something went wrong
+ */
+static bool writeSection(FILE *f, const void *data, size_t length)
+{
+    static const char padding[INDEX_ALIGNMENT] = {0};
+    size_t npad = (INDEX_ALIGNMENT - length % INDEX_ALIGNMENT) % INDEX_ALIGNMENT;
+    return (length == 0 || fwrite(data, 1, length, f) == length)
+           && (npad == 0 || fwrite(padding, 1, npad, f) == npad);
+}
+
+/**size of a section padded to the alignment
+ * @param length length of the section in bytes
+ * @return padded length
+ */
+static uint64_t getPaddedLength(uint64_t length)
+{
+    return (length + INDEX_ALIGNMENT - 1) / INDEX_ALIGNMENT * INDEX_ALIGNMENT;
+}
+
+OctreeIndex::OctreeIndex()
+{
+    m_data = NULL;
+    m_length = 0;
+    m_radius = 0;
+}
+
+OctreeIndex::~OctreeIndex()
+{
+    unmap();
+}
+
+bool OctreeIndex::write(const char *filename, Octree &octree, double radius)
+{
+    std::vector<Octree::NodeRecord> records;
+    octree.getNodeRecords(records);
+    const uint64_t npoints = octree.getNpoints();
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = PDSS_INDEX_VERSION;
+    header.sample_size = sizeof(Sample);
+    header.scalar_size = sizeof(Scalar);
+    header.depth = octree.getDepth();
+    header.npoints = npoints;
+    header.nnodes = records.size();
+    header.origin[0] = octree.getOrigin().x();
+    header.origin[1] = octree.getOrigin().y();
+    header.origin[2] = octree.getOrigin().z();
+    header.size = octree.getSize();
+    header.radius = radius;
+    octree.getStorageOrigin(header.storage_origin);
+
+    uint64_t lengths[5] = {npoints * sizeof(Sample), npoints * sizeof(Scalar),
+                           npoints * sizeof(Scalar), npoints * sizeof(Scalar),
+                           records.size() * sizeof(Octree::NodeRecord)};
+    uint64_t offset = getPaddedLength(sizeof(Header));
+    for(int k = 0; k < 5; ++k)
+    {
+      header.offsets[k] = offset;
+      offset += getPaddedLength(lengths[k]);
+    }
+
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".tmp%ld", (long)getpid());
+    std::string tmp = std::string(filename) + suffix;
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if(f == NULL)
+      return false;
+    const void *sections[5] = {octree.points_begin(), octree.getX(),
+                               octree.getY(), octree.getZ(),
+                               records.empty() ? NULL : &records[0]};
+    bool ok = writeSection(f, &header, sizeof(header));
+    for(int k = 0; ok && k < 5; ++k)
+      ok = writeSection(f, sections[k], lengths[k]);
+    ok = (fclose(f) == 0) && ok;
+    if(!ok || rename(tmp.c_str(), filename) != 0)
+    {
+      unlink(tmp.c_str());
+      return false;
+    }
+    return true;
+}
+
+bool OctreeIndex::map(const char *filename, Octree &octree)
+{
+    unmap();
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0)
+    {
+      std::cerr<<"File "<<filename<<" could not be opened"<<std::endl;
+      return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header))
+    {
+      std::cerr<<filename<<" is not an index file"<<std::endl;
+      close(fd);
+      return false;
+    }
+    //private and writable: the octree hands out non const points, the
+    //pages written to (none by the selection) would be copied
+    void *data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                      fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+      return false;
+    m_data = data;
+    m_length = st.st_size;
+
+    Header header;
+    memcpy(&header, data, sizeof(header));
+    if(memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0)
+    {
+      std::cerr<<filename<<" is not an index file"<<std::endl;
+      unmap();
+      return false;
+    }
+    if(header.version != PDSS_INDEX_VERSION
+       || header.sample_size != sizeof(Sample)
+       || header.scalar_size != sizeof(Scalar))
+    {
+      std::cerr<<filename<<" was written by another version or build of pdss"
+               <<" (index again)"<<std::endl;
+      unmap();
+      return false;
+    }
+
+    uint64_t lengths[5] = {header.npoints * sizeof(Sample),
+                           header.npoints * sizeof(Scalar),
+                           header.npoints * sizeof(Scalar),
+                           header.npoints * sizeof(Scalar),
+                           header.nnodes * sizeof(Octree::NodeRecord)};
+    bool ok = true;
+    for(int k = 0; k < 5; ++k)
+      ok = ok && header.offsets[k] % INDEX_ALIGNMENT == 0
+           && header.offsets[k] <= m_length
+           && lengths[k] <= m_length - header.offsets[k];
+
+    //the samples and the origin are stored relative to the storage origin
+    char *base = (char*)m_data;
+    Point origin(header.origin[0], header.origin[1], header.origin[2]);
+    octree.setStorageOrigin(header.storage_origin);
+    octree.setDepth(header.depth);
+    octree.initialize(origin, header.size);
+    ok = ok && octree.setSortedPoints(
+               (Sample*)(base + header.offsets[0]),
+               (const Scalar*)(base + header.offsets[1]),
+               (const Scalar*)(base + header.offsets[2]),
+               (const Scalar*)(base + header.offsets[3]),
+               header.npoints,
+               (const Octree::NodeRecord*)(base + header.offsets[4]),
+               header.nnodes);
+    if(!ok)
+    {
+      std::cerr<<"The index file "<<filename<<" is corrupted"<<std::endl;
+      unmap();
+      return false;
+    }
+    m_radius = header.radius;
+    return true;
+}
+
+double OctreeIndex::getRadius() const
+{
+    return m_radius;
+}
+
+void OctreeIndex::unmap()
+{
+    if(m_data != NULL)
+      munmap(m_data, m_length);
+    m_data = NULL;
+    m_length = 0;
+}
@@ -0,0 +1,115 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file OctreeIndex.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+ * @file OctreeIndex.h
+ * declares the index files of pdss: an octree saved once built (pdss
+ * index), to be subsampled many times without reading and sorting the
+ * points again (pdss select). The file holds a header (version, layout of
+ * the samples, depth, origin and size of the octree), then, each section
+ * starting on a page boundary, the samples sorted along the Morton curve,
+ * their x, y and z coordinates and the records of the nodes. The file is
+ * mapped and the octree uses the mapped samples in place: only the nodes
+ * are rebuilt, and only the pages of the points read by the selection are
+ * loaded. The index is specific to the build (sample layout, endianness).
+ */
+
+#ifndef OCTREE_INDEX_H
+#define OCTREE_INDEX_H
+
+#include <cstddef>
+
+#include "types.h"
+#include "Sample.h"
+
+/**version of the index files, to be increased whenever their layout or the
+ * octree built from the same points change*/
+#define PDSS_INDEX_VERSION 2
+
+/**@class OctreeIndex
+ * octree saved to a file and mapped back
+ */
+class OctreeIndex
+{
+  public :
+
+  /**constructor (no file mapped)*/
+  OctreeIndex();
+
+  /**destructor (unmaps the file)*/
+  ~OctreeIndex();
+
+  /**save an octree
+   * @param filename name of the index file (written to a temporary file
+   * renamed once complete)
+   * @param octree octree to save
+   * @param radius smallest radius the octree was built for
+   * @return false if something went wrong
+   */
+  static bool write(const char *filename, Octree &octree, double radius);
+
+  /**map an index file and rebuild its octree. The octree uses the mapped
+   * samples: this index must outlive it (or its next setPoints). The
+   * mapping is private: the file is never modified.
+   * @param filename name of the index file
+   * @param[out] octree octree to rebuild
+   * @return false if the file could not be mapped or is not an index of
+   * this build
+   */
+  bool map(const char *filename, Octree &octree);
+
+  /**get the smallest radius the octree of the mapped index was built for
+   * @return radius
+   */
+  double getRadius() const;
+
+  private :
+
+  /**header of the index files*/
+  struct Header
+  {
+    char magic[8];
+    uint32_t version;
+    uint32_t sample_size;
+    uint32_t scalar_size;
+    uint32_t depth;
+    uint64_t npoints;
+    uint64_t nnodes;
+    double origin[3];
+    double size;
+    double radius;
+    /**origin of the stored coordinates (see TOctree::getStorageOrigin)*/
+    double storage_origin[3];
+    /**offsets of the samples, x, y and z coordinates and nodes*/
+    uint64_t offsets[5];
+  };
+
+  /**unmap the file*/
+  void unmap();
+
+  void *m_data;
+
+  size_t m_length;
+
+  double m_radius;
+};
+
+#endif
@@ -35,13 +35,21 @@
 #define OCTREE_ITERATOR_H
 
 #include<cstdlib>
+#include <algorithm>
+#include <functional>
+#include <limits>
 #include <list>
 #include <map>
+#include <utility>
+#include <vector>
 #include "Point.h"
 #include "Octree.h"
 #include "OctreeNode.h"
 #include <cmath>
 #include<cassert>
+#include "DistanceKernel.h"
+#include "Morton.h"
+#include "Metrics.h"
 
 /**@class TOctreeIterator
  * defines methods to access range neighbors of points
@@ -52,8 +60,11 @@ class TOctreeIterator
    public : //some typedefs
     typedef std::list<T*> Neighbor_star_list;
     typedef std::set<T*> Exception_set;
-    typedef std::map<double, T*> Neighbor_star_map;
+    typedef std::multimap<double, T*> Neighbor_star_map;
     typedef std::list<double> Distance_list;
+    /**square distance to the query and neighbor*/
+    typedef std::pair<double, T*> Neighbor_distance;
+    typedef std::vector<Neighbor_distance> Neighbor_distance_vector;
 
    private ://class members
     /**active depth*/
@@ -68,6 +79,9 @@ class TOctreeIterator
     /**TOctree the iterator refers to*/
     TOctree<T> *m_octree;
     
+    /**distance test of the runs of points*/
+    Distance_kernel m_kernel;
+    
     public ://constructor+destructor
      /**constructor*/
      TOctreeIterator<T>();
@@ -82,7 +96,7 @@ class TOctreeIterator
      
      /**set radius and active depth accordingly
       * @param radius radius to set
-      * @return false if the radius was not coherent with the structure (> bounding box size)
+      * @return false if the radius is not positive
       */
      bool setR(double radius);
      
@@ -143,6 +157,39 @@ class TOctreeIterator
        */
       unsigned int getNeighbors(const Point &query, TOctreeNode<T> *query_node, Neighbor_star_list &neighbors, Distance_list &distances) const;
       
+      /**get star-neighbors of a given point in a reusable buffer
+       * @param query query point
+       *@param[out] neighbors buffer of neighbors, cleared by the method (its capacity is kept)
+       *@return number of neighbors
+       */
+      unsigned int getNeighbors(const Point &query, std::vector<T*> &neighbors) const;
+      
+      /**get star neighbors of a given point in a reusable buffer when the node containing that point is known
+       * @param query query point
+       *@param query_node node containing the query point
+       *@param[out] neighbors buffer of neighbors, cleared by the method (its capacity is kept)
+       *@return number of neighbors
+       */
+      unsigned int getNeighbors(const Point &query, TOctreeNode<T> *query_node, std::vector<T*> &neighbors) const;
+      
+      /**call a visitor on each neighbor of a given point, no memory is allocated
+       * the visitor is called as visitor(T *neighbor, double square_distance)
+       * @param query query point
+       *@param visitor functor called on each neighbor
+       *@return number of neighbors
+       */
+      template<class Visitor>
+      unsigned int visitNeighbors(const Point &query, Visitor &visitor) const;
+      
+      /**call a visitor on each neighbor of a given point when the node containing that point is known
+       * @param query query point
+       *@param query_node node containing the query point
+       *@param visitor functor called on each neighbor
+       *@return number of neighbors
+       */
+      template<class Visitor>
+      unsigned int visitNeighbors(const Point &query, TOctreeNode<T> *query_node, Visitor &visitor) const;
+      
      /**get neighbors of a given point sorted by their distances 
        * @param query query point
        *@param[out] neighbors map of neighbors to be filled by the method
@@ -159,6 +206,63 @@ class TOctreeIterator
        */
      unsigned int getSortedNeighbors(const Point &query, TOctreeNode<T> *node, Neighbor_star_map &neighbors) const;
      
+     /**get the neighbors of a given point sorted by their distances in a
+      * reusable buffer. Points at equal distances are ordered as in the
+      * octree.
+      * @param query query point
+      * @param[out] neighbors square distances and neighbors, cleared by the method (its capacity is kept)
+      * @param max_neighbors if positive, only the closest max_neighbors are kept (partial sort)
+      * @return number of neighbors
+      */
+     unsigned int getSortedNeighbors(const Point &query, Neighbor_distance_vector &neighbors,
+                                     unsigned int max_neighbors = 0) const;
+     
+     /**get the sorted neighbors of a given point when the node containing that point is known
+      * @param query query point
+      * @param node node containing the query point
+      * @param[out] neighbors square distances and neighbors, cleared by the method (its capacity is kept)
+      * @param max_neighbors if positive, only the closest max_neighbors are kept (partial sort)
+      * @return number of neighbors
+      */
+     unsigned int getSortedNeighbors(const Point &query, TOctreeNode<T> *node,
+                                     Neighbor_distance_vector &neighbors,
+                                     unsigned int max_neighbors = 0) const;
+     
+     /**get the sorted neighbors of several points, in parallel
+      * @param queries query points (any type derived from Point)
+      * @param[out] neighbors sorted neighbors of each query, resized to the number of queries
+      * @param max_neighbors if positive, only the closest max_neighbors are kept
+      */
+     template<class Q>
+     void getSortedNeighbors(const std::vector<Q> &queries,
+                             std::vector<Neighbor_distance_vector> &neighbors,
+                             unsigned int max_neighbors = 0) const;
+     
+     /**get the k nearest neighbors of a given point, whatever the radius of
+      * the iterator: the nodes are explored from the closest one, and the
+      * search radius shrinks to the k-th distance found so far. The query is
+      * one of the neighbors if it is a point of the octree.
+      * @param query query point
+      * @param k number of neighbors
+      * @param[out] neighbors square distances and neighbors sorted by distance, cleared by the method (its capacity is kept)
+      * @param radius if positive, only the neighbors closer than radius are looked for
+      * @return number of neighbors (less than k if the octree or the ball hold fewer points)
+      */
+     unsigned int getKNearestNeighbors(const Point &query, unsigned int k,
+                                       Neighbor_distance_vector &neighbors,
+                                       double radius = -1) const;
+     
+     /**get the k nearest neighbors of several points, in parallel
+      * @param queries query points (any type derived from Point)
+      * @param k number of neighbors
+      * @param[out] neighbors k nearest neighbors of each query, resized to the number of queries
+      * @param radius if positive, only the neighbors closer than radius are looked for
+      */
+     template<class Q>
+     void getKNearestNeighbors(const std::vector<Q> &queries, unsigned int k,
+                               std::vector<Neighbor_distance_vector> &neighbors,
+                               double radius = -1) const;
+     
       /** Look in a ball centered at query point if there is any other point than those given in the parameter set
        * @param query center point
        * @param exceptions set of elements that are allowed in the neighborhood
@@ -177,13 +281,46 @@ class TOctreeIterator
 private :
     
     
-     /**
-      explore a node to find neighbors of a point.
-      @param node (node to explore)
-      @param query_point (center of the neighborhood)
-      @param neighbors deque of points (at the end: neighbors of pt)
-      */
-     void explore(TOctreeNode<T> *node, const Point &query_point, Neighbor_star_list &neighbors) const;
+     /**visitor appending the neighbors to a list*/
+     struct ListCollector
+     {
+       ListCollector(Neighbor_star_list &l) : neighbors(l) {}
+       void operator()(T *neighbor, double) { neighbors.push_back(neighbor); }
+       Neighbor_star_list &neighbors;
+     };
+     
+     /**visitor appending the neighbors and their distances to lists*/
+     struct DistanceCollector
+     {
+       DistanceCollector(Neighbor_star_list &l, Distance_list &d) : neighbors(l), distances(d) {}
+       void operator()(T *neighbor, double dist) { neighbors.push_back(neighbor); distances.push_back(dist); }
+       Neighbor_star_list &neighbors;
+       Distance_list &distances;
+     };
+     
+     /**visitor appending the neighbors to a vector*/
+     struct VectorCollector
+     {
+       VectorCollector(std::vector<T*> &v) : neighbors(v) {}
+       void operator()(T *neighbor, double) { neighbors.push_back(neighbor); }
+       std::vector<T*> &neighbors;
+     };
+     
+     /**visitor appending the neighbors and their distances to a vector*/
+     struct DistanceVectorCollector
+     {
+       DistanceVectorCollector(Neighbor_distance_vector &v) : neighbors(v) {}
+       void operator()(T *neighbor, double dist) { neighbors.push_back(Neighbor_distance(dist, neighbor)); }
+       Neighbor_distance_vector &neighbors;
+     };
+     
+     /**visitor inserting the neighbors in a map sorted by distance*/
+     struct MapCollector
+     {
+       MapCollector(Neighbor_star_map &m) : neighbors(m) {}
+       void operator()(T *neighbor, double dist) { neighbors.insert( std::pair<double, T*>(dist, neighbor) ); }
+       Neighbor_star_map &neighbors;
+     };
       
      /**
       explore a node to look at neighbors of a point. Stops if one of those neighbors is not in the exception set
@@ -194,24 +331,6 @@ private :
       */
      void explore(TOctreeNode<T> *node, const Point &query_point, const Exception_set &exceptions, bool &check) const;
     
-     /**
-      explore a node to find neighbors of a point.
-      @param node (node to explore)
-      @param query_point (center of the neighborhood)
-      @param neighbors deque of points (at the end: neighbors of pt)
-      @param distances distance to the neigbors
-      */
-     void explore(TOctreeNode<T> *node, const Point &query_point, Neighbor_star_list &neighbors, Distance_list &distances) const;
-     
-
-     /**explore a node to find neighbors of a point and sort them according to their distance
-      @param node (node to explore)
-      @param query_point (center of the neighborhood)
-      @param neighbors map of points sorted by their distances to the query point 
-      */
-     void exploreSort(TOctreeNode<T> *node, const Point &query_point, Neighbor_star_map &neighbors) const;
-    
-     
      /**
       follow the path given by loc-codes beginning at node
       @param node pointer to the node where the path begins (at the end is is the end of path node)
@@ -222,6 +341,44 @@ private :
       */
      void traverseToLevel(TOctreeNode<T> **node,unsigned int xLocCode,unsigned int yLocCode, unsigned int zLocCode, unsigned int k) const;
      
+     /**
+      follow the path given by a Morton code beginning at node: the child
+      of each level is read from 3 bits of the code
+      @param node pointer to the node where the path begins (at the end is is the end of path node)
+      @param key Morton code of the path (see TOctree::computeKey)
+      @param k max level to look for
+      */
+     void traverseToLevel(TOctreeNode<T> **node, uint64_t key, unsigned int k) const;
+     
+     /**nodes holding at most this number of points are not split by the
+      * k nearest neighbors search: their points are tested at once*/
+     enum { KNN_LEAF_SIZE = 8 };
+     
+     /**square distance of a node to the query and node*/
+     typedef std::pair<double, TOctreeNode<T>*> Node_distance;
+     
+     /**
+      get the square distance from a point to the box of a node
+      @param query point
+      @param node node
+      @return 0 if the point is in the node
+      */
+     static double getSquareDistance(const Point &query, const TOctreeNode<T> *node);
+     
+     /**
+      find the points of the node of a level containing a locational code: a
+      lookup if the level is indexed by the octree (buildCellIndex), a
+      traversal from the root otherwise
+      @param xLocCode x locational code
+      @param yLocCode y locational code
+      @param zLocCode z locational code
+      @param k level
+      @param[out] begin index of the first point of the node
+      @param[out] end index past the last point of the node
+      @return false if there is no node at this level
+      */
+     bool findPoints(unsigned int xLocCode, unsigned int yLocCode, unsigned int zLocCode, unsigned int k, size_t &begin, size_t &end) const;
+     
      /**
       * get left neighbor code (along x-axis) of a cell
       * @param cell
@@ -265,14 +422,6 @@ private :
       */
      unsigned int getZRightCode(TOctreeNode<T> *cell) const;
      
-     /**compute the code of a given position (useful for locating points and traversing the octree
-      @param point point to locate
-      @param[out] xcode x locational code 
-      @param[out] ycode y locational code 
-      @param[out] zcode z locational code 
-      */
-     void computeCode(const Point &point, unsigned int &codx, unsigned int &cody, unsigned int &codz) const;
-    
      /**return a cell containing the point at active depth
       @param point to locate
       @return the node containing the point at active depth
@@ -284,6 +433,7 @@ template<class T>
 TOctreeIterator<T>::TOctreeIterator()
 {
   m_octree = NULL;
+  m_kernel = getDistanceKernel();
 }
 
 
@@ -294,6 +444,7 @@ TOctreeIterator<T>::TOctreeIterator(TOctree<T>* octree)
   m_activeDepth = m_octree->getDepth();
   m_radius = m_octree->getSize()/((double)pow2(m_activeDepth));
   m_sqradius = m_radius * m_radius;
+  m_kernel = getDistanceKernel();
 }
 
 
@@ -332,11 +483,19 @@ double TOctreeIterator<T>::getR() const
 template<class T>
 bool TOctreeIterator<T>::setR(double radius)
 {
-  if(radius < m_octree->getSize())
+  if(radius > 0)
   {
      m_radius = radius;
      m_sqradius = m_radius * m_radius;
-     m_activeDepth = (unsigned int)(m_octree->getDepth() - floor( log2( m_octree->getSize() / (2.0*m_radius) )));
+     // a radius above half the box size would ask for depth D+1 or more (the
+     // root cell then holds all the neighbors), and one below the finest cell
+     // for a negative depth: clamp to the octree levels
+     double depth = m_octree->getDepth() - floor( log2( m_octree->getSize() / (2.0*m_radius) ));
+     if(depth < 0)
+        depth = 0;
+     if(depth > m_octree->getDepth())
+        depth = m_octree->getDepth();
+     m_activeDepth = (unsigned int)depth;
      return true;
   }
   return false;
@@ -369,212 +528,146 @@ unsigned int TOctreeIterator<T>::getNeighbors(const Point& query, Neighbor_star_
 
 template<class T>
 unsigned int TOctreeIterator<T>::getNeighbors(const Point& query, TOctreeNode<T>* query_node, Neighbor_star_list& neighbors) const
-{	
-  Point octree_origin = m_octree->getOrigin();
-  Point node_origin = query_node->getOrigin();
-  double node_size = query_node->getSize();
-  double octree_size = m_octree->getSize();
-  
-  if(query_node->getDepth() ==  m_activeDepth)
-  {
-    //find neighboring nodes
-    list<unsigned int> xloc, yloc, zloc;
-    xloc.push_back(query_node->getXLoc());
-    yloc.push_back(query_node->getYLoc());
-    zloc.push_back(query_node->getZLoc());
-    
-    if((query.x() - m_radius  < node_origin.x())&&(query.x() - m_radius > octree_origin.x()))
-      xloc.push_back(getXLeftCode(query_node));
-    if((query.x() + m_radius > node_origin.x() + node_size) && (query.x() + m_radius <octree_origin.x() + octree_size))
-      xloc.push_back(getXRightCode(query_node));
-    
-    if((query.y() - m_radius < node_origin.y())&&(query.y() - m_radius >octree_origin.y()))
-      yloc.push_back(getYLeftCode(query_node));
-    if((query.y() + m_radius > node_origin.y() + node_size) && (query.y() + m_radius < octree_origin.y() + octree_size))
-      yloc.push_back(getYRightCode(query_node));
-    
-    if((query.z() - m_radius  < node_origin.z())&&(query.z() - m_radius >octree_origin.z()))
-      zloc.push_back(getZLeftCode(query_node));
-    if((query.z() + m_radius > node_origin.z() +node_size) && (query.z() + m_radius <octree_origin.z() + octree_size))
-      zloc.push_back(getZRightCode(query_node));
-    
-    //look inside neighboring node
-      list<unsigned int>::iterator xi,yi,zi;
-      xi = xloc.begin();
-      while(xi != xloc.end())
-      {
-	yi = yloc.begin();
-	while(yi != yloc.end())
-	{
-	  zi = zloc.begin();
-	  while(zi != zloc.end())
-	  {
-	    TOctreeNode<T> *node=m_octree->getRoot();
-	    traverseToLevel(&node, *xi, *yi, *zi, m_activeDepth);
-	    if((node!=NULL)&&(node->getDepth() == m_activeDepth))
-	      explore(node, query, neighbors);
-	    ++zi;
-	  }
-	  ++yi;
-	}
-	++xi;
-      }
-  }
-  else
-  {
-    unsigned int s = query_node->getDepth();
-    list<unsigned int> xloc, yloc, zloc;
-    xloc.push_back(query_node->getXLoc());
-    yloc.push_back(query_node->getYLoc());
-    zloc.push_back(query_node->getZLoc());
-    if((query.x() - m_radius  < node_origin.x() )&&(query.x() - m_radius > octree_origin.x() ))
-      xloc.push_back(getXLeftCode(query_node));
-    if((query.x() + m_radius > node_origin.x() + node_size) && (query.x() + m_radius < octree_origin.x() +octree_size))
-      xloc.push_back(getXRightCode(query_node));
-    
-    if((query.y() - m_radius  < node_origin.y() )&&(query.y() - m_radius >octree_origin.y() ))
-      yloc.push_back(getYLeftCode(query_node));
-    if((query.y() + m_radius > node_origin.y() + node_size) && (query.y() + m_radius < octree_origin.y()+octree_size))
-      yloc.push_back(getYRightCode(query_node));
-    
-    if((query.z() - m_radius  < node_origin.z() )&&(query.z() - m_radius >octree_origin.z()))
-      zloc.push_back(getZLeftCode(query_node));
-    if((query.z() + m_radius > node_origin.z() + node_size) && (query.z() + m_radius <octree_origin.z() + octree_size))
-      zloc.push_back(getZRightCode(query_node));
-    
-    
-    //look inside neighboring nodes
-      list<unsigned int>::iterator xi,yi,zi;
-      xi = xloc.begin();
-      while(xi != xloc.end())
-      {
-	yi = yloc.begin();
-	while(yi != yloc.end())
-	{
-	  zi = zloc.begin();
-	  while(zi != zloc.end())
-	  {
-	    TOctreeNode<T> *node=m_octree->getRoot();
-	    traverseToLevel(&node,*xi,*yi,*zi,s);
-	    if( (node != NULL )&&( node->getDepth() == s))
-	      explore(node,query,neighbors);
-	    ++zi;
-	  }
-	  ++yi;
-	}
-	++xi;
-      }
-  }
+{
+  ListCollector collector(neighbors);
+  visitNeighbors(query, query_node, collector);
   return (int)neighbors.size();
 }
 
-
 template<class T>
 unsigned int TOctreeIterator<T>::getNeighbors(const Point& query, TOctreeNode<T>* query_node, Neighbor_star_list& neighbors, Distance_list &distances) const
-{	
-  Point octree_origin = m_octree->getOrigin();
-  Point node_origin = query_node->getOrigin();
+{
+  DistanceCollector collector(neighbors, distances);
+  visitNeighbors(query, query_node, collector);
+  return (int)neighbors.size();
+}
+
+template<class T>
+unsigned int TOctreeIterator<T>::getNeighbors(const Point& query, std::vector<T*> &neighbors) const
+{
+  TOctreeNode<T> *node = locatePointNode(query);
+  return getNeighbors(query, node, neighbors);
+}
+
+template<class T>
+unsigned int TOctreeIterator<T>::getNeighbors(const Point& query, TOctreeNode<T>* query_node, std::vector<T*> &neighbors) const
+{
+  neighbors.clear();
+  VectorCollector collector(neighbors);
+  return visitNeighbors(query, query_node, collector);
+}
+
+template<class T>
+template<class Visitor>
+unsigned int TOctreeIterator<T>::visitNeighbors(const Point& query, Visitor &visitor) const
+{
+  TOctreeNode<T> *node = locatePointNode(query);
+  return visitNeighbors(query, node, visitor);
+}
+
+template<class T>
+template<class Visitor>
+unsigned int TOctreeIterator<T>::visitNeighbors(const Point& query, TOctreeNode<T>* query_node, Visitor &visitor) const
+{
+  const Point &octree_origin = m_octree->getOrigin();
+  const Point &node_origin = query_node->getOrigin();
   double node_size = query_node->getSize();
   double octree_size = m_octree->getSize();
+  //neighbors are looked for in the nodes of the level of the query node
+  //(the active depth, unless the branch stops earlier)
+  unsigned int s = query_node->getDepth();
+  PDSS_COUNT(NEIGHBOR_QUERIES, 1);
   
-  if(query_node->getDepth() ==  m_activeDepth)
-  {
-    //find neighboring nodes
-    list<unsigned int> xloc, yloc, zloc;
-    xloc.push_back(query_node->getXLoc());
-    yloc.push_back(query_node->getYLoc());
-    zloc.push_back(query_node->getZLoc());
-    
-    if((query.x() - m_radius  < node_origin.x())&&(query.x() - m_radius > octree_origin.x()))
-      xloc.push_back(getXLeftCode(query_node));
-    if((query.x() + m_radius > node_origin.x() + node_size) && (query.x() + m_radius <octree_origin.x() + octree_size))
-      xloc.push_back(getXRightCode(query_node));
-    
-    if((query.y() - m_radius < node_origin.y())&&(query.y() - m_radius >octree_origin.y()))
-      yloc.push_back(getYLeftCode(query_node));
-    if((query.y() + m_radius > node_origin.y() + node_size) && (query.y() + m_radius < octree_origin.y() + octree_size))
-      yloc.push_back(getYRightCode(query_node));
-   
-    if((query.z() - m_radius  < node_origin.z())&&(query.z() - m_radius >octree_origin.z()))
-      zloc.push_back(getZLeftCode(query_node));
-    if((query.z() + m_radius > node_origin.z() +node_size) && (query.z() + m_radius <octree_origin.z() + octree_size))
-      zloc.push_back(getZRightCode(query_node));
-    
-    //look inside neighboring node
-      list<unsigned int>::iterator xi,yi,zi;
-      xi = xloc.begin();
-      while(xi != xloc.end())
+  //find neighboring nodes: at most the node and one neighbor on each side
+  unsigned int xloc[3], yloc[3], zloc[3];
+  unsigned int nx = 1, ny = 1, nz = 1;
+  xloc[0] = query_node->getXLoc();
+  yloc[0] = query_node->getYLoc();
+  zloc[0] = query_node->getZLoc();
+  
+  if((query.x() - m_radius  < node_origin.x())&&(query.x() - m_radius > octree_origin.x()))
+    xloc[nx++] = getXLeftCode(query_node);
+  if((query.x() + m_radius > node_origin.x() + node_size) && (query.x() + m_radius <octree_origin.x() + octree_size))
+    xloc[nx++] = getXRightCode(query_node);
+  
+  if((query.y() - m_radius < node_origin.y())&&(query.y() - m_radius >octree_origin.y()))
+    yloc[ny++] = getYLeftCode(query_node);
+  if((query.y() + m_radius > node_origin.y() + node_size) && (query.y() + m_radius < octree_origin.y() + octree_size))
+    yloc[ny++] = getYRightCode(query_node);
+  
+  if((query.z() - m_radius  < node_origin.z())&&(query.z() - m_radius >octree_origin.z()))
+    zloc[nz++] = getZLeftCode(query_node);
+  if((query.z() + m_radius > node_origin.z() +node_size) && (query.z() + m_radius <octree_origin.z() + octree_size))
+    zloc[nz++] = getZRightCode(query_node);
+  
+  //look inside neighboring nodes
+  T *points = m_octree->points_begin();
+  const Scalar *xs = m_octree->getX();
+  const Scalar *ys = m_octree->getY();
+  const Scalar *zs = m_octree->getZ();
+  unsigned int n = 0;
+  for(unsigned int xi = 0; xi < nx; ++xi)
+    for(unsigned int yi = 0; yi < ny; ++yi)
+      for(unsigned int zi = 0; zi < nz; ++zi)
       {
-	yi = yloc.begin();
-	while(yi != yloc.end())
-	{
-	  zi = zloc.begin();
-	  while(zi != zloc.end())
-	  {
-	    TOctreeNode<T> *node=m_octree->getRoot();
-	    traverseToLevel(&node, *xi, *yi, *zi, m_activeDepth);
-	    if((node!=NULL)&&(node->getDepth() == m_activeDepth))
-	      explore(node, query, neighbors, distances);
-	    ++zi;
-	  }
-	  ++yi;
-	}
-	++xi;
+        //the points of the node and of its children are contiguous:
+        //their coordinates are tested by runs with the distance kernel
+        size_t begin, end;
+        if(!findPoints(xloc[xi], yloc[yi], zloc[zi], s, begin, end))
+          continue;
+        PDSS_COUNT(NODES_VISITED, 1);
+        PDSS_COUNT(DISTANCE_TESTS, end - begin);
+        for(size_t i = begin; i < end; i += DISTANCE_KERNEL_WIDTH)
+        {
+          unsigned int count = end - i < DISTANCE_KERNEL_WIDTH
+                               ? end - i : DISTANCE_KERNEL_WIDTH;
+          uint64_t hits = m_kernel(xs + i, ys + i, zs + i, count,
+                                   query.x(), query.y(), query.z(),
+                                   m_sqradius);
+          while(hits != 0)
+          {
+            T *neighbor = points + i + lsb64(hits);
+            hits &= hits - 1;
+            visitor(neighbor, dist2( query, *neighbor));
+            n++;
+          }
+        }
       }
-  }
-  else
+  return n;
+}
+
+template<class T>
+bool TOctreeIterator<T>::findPoints(unsigned int xLocCode, unsigned int yLocCode, unsigned int zLocCode, unsigned int k, size_t &begin, size_t &end) const
+{
+  if(m_octree->hasCellIndex(k))
   {
-    unsigned int s=query_node->getDepth();
-    list<unsigned int> xloc, yloc, zloc;
-    xloc.push_back(query_node->getXLoc());
-    yloc.push_back(query_node->getYLoc());
-    zloc.push_back(query_node->getZLoc());
-    if((query.x() - m_radius  < node_origin.x())&&(query.x() - m_radius > octree_origin.x()))
-      xloc.push_back(getXLeftCode(query_node));
-    if((query.x() + m_radius > node_origin.x() + node_size) && (query.x() + m_radius < octree_origin.x() + octree_size))
-      xloc.push_back(getXRightCode(query_node));
-    
-    if((query.y() - m_radius  < node_origin.y())&&(query.y() - m_radius >octree_origin.y() ))
-      yloc.push_back(getYLeftCode(query_node));
-    if((query.y() + m_radius > node_origin.y() + node_size) && (query.y() + m_radius < octree_origin.y() + octree_size))
-      yloc.push_back(getYRightCode(query_node));
-    
-    if((query.z() - m_radius  < node_origin.z() )&&(query.z() - m_radius >octree_origin.z()))
-      zloc.push_back(getZLeftCode(query_node));
-    if((query.z() + m_radius > node_origin.z() +node_size) && (query.z() + m_radius <octree_origin.z() + octree_size))
-      zloc.push_back(getZRightCode(query_node));
-    
-    
-    //look inside neighboring nodes
-      list<unsigned int>::iterator xi,yi,zi;
-      xi = xloc.begin();
-      while(xi != xloc.end())
-      {
-	yi = yloc.begin();
-	while(yi != yloc.end())
-	{
-	  zi = zloc.begin();
-	  while(zi != zloc.end())
-	  {
-	    TOctreeNode<T> *node=m_octree->getRoot();
-	    traverseToLevel(&node,*xi,*yi,*zi,s);
-	    if( (node != NULL )&&( node->getDepth() == s))
-	      explore(node,query,neighbors, distances);
-	    ++zi;
-	  }
-	  ++yi;
-	}
-	++xi;
-      }
+    const IndexedCell *cell = m_octree->findCell(xLocCode, yLocCode, zLocCode, k);
+    if(cell == NULL)
+      return false;
+    begin = cell->begin;
+    end = cell->end;
+    return true;
   }
-  return (int)neighbors.size();
+  
+  TOctreeNode<T> *node = m_octree->getRoot();
+  traverseToLevel(&node, xLocCode, yLocCode, zLocCode, k);
+  if(node == NULL || node->getDepth() != k)
+    return false;
+  begin = node->points_begin() - m_octree->points_begin();
+  end = node->points_end() - m_octree->points_begin();
+  return true;
 }
 
-
 template<class T>
 void TOctreeIterator<T>::traverseToLevel(TOctreeNode<T>** node, unsigned int xLocCode, unsigned int yLocCode, unsigned int zLocCode, unsigned int k)
 const
 {
+  if(m_octree->getDepth() <= MORTON_MAX_DEPTH)
+  {
+    traverseToLevel(node, mortonEncode(xLocCode, yLocCode, zLocCode), k);
+    return;
+  }
+  
   int l=(*node)->getDepth()-1;
   
   while((*node)->getDepth()>k)
@@ -595,57 +688,21 @@ const
 }
 
 
-
 template<class T>
-void TOctreeIterator<T>::explore(TOctreeNode<T>* node, const Point& query_point, Neighbor_star_list &neighbors)
-const
+void TOctreeIterator<T>::traverseToLevel(TOctreeNode<T>** node, uint64_t key,
+                                         unsigned int k) const
 {
-  	if(node->getDepth() != 0)
-	{
-		for(unsigned int i=0;i<8;i++)
-			if(node->getChild(i) != NULL)
-				explore(node->getChild(i), query_point, neighbors);
-	
-	}
-	else if(node->getNpts() != 0)
-	{
-		typename std::list<T>::iterator iter;
-		for(iter = node->points_begin(); iter != node->points_end(); ++iter)
-		{
-			double dist = dist2( query_point, *iter);
-			if(dist < m_sqradius)
-				neighbors.push_back(&(*iter));
-		}
-	}
+  while((*node)->getDepth() > k)
+  {
+    TOctreeNode<T> *child =
+      (*node)->getChild(mortonChild(key, (*node)->getDepth() - 1));
+    if(child == NULL)
+      break;
+    *node = child;
+  }
 }
 
 
-template<class T>
-void TOctreeIterator<T>::explore(TOctreeNode<T>* node, const Point& query_point, Neighbor_star_list &neighbors, Distance_list &distances)
-const
-{
-  	if(node->getDepth() != 0)
-	{
-		for(unsigned int i=0;i<8;i++)
-			if(node->getChild(i) != NULL)
-				explore(node->getChild(i), query_point, neighbors, distances);
-	
-	}
-	else if(node->getNpts() != 0)
-	{
-		typename std::list<T>::iterator iter;
-		for(iter = node->points_begin(); iter != node->points_end(); ++iter)
-		{
-			double dist = dist2( query_point, *iter);
-			if(dist < m_sqradius)
-			{
-				neighbors.push_back(&(*iter));
-				distances.push_back(dist);
-			}
-		}
-	}
-}
-
 template<class T>
 unsigned int TOctreeIterator<T>::getSortedNeighbors(const Point &query, Neighbor_star_map &neighbors) const
 {
@@ -657,129 +714,168 @@ unsigned int TOctreeIterator<T>::getSortedNeighbors(const Point &query, Neighbor
 
 template<class T>
 unsigned int TOctreeIterator<T>::getSortedNeighbors(const Point& query, TOctreeNode<T>* query_node, Neighbor_star_map &neighbors) const
-{	
-  Point octree_origin = m_octree->getOrigin();
-  Point node_origin = query_node->getOrigin();
-  double node_size = query_node->getSize();
-  double octree_size = m_octree->getSize();
-  
-  if(query_node->getDepth() ==  m_activeDepth)
+{
+  MapCollector collector(neighbors);
+  visitNeighbors(query, query_node, collector);
+  return (int)neighbors.size();
+}
+
+template<class T>
+unsigned int TOctreeIterator<T>::getSortedNeighbors(const Point &query,
+                                                    Neighbor_distance_vector &neighbors,
+                                                    unsigned int max_neighbors) const
+{
+  TOctreeNode<T> *node = locatePointNode(query);
+  return getSortedNeighbors(query, node, neighbors, max_neighbors);
+}
+
+template<class T>
+unsigned int TOctreeIterator<T>::getSortedNeighbors(const Point &query,
+                                                    TOctreeNode<T> *node,
+                                                    Neighbor_distance_vector &neighbors,
+                                                    unsigned int max_neighbors) const
+{
+  neighbors.clear();
+  DistanceVectorCollector collector(neighbors);
+  visitNeighbors(query, node, collector);
+  if(max_neighbors > 0 && neighbors.size() > max_neighbors)
   {
-    //find neighboring nodes
-    list<unsigned int> xloc, yloc, zloc;
-    xloc.push_back(query_node->getXLoc());
-    yloc.push_back(query_node->getYLoc());
-    zloc.push_back(query_node->getZLoc());
-    
-    if((query.x() - m_radius  < node_origin.x())&&(query.x() - m_radius > octree_origin.x()))
-      xloc.push_back(getXLeftCode(query_node));
-    if((query.x() + m_radius > node_origin.x() + node_size) && (query.x() + m_radius <octree_origin.x() + octree_size))
-      xloc.push_back(getXRightCode(query_node));
-    
-    if((query.y() - m_radius < node_origin.y())&&(query.y() - m_radius >octree_origin.y()))
-      yloc.push_back(getYLeftCode(query_node));
-    if((query.y() + m_radius > node_origin.y() + node_size) && (query.y() + m_radius < octree_origin.y() + octree_size))
-      yloc.push_back(getYRightCode(query_node));
-   
-    if((query.z() - m_radius  < node_origin.z())&&(query.z() - m_radius >octree_origin.z()))
-      zloc.push_back(getZLeftCode(query_node));
-    if((query.z() + m_radius > node_origin.z() +node_size) && (query.z() + m_radius <octree_origin.z() + octree_size))
-      zloc.push_back(getZRightCode(query_node));
-    
-    //look inside neighboring node
-      list<unsigned int>::iterator xi,yi,zi;
-      xi = xloc.begin();
-      while(xi != xloc.end())
-      {
-	yi = yloc.begin();
-	while(yi != yloc.end())
-	{
-	  zi = zloc.begin();
-	  while(zi != zloc.end())
-	  {
-	    TOctreeNode<T> *node=m_octree->getRoot();
-	    traverseToLevel(&node, *xi, *yi, *zi, m_activeDepth);
-	    if((node!=NULL)&&(node->getDepth() == m_activeDepth))
-	      exploreSort(node, query, neighbors);
-	    ++zi;
-	  }
-	  ++yi;
-	}
-	++xi;
-      }
+    std::partial_sort(neighbors.begin(), neighbors.begin() + max_neighbors,
+                      neighbors.end());
+    neighbors.resize(max_neighbors);
   }
   else
+    std::sort(neighbors.begin(), neighbors.end());
+  return neighbors.size();
+}
+
+template<class T>
+template<class Q>
+void TOctreeIterator<T>::getSortedNeighbors(const std::vector<Q> &queries,
+                                            std::vector<Neighbor_distance_vector> &neighbors,
+                                            unsigned int max_neighbors) const
+{
+  neighbors.resize(queries.size());
+  const int nqueries = (int)queries.size();
+#ifdef OMP
+  #pragma omp parallel for schedule(dynamic, 64)
+#endif
+  for(int i = 0; i < nqueries; ++i)
+    getSortedNeighbors(queries[i], neighbors[i], max_neighbors);
+}
+
+template<class T>
+unsigned int TOctreeIterator<T>::getKNearestNeighbors(const Point &query, unsigned int k,
+                                                      Neighbor_distance_vector &neighbors,
+                                                      double radius) const
+{
+  neighbors.clear();
+  TOctreeNode<T> *root = m_octree->getRoot();
+  if(k == 0 || root == NULL || root->getNpts() == 0)
+    return 0;
+  neighbors.reserve(k);
+  
+  T *points = m_octree->points_begin();
+  const Scalar *xs = m_octree->getX();
+  const Scalar *ys = m_octree->getY();
+  const Scalar *zs = m_octree->getZ();
+  
+  //the neighbors form a max-heap: once k are found, the farthest one on
+  //top bounds the search
+  double bound = radius > 0 ? radius * radius
+                            : std::numeric_limits<double>::max();
+  
+  //the nodes to explore form a min-heap on their distances to the query
+  std::greater<Node_distance> farther;
+  std::vector<Node_distance> nodes;
+  nodes.push_back(Node_distance(getSquareDistance(query, root), root));
+  while(!nodes.empty())
   {
-    unsigned int s=query_node->getDepth();
-    list<unsigned int> xloc, yloc, zloc;
-    xloc.push_back(query_node->getXLoc());
-    yloc.push_back(query_node->getYLoc());
-    zloc.push_back(query_node->getZLoc());
-    if((query.x() - m_radius  < node_origin.x())&&(query.x() - m_radius > octree_origin.x()))
-      xloc.push_back(getXLeftCode(query_node));
-    if((query.x() + m_radius > node_origin.x() + node_size) && (query.x() + m_radius < octree_origin.x() + octree_size))
-      xloc.push_back(getXRightCode(query_node));
-    
-    if((query.y() - m_radius  < node_origin.y())&&(query.y() - m_radius >octree_origin.y() ))
-      yloc.push_back(getYLeftCode(query_node));
-    if((query.y() + m_radius > node_origin.y() + node_size) && (query.y() + m_radius < octree_origin.y() + octree_size))
-      yloc.push_back(getYRightCode(query_node));
-    
-    if((query.z() - m_radius  < node_origin.z() )&&(query.z() - m_radius >octree_origin.z()))
-      zloc.push_back(getZLeftCode(query_node));
-    if((query.z() + m_radius > node_origin.z() +node_size) && (query.z() + m_radius <octree_origin.z() + octree_size))
-      zloc.push_back(getZRightCode(query_node));
+    std::pop_heap(nodes.begin(), nodes.end(), farther);
+    Node_distance closest = nodes.back();
+    nodes.pop_back();
+    if(closest.first >= bound)
+      break;
     
+    TOctreeNode<T> *node = closest.second;
+    if(node->getDepth() > 0 && node->getNpts() > KNN_LEAF_SIZE)
+    {
+      for(unsigned int c = 0; c < 8; ++c)
+      {
+        TOctreeNode<T> *child = node->getChild(c);
+        if(child == NULL)
+          continue;
+        double d = getSquareDistance(query, child);
+        if(d < bound)
+        {
+          nodes.push_back(Node_distance(d, child));
+          std::push_heap(nodes.begin(), nodes.end(), farther);
+        }
+      }
+      continue;
+    }
     
-    //look inside neighboring nodes
-      list<unsigned int>::iterator xi,yi,zi;
-      xi = xloc.begin();
-      while(xi != xloc.end())
+    PDSS_COUNT(NODES_VISITED, 1);
+    PDSS_COUNT(DISTANCE_TESTS, node->getNpts());
+    size_t begin = node->points_begin() - points;
+    size_t end = begin + node->getNpts();
+    for(size_t i = begin; i < end; ++i)
+    {
+      double dx = query.x() - xs[i];
+      double dy = query.y() - ys[i];
+      double dz = query.z() - zs[i];
+      double d = dx * dx + dy * dy + dz * dz;
+      if(d >= bound)
+        continue;
+      if(neighbors.size() == k)
       {
-	yi = yloc.begin();
-	while(yi != yloc.end())
-	{
-	  zi = zloc.begin();
-	  while(zi != zloc.end())
-	  {
-	    TOctreeNode<T> *node=m_octree->getRoot();
-	    traverseToLevel(&node,*xi,*yi,*zi,s);
-	    if( (node != NULL )&&( node->getDepth() == s))
-	      exploreSort(node, query, neighbors);
-	    ++zi;
-	  }
-	  ++yi;
-	}
-	++xi;
+        std::pop_heap(neighbors.begin(), neighbors.end());
+        neighbors.pop_back();
       }
+      neighbors.push_back(Neighbor_distance(d, points + i));
+      std::push_heap(neighbors.begin(), neighbors.end());
+      if(neighbors.size() == k)
+        bound = neighbors.front().first;
+    }
   }
-  return (int)neighbors.size();
+  
+  std::sort_heap(neighbors.begin(), neighbors.end());
+  return neighbors.size();
 }
 
 template<class T>
-void TOctreeIterator<T>::exploreSort(TOctreeNode<T>* node, const Point& query_point, Neighbor_star_map &neighbors)
-const
+template<class Q>
+void TOctreeIterator<T>::getKNearestNeighbors(const std::vector<Q> &queries, unsigned int k,
+                                              std::vector<Neighbor_distance_vector> &neighbors,
+                                              double radius) const
 {
-  	if(node->getDepth() != 0)
-	{
-		for(unsigned int i=0;i<8;i++)
-			if(node->getChild(i) != NULL)
-				exploreSort(node->getChild(i), query_point, neighbors);
-	
-	}
-	else if(node->getNpts() != 0)
-	{
-		typename std::list<T>::iterator iter;
-		for(iter = node->points_begin(); iter != node->points_end(); ++iter)
-		{
-			double dist = dist2( query_point, *iter);
-			if(dist < m_sqradius)
-				neighbors.insert( pair<double, T*>(dist, &(*iter)) );
-		}
-	}
+  neighbors.resize(queries.size());
+  const int nqueries = (int)queries.size();
+#ifdef OMP
+  #pragma omp parallel for schedule(dynamic, 64)
+#endif
+  for(int i = 0; i < nqueries; ++i)
+    getKNearestNeighbors(queries[i], k, neighbors[i], radius);
 }
 
-
+template<class T>
+double TOctreeIterator<T>::getSquareDistance(const Point &query,
+                                             const TOctreeNode<T> *node)
+{
+  Point origin = node->getOrigin();
+  double size = node->getSize();
+  double q[3] = {query.x(), query.y(), query.z()};
+  double o[3] = {origin.x(), origin.y(), origin.z()};
+  double d = 0;
+  for(int i = 0; i < 3; ++i)
+  {
+    if(q[i] < o[i])
+      d += (o[i] - q[i]) * (o[i] - q[i]);
+    else if(q[i] > o[i] + size)
+      d += (q[i] - o[i] - size) * (q[i] - o[i] - size);
+  }
+  return d;
+}
 
 template<class T>
 unsigned int TOctreeIterator<T>::getXLeftCode(TOctreeNode<T>* node)
@@ -824,22 +920,20 @@ const
     return node->getZLoc()+(unsigned int)pow2(node->getDepth());
 }
 
-template<class T>
-void TOctreeIterator<T>::computeCode(const Point& point, unsigned int& codx, unsigned int& cody, unsigned int& codz) const
-{
-    double multiplier = 1.0 / (m_octree->getSize()) * m_octree->getBinSize();
-    const Point &octree_origin = m_octree->getOrigin();
-    codx=(unsigned int)((point.x() - octree_origin.x()) * multiplier);
-    cody=(unsigned int)((point.y() - octree_origin.y()) * multiplier);
-    codz=(unsigned int)((point.z() - octree_origin.z()) * multiplier);
-}
-
 template<class T>
 TOctreeNode<T>* TOctreeIterator<T>::locatePointNode(const Point& point) const
 {
   unsigned int codx,cody,codz;
-  computeCode(point, codx, cody, codz);
+  m_octree->computeCode(point, codx, cody, codz);
   
+  if(m_octree->hasCellIndex(m_activeDepth))
+  {
+    const IndexedCell *cell = m_octree->findCell(codx, cody, codz, m_activeDepth);
+    if(cell != NULL)
+      return m_octree->getNode(*cell);
+  }
+  
+  //deepest node on the path (the point is in an empty cell)
   TOctreeNode<T> *node = m_octree->getRoot();
   traverseToLevel(&node, codx, cody, codz, m_activeDepth);
   
@@ -971,27 +1065,15 @@ const
 	if(!check)
 	  return;
 
-	if( node->getDepth() != 0)
-	{
-		unsigned int i = 0;
-		while( (i<8) && (check))
-		{
-			if(node->getChild(i) != NULL)
-				explore(node->getChild(i), query_point, exceptions, check);
-			i++;
-		}
-	}
-	else if(node->getNpts() != 0)
+	//the points of the node and of its children are contiguous
+	typename TOctreeNode<T>::Point_iterator iter;
+	for(iter = node->points_begin(); iter != node->points_end(); ++iter)
 	{
-		typename std::list<T>::iterator iter;
-		for(iter = node->points_begin(); iter != node->points_end(); ++iter)
+		double sqdist = dist2( query_point, *iter);
+		if((sqdist < m_sqradius) && (exceptions.find(iter) == exceptions.end()))
 		{
-			double sqdist = dist2( query_point, *iter);
-			if((sqdist < m_sqradius) && (exceptions.find(&(*iter)) == exceptions.end()))
-			{
-			  check = false;
-			  return;
-			}
+		  check = false;
+		  return;
 		}
 	}
 }
@@ -35,7 +35,6 @@
 #define OCTREENODE_H
 
 #include <cstdlib>
-#include <list>
 
 #include "Point.h"
 #include <iostream>
@@ -49,6 +48,10 @@
 template<class T>
 class TOctreeNode
 {
+	public : //some typedefs
+	typedef T* Point_iterator;
+	typedef const T* Point_const_iterator;
+	
 	protected :
 	  
 	/**
@@ -57,9 +60,17 @@ class TOctreeNode
 	TOctreeNode<T> *m_parent;
 	
 	/**
-	pointer to the eight children of the node
+	first child of the node: the nodes are allocated by the octree in a
+	flat array, where the children of a node are contiguous and sorted by
+	child number
 	*/
-	TOctreeNode<T> *m_child[8];
+	TOctreeNode<T> *m_first_child;
+	
+	/**position of the i^th child after m_first_child (NO_CHILD if the
+	 * child does not exist)*/
+	unsigned char m_child_offset[8];
+	
+	enum { NO_CHILD = 0xff };
 	
 	/**
 	* child number of the node (depends on the relative location of the node to the middle of its parent)
@@ -108,10 +119,11 @@ class TOctreeNode
 	/**size of the node side*/
 	double m_size;
 	
-	/**list of points contained in the node
-	 (empty if the node is not a leaf)
+	/**first point contained in the node or in the node's children
+	 * the points of the octree are stored contiguously along the Morton
+	 * curve, so the points of a node are the range [m_points, m_points+m_npts)
 	 */
-	list<T> m_points;
+	T *m_points;
 	
 	  
 	public :
@@ -129,7 +141,7 @@ class TOctreeNode
 	TOctreeNode(Point & origin, double size,  unsigned int depth);
 	
 	/**
-	Destructor
+	Destructor (the children are owned by the octree)
 	*/
 	~TOctreeNode();
 	
@@ -263,50 +275,63 @@ class TOctreeNode
 	*/
 	void setZLoc(unsigned int Zloc);
 	
-	/**get a pointer to the list of points
-	 * @return pointer to the beginning of the list
+	/**get a pointer to the points of the node
+	 * @return pointer to the first point of the node
 	 */
-	typename std::list<T>::iterator points_begin();
+	Point_iterator points_begin();
 	
-	/**get a pointer to the end of the list of points
-	 * @return pointer to the end of 'points'
+	/**get a pointer to the end of the points of the node
+	 * @return pointer past the last point of the node
 	 */
-	typename std::list<T>::iterator points_end();
+	Point_iterator points_end();
 		
-	/**get a const pointer to the list of points
-	 * @return const pointer to the beginning of the list
+	/**get a const pointer to the points of the node
+	 * @return const pointer to the first point of the node
 	 */
-	typename std::list<T>::const_iterator points_begin() const;
+	Point_const_iterator points_begin() const;
 	
-	/**get a const pointer to the end of the list of points
-	 * @return const pointer to the end of 'points'
+	/**get a const pointer to the end of the points of the node
+	 * @return const pointer past the last point of the node
 	 */
-	typename std::list<T>::const_iterator points_end() const;
+	Point_const_iterator points_end() const;
 	
-	/**add a point to the list of points included in the cell
-	 * PREREQUISITE: the node is a leaf in the octree
+	/**set the range of points included in the node or in its children
+	 * @param first first point of the node
+	 * @param npts number of points
+	 */
+	void setPoints(T *first, unsigned int npts);
+	
+	/**extend the range of points included in the cell with a point
+	 * PREREQUISITE: pt directly follows the points already in the node
 	 * @param pt point to add
 	 */
-	void addPoint(T &pt);
+	void addPoint(T *pt);
 	
-	/**build the i^th child of the node
+	/**build the i^th child of the node in a node allocated by the octree
+	 * PREREQUISITE: the children of the node are consecutive nodes, the
+	 * first one being built first
 	 * @param index child index
 	 * @param origin origin of the node
+	 * @param child node to initialize
 	 * @return pointer to the created node 
 	 */
-	TOctreeNode<T>* initializeChild(unsigned int index, Point origin);
+	TOctreeNode<T>* initializeChild(unsigned int index, Point origin,
+	                                TOctreeNode<T> *child);
 };
 
 
 template<class T>
 TOctreeNode<T>::TOctreeNode()
 {
+	m_first_child = NULL;
 	for(int i = 0 ; i <8 ; i++)
-	  m_child[i] = NULL;
+	  m_child_offset[i] = NO_CHILD;
+	m_nchild = 0;
 	m_parent = NULL;
 	m_xloc = m_yloc = m_zloc =0;
 	m_depth = 0;
 	m_npts = 0;
+	m_points = NULL;
 	m_origin = Point();
 	m_size = 0.0;
 }
@@ -314,12 +339,15 @@ TOctreeNode<T>::TOctreeNode()
 template<class T>
 TOctreeNode<T>::TOctreeNode(Point& origin, double size, unsigned int depth)
 {
+	m_first_child = NULL;
 	for(int i = 0 ; i <8 ; i++)
-	  m_child[i] = NULL;
+	  m_child_offset[i] = NO_CHILD;
+	m_nchild = 0;
 	m_parent = NULL;
 	m_xloc = m_yloc = m_zloc =0;
 	m_depth = depth;
 	m_npts = 0;
+	m_points = NULL;
 	m_origin = origin;
 	m_size = size;
 }
@@ -327,12 +355,11 @@ TOctreeNode<T>::TOctreeNode(Point& origin, double size, unsigned int depth)
 template<class T>
 TOctreeNode<T>::~TOctreeNode()
 {
-        m_points.clear();
+	m_points = NULL;
 	m_xloc = m_yloc = m_zloc =0;
 	m_depth = 0;
 	m_npts = 0;
-	for(int i = 0; i<8 ; i++)
-	  delete m_child[i];
+	m_first_child = NULL;
 	m_parent = NULL;
 	m_origin = Point();
 	m_size = 0.0;
@@ -400,7 +427,9 @@ template<class T>
 TOctreeNode<T>* TOctreeNode<T>::getChild(unsigned int index) 
 {
     unsigned int i = index % 8;
-    return m_child[i];
+    if(m_child_offset[i] == NO_CHILD)
+      return NULL;
+    return m_first_child + m_child_offset[i];
 }
 
 
@@ -490,45 +519,61 @@ Point TOctreeNode<T>::getOrigin() const
 }
 
 template<class T>
-typename std::list<T>::iterator TOctreeNode<T>::points_begin()
+typename TOctreeNode<T>::Point_iterator TOctreeNode<T>::points_begin()
 {
-  return m_points.begin();
+  return m_points;
 }
 
 template<class T>
-typename std::list<T>::iterator TOctreeNode<T>::points_end()
+typename TOctreeNode<T>::Point_iterator TOctreeNode<T>::points_end()
 {
-  return m_points.end();
+  return m_points + m_npts;
 }
 
 template<class T>
-typename std::list<T>::const_iterator TOctreeNode<T>::points_begin() const
+typename TOctreeNode<T>::Point_const_iterator TOctreeNode<T>::points_begin() const
 {
-  return m_points.begin();
+  return m_points;
 }
 
 template<class T>
-typename std::list<T>::const_iterator TOctreeNode<T>::points_end() const
+typename TOctreeNode<T>::Point_const_iterator TOctreeNode<T>::points_end() const
 {
-  return m_points.end();
+  return m_points + m_npts;
 }
+
 template<class T>
-void TOctreeNode<T>::addPoint(T &t)
+void TOctreeNode<T>::setPoints(T *first, unsigned int npts)
 {
-    m_points.push_back(t);
+    m_points = first;
+    m_npts = npts;
+}
+
+template<class T>
+void TOctreeNode<T>::addPoint(T *pt)
+{
+    if(m_npts == 0)
+      m_points = pt;
+    assert(pt == m_points + m_npts);
     m_npts++;
 }
 
 template<class T>
-TOctreeNode< T >* TOctreeNode<T>::initializeChild(unsigned int index, Point origin)
+TOctreeNode< T >* TOctreeNode<T>::initializeChild(unsigned int index, Point origin,
+                                                 TOctreeNode<T> *child)
 {
     double size = m_size/2.0;
     unsigned int depth= m_depth -1;
-    m_child[index] = new TOctreeNode<T>(origin, size, depth);
-    m_child[index]->setParent(this);
-    m_child[index]->setNchild(index);
+    *child = TOctreeNode<T>(origin, size, depth);
+    child->setParent(this);
+    child->setNchild(index);
+    
+    if(m_first_child == NULL)
+      m_first_child = child;
+    assert(child >= m_first_child && child < m_first_child + 8);
+    m_child_offset[index] = (unsigned char)(child - m_first_child);
 
-  return m_child[index];
+  return child;
 }
 
 
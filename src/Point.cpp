@@ -40,9 +40,23 @@ Point::Point()
 
 Point::Point(double x, double y, double z)
 {
-  m_x = x;
-  m_y = y;
-  m_z = z;
+  m_x = (Scalar)x;
+  m_y = (Scalar)y;
+  m_z = (Scalar)z;
+}
+
+void Point::chooseStorageOrigin(double x, double y, double z, double origin[3])
+{
+#ifdef PDSS_FLOAT32
+  origin[0] = x;
+  origin[1] = y;
+  origin[2] = z;
+#else
+  (void)x;
+  (void)y;
+  (void)z;
+  origin[0] = origin[1] = origin[2] = 0;
+#endif
 }
 
 Point::~Point()
@@ -64,5 +78,3 @@ double Point::z() const
 {
   return m_z;
 }
-
-
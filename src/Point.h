@@ -34,6 +34,18 @@
 #ifndef POINT_H
 #define POINT_H
 
+/**
+ * type of the stored coordinates and normals: configuring with
+ * -DPDSS_FLOAT32=ON stores them in single precision, which halves the size
+ * of a Sample and of the coordinate arrays of the octree (TOctree::getX).
+ * The computations are still carried out in double precision.
+ */
+#ifdef PDSS_FLOAT32
+typedef float Scalar;
+#else
+typedef double Scalar;
+#endif
+
 /**
 *  Generic unoriented point
 */
@@ -45,6 +57,22 @@ class Point
 
     Point(double x, double y, double z);
 
+    /**choose the origin the coordinates of a cloud are stored relative to.
+     * In single precision the absolute coordinates of a scan (e.g.
+     * georeferenced in meters) would lose their millimeters, the offsets to
+     * a point of the cloud keep them: with PDSS_FLOAT32 the origin is the
+     * given point, without it the origin is 0 and the coordinates are stored
+     * as is. Each cloud keeps its own origin (e.g.
+     * TOctree::getStorageOrigin), and the points are built from the
+     * coordinates minus the origin.
+     * @param x x of a point of the cloud (e.g. its first point)
+     * @param y
+     * @param z
+     * @param[out] origin x y z of the origin
+     */
+    static void chooseStorageOrigin(double x, double y, double z,
+                                    double origin[3]);
+
     ~Point();
 
     /**access x coordinate
@@ -64,8 +92,8 @@ class Point
 
     private :
 
-    /**3D coordinates*/
-    double m_x,m_y,m_z;
+    /**3D coordinates (relative to the storage origin of the cloud)*/
+    Scalar m_x,m_y,m_z;
 };
 
 #endif
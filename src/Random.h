@@ -0,0 +1,110 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file Random.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+ * @file Random.h
+ * declares a splittable pseudo-random generator (splitmix64)
+ * the stream of a generator only depends on a user seed and on a key
+ * (typically the locational code of an octree cell), so that each cell owns
+ * an independent sequence and generators never share any state.
+ */
+
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <stdint.h>
+
+/**@class RandomGenerator
+ * splitmix64 generator keyed by a seed and a 3D locational code
+ */
+class RandomGenerator
+{
+  public :
+  /**constructor
+   * @param seed user seed
+   * @param xloc x locational code of the key
+   * @param yloc y locational code of the key
+   * @param zloc z locational code of the key
+   */
+  RandomGenerator(uint64_t seed, unsigned int xloc = 0,
+                  unsigned int yloc = 0, unsigned int zloc = 0);
+
+  /**get the next 64 bits random value
+   * @return random value
+   */
+  uint64_t next();
+
+  /**get a random value uniformly distributed in [0,n)
+   * @param n upper bound (excluded)
+   * @return random value
+   */
+  unsigned int uniform(unsigned int n);
+  
+  /**get a random value uniformly distributed in [0,1)
+   * @return random value (53 random bits)
+   */
+  double uniformReal();
+
+  private :
+
+  /**finalizer of splitmix64, bijective mixing of 64 bits
+   * @param z value to mix
+   * @return mixed value
+   */
+  static uint64_t mix(uint64_t z);
+
+  /**counter of the stream*/
+  uint64_t m_state;
+};
+
+inline uint64_t RandomGenerator::mix(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+inline RandomGenerator::RandomGenerator(uint64_t seed, unsigned int xloc,
+                                        unsigned int yloc, unsigned int zloc)
+{
+  m_state = mix(seed + 0x9E3779B97F4A7C15ULL);
+  m_state = mix(m_state ^ xloc);
+  m_state = mix(m_state ^ yloc);
+  m_state = mix(m_state ^ zloc);
+}
+
+inline uint64_t RandomGenerator::next()
+{
+  m_state += 0x9E3779B97F4A7C15ULL;
+  return mix(m_state);
+}
+
+inline unsigned int RandomGenerator::uniform(unsigned int n)
+{
+  return (unsigned int)(((next() >> 32) * (uint64_t)n) >> 32);
+}
+
+inline double RandomGenerator::uniformReal()
+{
+  return (double)(next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+#endif
@@ -0,0 +1,177 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file ResultCache.cpp
+* @author Julie Digne
+* cache of the outputs, see ResultCache.h
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ResultCache.h"
+
+#include "FileIO.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+
+/**mix a word into a lane of the hash
+ * @param h lane
+ * @param word 8 bytes of the input
+ * @return new lane
+ */
+static inline uint64_t hashRound(uint64_t h, uint64_t word)
+{
+    h += word * PRIME2;
+    h = (h << 31) | (h >> 33);
+    return h * PRIME1;
+}
+
+/**bijective mixing of 64 bits (finalizer of splitmix64)
+ * @param z value to mix
+ * @return mixed value
+ */
+static inline uint64_t hashMix(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+ResultCache::ResultCache()
+{
+    m_key = 0;
+}
+
+bool ResultCache::open(const char *dir)
+{
+    struct stat st;
+    mkdir(dir, 0777);
+    if(stat(dir, &st) != 0 || !S_ISDIR(st.st_mode))
+      return false;
+    m_dir = dir;
+    return true;
+}
+
+bool ResultCache::isOpen() const
+{
+    return !m_dir.empty();
+}
+
+uint64_t ResultCache::hash(const char *data, size_t length, uint64_t seed)
+{
+    //four independent lanes of 8 bytes, so that the multiplications of
+    //consecutive words overlap
+    uint64_t lanes[4] = {seed + PRIME1, seed + PRIME2, seed, seed - PRIME1};
+    size_t i = 0;
+    for(; i + 32 <= length; i += 32)
+    {
+      for(int k = 0; k < 4; ++k)
+      {
+        uint64_t word;
+        memcpy(&word, data + i + 8 * k, 8);
+        lanes[k] = hashRound(lanes[k], word);
+      }
+    }
+
+    uint64_t h = (uint64_t)length;
+    for(int k = 0; k < 4; ++k)
+      h = hashMix(h ^ lanes[k]);
+    for(; i < length; ++i)
+      h = hashRound(h, (unsigned char)data[i]);
+    return hashMix(h);
+}
+
+bool ResultCache::computeKey(const char *input_file, const std::string &parameters)
+{
+    size_t length;
+    const char *data = FileIO::mapFile(input_file, length);
+    if(data == NULL)
+      return false;
+    uint64_t h = hash(data, length);
+    FileIO::unmapFile(data, length);
+
+    m_key = hash(parameters.data(), parameters.size(), h);
+    return true;
+}
+
+std::string ResultCache::getKey() const
+{
+    char key[17];
+    snprintf(key, sizeof(key), "%016llx", (unsigned long long)m_key);
+    return key;
+}
+
+std::string ResultCache::getPath(unsigned int level) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), ".%u", level);
+    return m_dir + "/" + getKey() + name;
+}
+
+bool ResultCache::contains(unsigned int level) const
+{
+    return access(getPath(level).c_str(), R_OK) == 0;
+}
+
+bool ResultCache::fetch(const char *output_file, unsigned int level) const
+{
+    return contains(level) && copyFile(getPath(level).c_str(), output_file);
+}
+
+bool ResultCache::store(const char *output_file, unsigned int level) const
+{
+    std::string path = getPath(level);
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), ".tmp%ld", (long)getpid());
+    std::string tmp = path + suffix;
+    if(!copyFile(output_file, tmp.c_str()) || rename(tmp.c_str(), path.c_str()) != 0)
+    {
+      unlink(tmp.c_str());
+      return false;
+    }
+    return true;
+}
+
+bool ResultCache::copyFile(const char *from, const char *to)
+{
+    FILE *in = fopen(from, "rb");
+    if(in == NULL)
+      return false;
+    FILE *out = fopen(to, "wb");
+    if(out == NULL)
+    {
+      fclose(in);
+      return false;
+    }
+
+    char buffer[1 << 16];
+    size_t n;
+    bool ok = true;
+    while(ok && (n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+      ok = (fwrite(buffer, 1, n, out) == n);
+    ok = ok && !ferror(in);
+    fclose(in);
+    return (fclose(out) == 0) && ok;
+}
@@ -0,0 +1,125 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file ResultCache.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+ * @file ResultCache.h
+ * declares a cache of the outputs of pdss in a directory (content
+ * addressed). The key of a run hashes the bytes of the input file and the
+ * parameters the output depends on (radii, seed, method, formats, build
+ * options and PDSS_CACHE_VERSION). A run found in the cache copies the
+ * outputs it stored, without reading the points, building the octree or
+ * selecting the samples.
+ */
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <cstddef>
+#include <string>
+#include <stdint.h>
+
+/**version of the outputs, to be increased whenever the selection or the
+ * file formats change the output of a given input and parameters*/
+#define PDSS_CACHE_VERSION 1
+
+/**@class ResultCache
+ * cache of the output files of pdss keyed by their input and parameters
+ */
+class ResultCache
+{
+  public :
+
+  /**constructor (no cache directory)*/
+  ResultCache();
+
+  /**use a cache directory
+   * @param dir cache directory (created if it does not exist)
+   * @return false if the directory could not be created
+   */
+  bool open(const char *dir);
+
+  /**check if a cache directory is used
+   * @return true once open succeeded
+   */
+  bool isOpen() const;
+
+  /**compute the key of a run
+   * @param input_file name of the input file, hashed as a whole
+   * @param parameters description of everything else the output depends on
+   * @return false if the input file could not be read
+   */
+  bool computeKey(const char *input_file, const std::string &parameters);
+
+  /**get the key of the run
+   * @return key (16 hexadecimal digits)
+   */
+  std::string getKey() const;
+
+  /**copy a cached output
+   * @param output_file file to write
+   * @param level output index (level of detail)
+   * @return false if the output is not in the cache
+   */
+  bool fetch(const char *output_file, unsigned int level) const;
+
+  /**check if an output is in the cache
+   * @param level output index (level of detail)
+   * @return true if the output is in the cache
+   */
+  bool contains(unsigned int level) const;
+
+  /**add an output to the cache (written to a temporary file then renamed,
+   * so that concurrent runs never read a partial entry)
+   * @param output_file file to copy into the cache
+   * @param level output index (level of detail)
+   * @return false if something went wrong
+   */
+  bool store(const char *output_file, unsigned int level) const;
+
+  /**hash a buffer (64 bits, not cryptographic)
+   * @param data buffer
+   * @param length length of the buffer in bytes
+   * @param seed seed of the hash
+   * @return hash value
+   */
+  static uint64_t hash(const char *data, size_t length, uint64_t seed = 0);
+
+  private :
+
+  /**get the path of a cache entry
+   * @param level output index (level of detail)
+   * @return path
+   */
+  std::string getPath(unsigned int level) const;
+
+  /**copy a file
+   * @param from file to read
+   * @param to file to write
+   * @return false if something went wrong
+   */
+  static bool copyFile(const char *from, const char *to);
+
+  std::string m_dir;
+
+  uint64_t m_key;
+};
+
+#endif
@@ -27,8 +27,103 @@
 #include <cstdio>
 #include "Point.h"
 
+/**
+ * attributes stored with the position of a sample, fixed at build time by
+ * -DPDSS_SAMPLE_ATTRIBUTES=position|normal|tangent. The selection only reads
+ * the positions: an unoriented cloud subsampled by a position build does not
+ * store 3 zero normals per point, and the tangent is only kept for the
+ * callers that need it. The accessors of the attributes that are not stored
+ * return 0 and their setters do nothing.
+ */
+#define PDSS_ATTRIBUTES_POSITION 0
+#define PDSS_ATTRIBUTES_NORMAL 1
+#define PDSS_ATTRIBUTES_TANGENT 2
+
+#ifndef PDSS_SAMPLE_ATTRIBUTES
+#define PDSS_SAMPLE_ATTRIBUTES PDSS_ATTRIBUTES_NORMAL
+#endif
+
+/**attributes of a sample besides its position (position only: none)*/
+template<int Attributes>
+class SampleAttributes
+{
+  public :
+  
+  double nx() const { return 0.0; }
+  double ny() const { return 0.0; }
+  double nz() const { return 0.0; }
+  
+  double t1x() const { return 0.0; }
+  double t1y() const { return 0.0; }
+  double t1z() const { return 0.0; }
+  
+  void set_nx(double) {}
+  void set_ny(double) {}
+  void set_nz(double) {}
+  
+  void set_t1x(double) {}
+  void set_t1y(double) {}
+  void set_t1z(double) {}
+  
+  protected :
+  
+  void setNormal(double, double, double) {}
+};
 
-class Sample : public Point
+/**normal of an oriented sample*/
+template<>
+class SampleAttributes<PDSS_ATTRIBUTES_NORMAL>
+  : public SampleAttributes<PDSS_ATTRIBUTES_POSITION>
+{
+  public :
+  
+  double nx() const { return m_nx; }
+  double ny() const { return m_ny; }
+  double nz() const { return m_nz; }
+  
+  void set_nx(double nx) { m_nx = (Scalar)nx; }
+  void set_ny(double ny) { m_ny = (Scalar)ny; }
+  void set_nz(double nz) { m_nz = (Scalar)nz; }
+  
+  protected :
+  
+  void setNormal(double nx, double ny, double nz)
+  {
+    m_nx = (Scalar)nx;
+    m_ny = (Scalar)ny;
+    m_nz = (Scalar)nz;
+  }
+  
+  private :
+  
+  Scalar m_nx, m_ny, m_nz;
+};
+
+/**normal and tangent of an oriented sample*/
+template<>
+class SampleAttributes<PDSS_ATTRIBUTES_TANGENT>
+  : public SampleAttributes<PDSS_ATTRIBUTES_NORMAL>
+{
+  public :
+  
+  SampleAttributes() { m_t1x = m_t1y = m_t1z = 0; }
+  
+  double t1x() const { return m_t1x; }
+  double t1y() const { return m_t1y; }
+  double t1z() const { return m_t1z; }
+  
+  void set_t1x(double t1x) { m_t1x = (Scalar)t1x; }
+  void set_t1y(double t1y) { m_t1y = (Scalar)t1y; }
+  void set_t1z(double t1z) { m_t1z = (Scalar)t1z; }
+  
+  private :
+  
+  Scalar m_t1x, m_t1y, m_t1z;
+};
+
+
+class Sample : public Point,
+               public SampleAttributes<PDSS_SAMPLE_ATTRIBUTES>
 {
   /**print the sample to an ostream
   @param output ostream to write the values to
@@ -37,17 +132,6 @@ class Sample : public Point
   */
   friend std::ostream& operator<<(std::ostream& output, const Sample &p);
   
-  private :
-  double m_nx, m_ny, m_nz;
-
-  double m_t1x, m_t1y, m_t1z;
-
-  bool m_selected;
-  
-  bool m_covered;
-
-  unsigned int m_ncovered;
-  
   public :
   /**constructor*/
   Sample();
@@ -57,36 +141,6 @@ class Sample : public Point
   
   /**constructor*/
   Sample(double x,double y, double z, double nx, double ny,double nz);
-  
-  public :
-
-  double nx() const;
-  double ny() const;
-  double nz() const;
-  
-  double t1x() const;
-  double t1y() const;
-  double t1z() const;
-  
-  unsigned int getNCovered() const;
-  
-  void increaseNCovered();
-  
-  void decreaseNCovered();
-  
-  void set_nx(double nx);
-  void set_ny(double ny);
-  void set_nz(double nz);
- 
-  void set_t1x(double t1x);
-  void set_t1y(double t1y);
-  void set_t1z(double t1z); 
-  
-  bool isSelected() const;
-  void setSelected(bool done);
-  
-  bool isCovered() const;
-  void setCovered(bool done);
 };
 
 
@@ -0,0 +1,163 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file SampleGrid.cpp
+* @author Julie Digne
+* background grid of the selected samples, see SampleGrid.h
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SampleGrid.h"
+
+#include "Morton.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+//Morton codes have at most 63 bits: the all-ones code marks empty slots
+static const uint64_t EMPTY_CODE = ~(uint64_t)0;
+
+/**offset of a neighbouring cell and its smallest distance to the cell, in
+ * squared cell sides*/
+struct CellOffset
+{
+    int d[3];
+    int distance;
+
+    bool operator<(const CellOffset &other) const
+    {
+      return distance < other.distance;
+    }
+};
+
+SampleGrid::SampleGrid()
+{
+    m_xs = m_ys = m_zs = NULL;
+    m_origin[0] = m_origin[1] = m_origin[2] = 0;
+    m_scale = 0;
+    m_sqradius = 0;
+    m_mask = 0;
+    m_bits = 0;
+    m_aliased = false;
+}
+
+void SampleGrid::initialize(const Scalar *xs, const Scalar *ys, const Scalar *zs,
+                            const double origin[3], double radius,
+                            double size, size_t nsamples)
+{
+    m_xs = xs;
+    m_ys = ys;
+    m_zs = zs;
+    for(int k = 0; k < 3; ++k)
+      m_origin[k] = origin[k];
+    m_scale = sqrt(3.0) / radius;
+    m_sqradius = radius * radius;
+    m_aliased = size * m_scale + 4 >= (double)(1 << MORTON_MAX_DEPTH);
+
+    //at most half full
+    m_bits = 1;
+    while(((size_t)1 << m_bits) < 2 * nsamples)
+      m_bits++;
+    Slot empty = {EMPTY_CODE, 0};
+    m_slots.assign((size_t)1 << m_bits, empty);
+    m_mask = m_slots.size() - 1;
+
+    //a cell at offset d is at least sum (|d_k|-1)^2 squared sides away,
+    //the radius being 3 squared sides: the cells at offset 2 on all axes
+    //are too far
+    std::vector<CellOffset> offsets;
+    for(int dx = -2; dx <= 2; ++dx)
+      for(int dy = -2; dy <= 2; ++dy)
+        for(int dz = -2; dz <= 2; ++dz)
+        {
+          CellOffset offset = {{dx, dy, dz}, 0};
+          for(int k = 0; k < 3; ++k)
+          {
+            int gap = abs(offset.d[k]) - 1;
+            offset.distance += gap > 0 ? gap * gap : 0;
+          }
+          if(offset.distance < 3)
+            offsets.push_back(offset);
+        }
+    std::stable_sort(offsets.begin(), offsets.end());
+    m_offsets.clear();
+    for(size_t i = 0; i < offsets.size(); ++i)
+      m_offsets.insert(m_offsets.end(), offsets[i].d, offsets[i].d + 3);
+}
+
+void SampleGrid::getCell(double x, double y, double z, int cell[3]) const
+{
+    cell[0] = (int)floor((x - m_origin[0]) * m_scale);
+    cell[1] = (int)floor((y - m_origin[1]) * m_scale);
+    cell[2] = (int)floor((z - m_origin[2]) * m_scale);
+}
+
+size_t SampleGrid::getSlot(uint64_t code) const
+{
+    //as in CellIndex: neighbouring cells in neighbouring slots
+    return (size_t)(code ^ (code >> m_bits)) & m_mask;
+}
+
+bool SampleGrid::isCovered(uint64_t code, double x, double y, double z) const
+{
+    for(size_t slot = getSlot(code); m_slots[slot].code != EMPTY_CODE;
+        slot = (slot + 1) & m_mask)
+    {
+      if(m_slots[slot].code != code)
+        continue;
+      uint32_t id = m_slots[slot].id;
+      double dx = m_xs[id] - x, dy = m_ys[id] - y, dz = m_zs[id] - z;
+      if(dx * dx + dy * dy + dz * dz < m_sqradius)
+        return true;
+      //a cell holds a single sample, unless the codes alias
+      if(!m_aliased)
+        return false;
+    }
+    return false;
+}
+
+bool SampleGrid::isCovered(double x, double y, double z) const
+{
+    int cell[3];
+    getCell(x, y, z, cell);
+    for(size_t i = 0; i < m_offsets.size(); i += 3)
+    {
+      //the coordinates wrap modulo 2^21 in the code
+      uint64_t code = mortonEncode(cell[0] + m_offsets[i],
+                                   cell[1] + m_offsets[i + 1],
+                                   cell[2] + m_offsets[i + 2]);
+      if(isCovered(code, x, y, z))
+        return true;
+    }
+    return false;
+}
+
+void SampleGrid::insert(uint32_t id)
+{
+    int cell[3];
+    getCell(m_xs[id], m_ys[id], m_zs[id], cell);
+    uint64_t code = mortonEncode(cell[0], cell[1], cell[2]);
+    //the slots taken by the other threads are skipped; the id is written
+    //after the code, but only the thread of the cell reads it before the
+    //cell is done (see the PREREQUISITE of insert)
+    size_t slot = getSlot(code);
+    while(!__sync_bool_compare_and_swap(&m_slots[slot].code, EMPTY_CODE, code))
+      slot = (slot + 1) & m_mask;
+    m_slots[slot].id = id;
+}
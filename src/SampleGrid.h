@@ -0,0 +1,142 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file SampleGrid.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+ * @file SampleGrid.h
+ * declares the background grid of the selected samples (Bridson): cubic
+ * cells of side r/sqrt(3), whose diagonal is the radius, so that a cell
+ * holds at most one sample. A point is covered if one of the cells around
+ * it (at most 5x5x5, minus the corners) holds a sample closer than the
+ * radius: a few probes instead of gathering all the points of the ball.
+ * The cells are hashed by their Morton codes in a table of samples (open
+ * addressing, linear probing), neighbouring cells falling in neighbouring
+ * slots; the samples are inserted with a compare and swap, so that cells
+ * processed by different threads can share it.
+ */
+
+#ifndef SAMPLE_GRID_H
+#define SAMPLE_GRID_H
+
+#include <cstddef>
+#include <vector>
+#include <stdint.h>
+
+#include "Point.h"
+
+/**@class SampleGrid
+ * hash grid of samples one radius apart
+ */
+class SampleGrid
+{
+  public :
+
+  /**constructor (empty grid)*/
+  SampleGrid();
+
+  /**empty the grid and size it
+   * @param xs x coordinates of the points, indexed by their ids
+   * @param ys y coordinates of the points
+   * @param zs z coordinates of the points
+   * @param origin corner of the grid (x y z), below all the points
+   * @param radius selection radius
+   * @param size side of the cube of the points
+   * @param nsamples largest number of samples to insert
+   */
+  void initialize(const Scalar *xs, const Scalar *ys, const Scalar *zs,
+                  const double origin[3], double radius, double size,
+                  size_t nsamples);
+
+  /**check if a sample is closer than the radius to a position
+   * @param x x coordinate of the position
+   * @param y y coordinate of the position
+   * @param z z coordinate of the position
+   * @return true if a sample covers the position
+   */
+  bool isCovered(double x, double y, double z) const;
+
+  /**add a sample
+   * PREREQUISITE: the sample is not covered (its cell is empty) and no
+   * thread reads the cells around it at the same time
+   * @param id id of the sample
+   */
+  void insert(uint32_t id);
+
+  private :
+
+  /**sample of a cell*/
+  struct Slot
+  {
+    /**Morton code of the cell (of its coordinates modulo 2^21)*/
+    uint64_t code;
+
+    uint32_t id;
+  };
+
+  /**get the cell of a position
+   * @param x x coordinate
+   * @param y y coordinate
+   * @param z z coordinate
+   * @param[out] cell integer coordinates of the cell
+   */
+  void getCell(double x, double y, double z, int cell[3]) const;
+
+  /**first slot probed for a cell
+   * @param code Morton code of the cell
+   * @return slot index
+   */
+  size_t getSlot(uint64_t code) const;
+
+  /**check if a cell holds a sample closer than the radius to a position
+   * @param code Morton code of the cell
+   * @param x x coordinate of the position
+   * @param y y coordinate of the position
+   * @param z z coordinate of the position
+   * @return true if the sample of the cell covers the position
+   */
+  bool isCovered(uint64_t code, double x, double y, double z) const;
+
+  const Scalar *m_xs, *m_ys, *m_zs;
+
+  double m_origin[3];
+
+  /**inverse of the side of the cells*/
+  double m_scale;
+
+  double m_sqradius;
+
+  std::vector<Slot> m_slots;
+
+  /**number of slots minus one (a power of two minus one)*/
+  size_t m_mask;
+
+  /**number of bits of the slot indices*/
+  unsigned int m_bits;
+
+  /**true if the grid has more than 2^21 cells along an axis: distinct
+   * cells may then share a code*/
+  bool m_aliased;
+
+  /**cells around a cell that may hold samples closer than the radius,
+   * the closest first (3 offsets per cell)*/
+  std::vector<int> m_offsets;
+};
+
+#endif
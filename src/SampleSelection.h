@@ -25,7 +25,15 @@
 #include "Octree.h"
 #include "OctreeNode.h"
 #include "OctreeIterator.h"
+#include "Random.h"
+#include "CellIndex.h"
+#include "CellScheduler.h"
+#include "SampleGrid.h"
+#include "Metrics.h"
+#include "Timer.h"
 #include <cmath>
+#include <vector>
+#include <algorithm>
 
 template<class T>
 class TSampleSelection
@@ -63,15 +71,91 @@ class TSampleSelection
    */
   unsigned int getNSelected() const;
   
+  /**get the ids of the selected samples in the octree (TOctree::getId)
+   @return ids in increasing order, i.e. along the Morton curve
+   */
+  const std::vector<size_t>& getSelectedSamples() const;
+  
+  /**get the seed of the random generators
+   @return seed
+   */
+  uint64_t getSeed() const;
+  
+  /**set the seed of the random generators (dart throwing)
+   * each cell draws from its own generator keyed by this seed and its
+   * locational code, so that the selection does not depend on the number
+   * of threads
+   *@param seed
+   */
+  void setSeed(uint64_t seed);
+  
+  /**get the smallest size of the cells processed independently by the dart
+   * throwing: two cells of the same colour are separated by a whole cell,
+   * so that their samples cannot cover each other
+   * @param radius selection radius
+   * @return smallest cell size
+   */
+  static double getProcessingCellSize(double radius);
+  
+  /**print the progress of the selection or not (default true)
+   *@param verbose
+   */
+  void setVerbose(bool verbose);
+  
 public : //selection methods
   
+  /**cover the samples of the octree closer than the radius to a sample
+   * selected outside of the octree (e.g. in a neighbouring tile), so that
+   * they cannot be selected anymore
+   * @param sample selected sample (inside the bounding box of the octree)
+   * @return number of covered samples
+   */
+  unsigned int cover(const Point &sample);
+  
+  /**pre-decimate a very dense cloud before the selection: the space is
+   * split into voxels of side fraction * radius and each voxel is
+   * collapsed to the point closest to its centre, the cells of the depth of
+   * the iterator being processed in parallel. The octree is rebuilt on
+   * these points, so that the selection then costs about the same whatever
+   * the density of the input.
+   * The samples are still points of the input at least radius apart: the
+   * minimum distance is unchanged. A removed point is within
+   * sqrt(3) * fraction * radius of the point kept in its voxel, so that
+   * every input point is closer than (1 + sqrt(3) * fraction) * radius to
+   * a sample instead of radius.
+   * PREREQUISITE: called before the selection (the octree is rebuilt)
+   * @param fraction side of the voxels relative to the radius (at least
+   * 1/16, smaller fractions are raised to it)
+   * @return number of points left in the octree
+   */
+  unsigned int decimate(double fraction);
+  
   /**select points according to a covering criterium*/
   void performSelection();
   
+  /**select points according to a covering criterium, in parallel: the
+   * cells of the depth of the iterator are split into 8 colours by the
+   * parity of their locational codes, and the cells of a colour, separated
+   * by at least one cell (two radii), are scanned concurrently. The output
+   * does not depend on the number of threads: it is the one of a serial
+   * scan of the cells colour by colour.
+   */
+  void performParallelSelection();
+  
   /**select points according to a covering criterium (dartthrowing)
    */
   void performDartThrowingSelection();
   
+  /**select points by dart throwing, testing the candidates against a
+   * background grid of the selected samples (SampleGrid) instead of
+   * covering the neighbours of each sample. The candidates are drawn as
+   * by performDartThrowingSelection, but the points covered by the samples
+   * of the previous cells are only rejected when drawn: the selection is
+   * as valid and as independent of the number of threads, not identical.
+   * Each point is counted as covered once (the covers are not gathered).
+   */
+  void performGridSelection();
+  
   private :
   
   double m_radius;
@@ -82,32 +166,126 @@ public : //selection methods
   
   unsigned int m_nselected;
   
+  uint64_t m_seed;
+  
+  bool m_verbose;
+  
   TOctree<T> *m_octree;
   
   TOctreeIterator<T> *m_iterator;
   
-  Sample_star_list m_selected_samples;
+  /**ids of the selected samples, sorted once the selection is done*/
+  std::vector<size_t> m_selected_samples;
   
   
-  /**select points according to a covering criterium
-   @param cell constrain selection to a given cell
+  /**visitor covering the neighbors of a selected sample*/
+  struct CoverVisitor
+  {
+    TOctree<T> *octree;
+    
+    /**number of covered samples*/
+    unsigned long ncovers;
+    
+    CoverVisitor(TOctree<T> *o) : octree(o), ncovers(0) {}
+    
+    void operator()(T *sample, double)
+    {
+      octree->setFlags(octree->getId(sample), TOctree<T>::FLAG_COVERED);
+      ncovers++;
+    }
+  };
+  
+  /**dart throwing in one cell, run by the cell scheduler*/
+  struct DartTask
+  {
+    TSampleSelection<T> *selection;
+    
+    /**grid of the selected samples, NULL to cover the neighbours*/
+    SampleGrid *grid;
+    
+    const std::vector<TOctreeNode<T>* > &nodes;
+    
+    /**ids of the samples selected in each cell*/
+    std::vector<std::vector<size_t> > cell_selected_samples;
+    
+    /**number of covers of each cell*/
+    std::vector<unsigned long> ncovers;
+    
+    DartTask(TSampleSelection<T> *s, SampleGrid *g,
+             const std::vector<TOctreeNode<T>* > &n)
+      : selection(s), grid(g), nodes(n), cell_selected_samples(n.size()),
+        ncovers(n.size(), 0) {}
+    
+    void operator()(unsigned int i)
+    {
+#ifdef PDSS_METRICS
+      Timer timer;
+#endif
+      if(grid != NULL)
+        ncovers[i] = selection->performGridSelection(nodes[i], *grid,
+                                                     cell_selected_samples[i]);
+      else
+        ncovers[i] = selection->performDartThrowingSelection(nodes[i],
+                                                     cell_selected_samples[i]);
+      PDSS_BUSY(nodes[i]->getNChild(), timer.elapsed());
+    }
+  };
+  
+  /**set the dependencies of the dart throwing in the cells of a level:
+   * the samples of a cell cover points of the adjacent cells (26
+   * neighbours) only, as the cells are larger than twice the radius. Two
+   * adjacent cells have different colours (parity of their locational
+   * codes) and the one of smaller colour is processed first, so that the
+   * selection is the one of the colours processed one after the other,
+   * whatever the order in which the threads take the cells.
+   * @param nodes cells of the level
+   * @param depth level of the cells
+   * @param[out] scheduler scheduler of the cells, the largest first
    */
-  void performSelection(TOctreeNode<T> *cell);
-   
- 
+  void scheduleCells(const std::vector<TOctreeNode<T>* > &nodes,
+                     unsigned int depth, CellScheduler &scheduler);
   
-  /**select points according to a covering criterium
-   @param cell constrain selection to a given cell
+  /**index the cells of the depth of the iterator, where the neighbours
+   * are looked for, if they hold several points on average: otherwise the
+   * index would cost more to build than the traversals it saves
+   */
+  void indexCells();
+  
+  /**scan the points of a cell in order, selecting the uncovered ones
+   @param cell cell to scan
    @param par parent at the right scale
+   @param neighbors buffer of neighbors (reused from one call to the next)
+   @param[in,out] ncovers number of covers
+   @param[in,out] nremoved number of isolated points left out
+   @param[out] selected ids of the selected points, appended
    */
-  void performSelection(TOctreeNode<T> *cell, TOctreeNode<T> *par);
+  void scanCell(TOctreeNode<T> *cell, TOctreeNode<T> *par,
+                std::vector<T*> &neighbors, unsigned long &ncovers,
+                unsigned int &nremoved, std::vector<size_t> &selected);
 
   /**select points according to a covering criterium
    @param cell constrain selection to a given cell
-   @param par parent at the right scale
+   @param[out] cell_selected_samples ids of the samples selected in the cell
+   @return number of covers
    */
-  void performDartThrowingSelection(TOctreeNode< T >* cell,
-                               std::list<T*> &cell_selected_samples);
+  unsigned long performDartThrowingSelection(TOctreeNode< T >* cell,
+                               std::vector<size_t> &cell_selected_samples);
+  
+  /**dart throwing in the cells of the processing level, run by the cell
+   * scheduler
+   * @param grid grid of the selected samples (performGridSelection), NULL
+   * to cover the neighbours of the samples
+   */
+  void throwDarts(SampleGrid *grid);
+  
+  /**select points of a cell against the grid of the selected samples
+   @param cell constrain selection to a given cell
+   @param grid grid of the selected samples
+   @param[out] cell_selected_samples ids of the samples selected in the cell
+   @return number of covers (one per candidate)
+   */
+  unsigned long performGridSelection(TOctreeNode< T >* cell, SampleGrid &grid,
+                               std::vector<size_t> &cell_selected_samples);
 };
 
 
@@ -117,6 +295,8 @@ TSampleSelection<T>::TSampleSelection()
     m_octree = NULL;
     m_iterator = NULL;
     m_nselected = 0;
+    m_seed = 0;
+    m_verbose = true;
     setRadius(0);
 }
 
@@ -126,6 +306,8 @@ TSampleSelection<T>::TSampleSelection(double radius, TOctree<T> *octree, TOctree
    m_octree = octree;
    m_iterator = iterator;
     m_nselected = 0;
+    m_seed = 0;
+    m_verbose = true;
    setRadius(radius);
    m_iterator->setR(radius);
 }
@@ -164,181 +346,467 @@ unsigned int TSampleSelection<T>::getNSelected() const
 
 
 template<class T>
-void TSampleSelection<T>::performSelection()
+const std::vector<size_t>& TSampleSelection<T>::getSelectedSamples() const
 {
-  std::cout<<"Selecting points with radius "<<getRadius()<<std::endl;
-  TOctreeNode<T>* cell = m_octree->getRoot();
-  performSelection(cell);
+  return m_selected_samples;
 }
 
+
 template<class T>
-void TSampleSelection<T>::performSelection(TOctreeNode<T> *cell)
+uint64_t TSampleSelection<T>::getSeed() const
 {
-	if(cell->getDepth() > m_iterator->getDepth())
-	{
-		for(int i=0;i<8;i++)
-			if(cell->getChild(i)!=NULL)
-				performSelection(cell->getChild(i));
-	}
-	else
-	{
-		performSelection(cell,cell);
-	}
+  return m_seed;
 }
 
 template<class T>
-void TSampleSelection<T>::performSelection(TOctreeNode< T >* cell, TOctreeNode< T >* par)
+void TSampleSelection<T>::setSeed(uint64_t seed)
 {
-        if(cell->getDepth() > 0)
-	{
-		for(int i=0; i<8; ++i)
-			if(cell->getChild(i)!=NULL)
-				performSelection(cell->getChild(i),par);
+  m_seed = seed;
+}
 
-	}
-	else if(cell->getNpts()>0)
+
+template<class T>
+void TSampleSelection<T>::setVerbose(bool verbose)
+{
+  m_verbose = verbose;
+}
+
+
+template<class T>
+double TSampleSelection<T>::getProcessingCellSize(double radius)
+{
+  const double d = 2.1 * radius;
+  return 1.5 * d;
+}
+
+
+template<class T>
+unsigned int TSampleSelection<T>::cover(const Point &sample)
+{
+  indexCells();
+  CoverVisitor visitor(m_octree);
+  unsigned int n = m_iterator->visitNeighbors(sample, visitor);
+  m_octree->addNCovers(visitor.ncovers);
+  return n;
+}
+
+
+template<class T>
+unsigned int TSampleSelection<T>::decimate(double fraction)
+{
+    if(fraction <= 0)
+      return m_octree->getNpoints();
+    //the voxels of a cell are indexed in a grid of each thread
+    if(fraction < 1.0 / 16)
+      fraction = 1.0 / 16;
+    const double voxel = fraction * m_radius;
+    if(m_verbose)
+      std::cout<<"Decimating the points in voxels of size "<<voxel<<std::endl;
+    
+    std::vector<TOctreeNode<T>*> nodes;
+    m_octree->getNodes(m_iterator->getDepth(), m_octree->getRoot(), nodes);
+    if(nodes.empty())
+      return m_octree->getNpoints();
+    const Point &origin = m_octree->getOrigin();
+    const Scalar *xs = m_octree->getX();
+    const Scalar *ys = m_octree->getY();
+    const Scalar *zs = m_octree->getZ();
+    T *points = m_octree->points_begin();
+    
+    //the cells of a level have the same size: the voxels overlapping a
+    //cell fit in a grid of side n
+    const size_t n = (size_t)(nodes[0]->getSize() / voxel) + 2;
+    const size_t none = (size_t)-1;
+    
+    //each cell keeps its points in the order of their voxels' first points,
+    //so that the result does not depend on the number of threads
+    std::vector<std::vector<T> > kept(nodes.size());
+    const int nnodes = (int)nodes.size();
+#ifdef OMP
+    #pragma omp parallel
+#endif
+    {
+      //point closest to the centre of each voxel of the cell, and its
+      //square distance to the centre
+      std::vector<size_t> closest(n * n * n, none);
+      std::vector<double> distances(n * n * n);
+      std::vector<size_t> voxels;
+#ifdef OMP
+      #pragma omp for schedule(dynamic)
+#endif
+      for(int i = 0; i < nnodes; ++i)
+      {
+        Point corner = nodes[i]->getOrigin();
+        double base[3] = {floor((corner.x() - origin.x()) / voxel),
+                          floor((corner.y() - origin.y()) / voxel),
+                          floor((corner.z() - origin.z()) / voxel)};
+        size_t begin = nodes[i]->points_begin() - points;
+        size_t end = begin + nodes[i]->getNpts();
+        voxels.clear();
+        for(size_t id = begin; id < end; ++id)
+        {
+          double p[3] = {xs[id] - origin.x(), ys[id] - origin.y(),
+                         zs[id] - origin.z()};
+          size_t v = 0;
+          double sqdist = 0;
+          for(int k = 0; k < 3; ++k)
+          {
+            double cell = floor(p[k] / voxel);
+            double d = p[k] - (cell + 0.5) * voxel;
+            sqdist += d * d;
+            v = v * n + (size_t)(cell - base[k]);
+          }
+          if(closest[v] == none)
+            voxels.push_back(v);
+          else if(distances[v] <= sqdist)
+            continue;
+          closest[v] = id;
+          distances[v] = sqdist;
+        }
+        
+        kept[i].reserve(voxels.size());
+        for(size_t j = 0; j < voxels.size(); ++j)
+        {
+          kept[i].push_back(points[closest[voxels[j]]]);
+          closest[voxels[j]] = none;
+        }
+      }
+    }
+    
+    size_t nkept = 0;
+    for(size_t i = 0; i < kept.size(); ++i)
+      nkept += kept[i].size();
+    std::vector<T> decimated;
+    decimated.reserve(nkept);
+    for(size_t i = 0; i < kept.size(); ++i)
+      decimated.insert(decimated.end(), kept[i].begin(), kept[i].end());
+    return m_octree->setPoints(decimated);
+}
+
+template<class T>
+void TSampleSelection<T>::indexCells()
+{
+  unsigned int depth = m_iterator->getDepth();
+  if(!m_octree->hasCellIndex(depth)
+     && 4 * (size_t)m_octree->getNCells(depth) <= m_octree->getNpoints())
+    m_octree->buildCellIndex(depth);
+}
+
+
+template<class T>
+void TSampleSelection<T>::performSelection()
+{
+  if(m_verbose)
+    std::cout<<"Selecting points with radius "<<getRadius()<<std::endl;
+  indexCells();
+  
+  //the cells of the depth of the iterator, along the Morton curve
+  std::vector<TOctreeNode<T>*> nodes;
+  m_octree->getNodes(m_iterator->getDepth(), m_octree->getRoot(), nodes);
+  
+  //the buffer of neighbors is reused from one sample to the next
+  std::vector<T*> neighbors;
+  unsigned long ncovers = 0;
+  unsigned int nremoved = 0;
+  for(size_t i = 0; i < nodes.size(); ++i)
+    scanCell(nodes[i], nodes[i], neighbors, ncovers, nremoved,
+             m_selected_samples);
+  std::sort(m_selected_samples.begin(), m_selected_samples.end());
+  m_nselected = m_selected_samples.size();
+  m_octree->addNCovers(ncovers);
+  if(m_verbose && nremoved > 0)
+    std::cout<<"removed "<<nremoved<<" isolated points"<<std::endl;
+}
+
+template<class T>
+void TSampleSelection<T>::scanCell(TOctreeNode< T >* cell, TOctreeNode< T >* par,
+                                   std::vector<T*> &neighbors,
+                                   unsigned long &ncovers,
+                                   unsigned int &nremoved,
+                                   std::vector<size_t> &selected)
+{
+	//the points of the cell are contiguous
+	typename TOctreeNode<T>::Point_iterator si=cell->points_begin();
+	while(si!=cell->points_end())
 	{
-		typename Sample_list::iterator si=cell->points_begin();
-		while(si!=cell->points_end())
+		T &s = *si;
+		size_t id = m_octree->getId(&s);
+		if(m_octree->isCovered(id) == false)
 		{
-			T &s = *si;
-			if(s.isCovered() == false)
+			m_iterator->getNeighbors(s, par, neighbors);
+			if(neighbors.size()<3)
 			{
-				Sample_star_list neighbors;
-				m_iterator->getNeighbors(s, par, neighbors);
-				if(neighbors.size()<3)
-        {
-				  s.setSelected(false);
-          std::cout<<"removed one point"<<std::endl;
-        }
-				else
-				{
-				  typename Sample_star_list::iterator ni = neighbors.begin();
-				  while(ni != neighbors.end())
-				  {
-				      (*ni)->setCovered(true);
-				      (*ni)->setSelected(false);
-				      (*ni)->increaseNCovered();
-				      ++ni;
-				  }
-				  m_nselected ++;
-				  s.setSelected(true);
-				}
+			  m_octree->setFlags(id, m_octree->getFlags(id)
+			                         & ~TOctree<T>::FLAG_SELECTED);
+			  nremoved++;
+			}
+			else
+			{
+			  typename std::vector<T*>::iterator ni = neighbors.begin();
+			  while(ni != neighbors.end())
+			  {
+			      m_octree->setFlags(m_octree->getId(*ni),
+			                         TOctree<T>::FLAG_COVERED);
+			      ++ni;
+			  }
+			  ncovers += neighbors.size();
+			  selected.push_back(id);
+			  m_octree->setFlags(id, TOctree<T>::FLAG_COVERED
+			                         | TOctree<T>::FLAG_SELECTED);
 			}
-			++si;
 		}
+		++si;
 	}
+}
 
+template<class T>
+void TSampleSelection<T>::performParallelSelection()
+{
+    if(m_verbose)
+      std::cout<<"Selecting points with radius "<<getRadius()
+               <<" in parallel"<<std::endl;
+    indexCells();
+    
+    std::vector< std::vector<TOctreeNode<T>* > > node_collection;
+    m_octree->getNodes(m_iterator->getDepth(), m_octree->getRoot(),
+                       node_collection);
+    
+    unsigned long ncovers = 0;
+    unsigned int nremoved = 0;
+    for(unsigned int i = 0; i < 8; ++i)
+    {
+#ifdef OMP
+       #pragma omp parallel default(shared) reduction(+:ncovers,nremoved)
+#endif
+       {
+         //the buffers are reused by the cells of a thread
+         std::vector<T*> neighbors;
+         std::vector<size_t> selected;
+#ifdef OMP
+         #pragma omp for schedule(dynamic) nowait
+#endif
+         for(int j = 0; j < (int)node_collection[i].size(); ++j)
+         {
+           TOctreeNode<T> *node = node_collection[i][j];
+           scanCell(node, node, neighbors, ncovers, nremoved, selected);
+         }
+#ifdef OMP
+         #pragma omp critical(selected_samples)
+#endif
+         m_selected_samples.insert(m_selected_samples.end(), selected.begin(),
+                                   selected.end());
+       }
+    }
+    std::sort(m_selected_samples.begin(), m_selected_samples.end());
+    m_nselected = m_selected_samples.size();
+    m_octree->addNCovers(ncovers);
+    if(m_verbose && nremoved > 0)
+      std::cout<<"removed "<<nremoved<<" isolated points"<<std::endl;
 }
 
 template<class T>
 void TSampleSelection<T>::performDartThrowingSelection()
 {
-    std::cout<<"Dart Throwing Selection in parallel"<<std::endl;
-    typedef typename std::vector< std::vector<TOctreeNode<T>* > >
-                                                 OctreeNode_collection;
+    if(m_verbose)
+      std::cout<<"Dart Throwing Selection in parallel"<<std::endl;
+    indexCells();
+    throwDarts(NULL);
+}
+
+template<class T>
+void TSampleSelection<T>::performGridSelection()
+{
+    if(m_verbose)
+      std::cout<<"Dart Throwing Selection on a grid in parallel"<<std::endl;
+    const Point &origin = m_octree->getOrigin();
+    double corner[3] = {origin.x(), origin.y(), origin.z()};
+    SampleGrid grid;
+    grid.initialize(m_octree->getX(), m_octree->getY(), m_octree->getZ(),
+                    corner, m_radius, m_octree->getSize(),
+                    m_octree->getNpoints());
+    throwDarts(&grid);
+}
+
+template<class T>
+void TSampleSelection<T>::throwDarts(SampleGrid *grid)
+{
     TOctreeNode<T> *root = m_octree->getRoot();
     unsigned int depth = m_iterator->getDepth();
 
     const double d = 2.1 * m_radius;
     depth = (unsigned int)(m_octree->getDepth() - floor( log2(
-                m_octree->getSize() / (1.5 * d) )));
+                m_octree->getSize() / getProcessingCellSize(m_radius) )));
+    //radius larger than the octree (coarse levels of detail): one cell
+    if(depth > m_octree->getDepth())
+      depth = m_octree->getDepth();
 
-    std::cout<<"Processing depth "<< depth <<" ; size "
+    if(m_verbose)
+      std::cout<<"Processing depth "<< depth <<" ; size "
              << m_octree->getSize()/(double)pow2(m_octree->getDepth()-depth)
              <<" ; dilatation radius "<<d<<std::endl;
 
-    OctreeNode_collection node_collection;
-    m_octree->getNodes(depth, root, node_collection);
+    std::vector<TOctreeNode<T>* > nodes;
+    m_octree->getNodes(depth, root, nodes);
     
-    for(unsigned int i = 0; i < 8; ++i)
+    //a cell waits for its neighbours of the previous colours only
+    CellScheduler scheduler;
+    scheduleCells(nodes, depth, scheduler);
+    
+    DartTask task(this, grid, nodes);
+#ifdef PDSS_METRICS
+    Timer timer;
+    scheduler.run(task);
+    Metrics::addParallelTime(timer.elapsed());
+#else
+    scheduler.run(task);
+#endif
+    
+    unsigned long ncovers = 0;
+    for(size_t j = 0; j < nodes.size(); ++j)
     {
-       std::vector<std::list<T*> > cell_selected_samples;
-       cell_selected_samples.assign(node_collection[i].size(),std::list<T*>());
-       
-#ifdef OMP
-       #pragma omp parallel for default(shared)
-#endif 
-       for(int j = 0; j < (int)node_collection[i].size(); ++j)
-       {
-           TOctreeNode<T> *node = node_collection[i][j];
-           performDartThrowingSelection(node, cell_selected_samples[j]);
-       }
-       
-       //merge
-       for(int j = 0; j < (int)node_collection[i].size(); ++j)
-       {
-           m_selected_samples.splice(m_selected_samples.end(),
-                                   cell_selected_samples[j]);
-       }
-       m_nselected = m_selected_samples.size();
+        m_selected_samples.insert(m_selected_samples.end(),
+                                  task.cell_selected_samples[j].begin(),
+                                  task.cell_selected_samples[j].end());
+        ncovers += task.ncovers[j];
+    }
+    std::sort(m_selected_samples.begin(), m_selected_samples.end());
+    m_nselected = m_selected_samples.size();
+    m_octree->addNCovers(ncovers);
+}
+
+
+template<class T>
+void TSampleSelection<T>::scheduleCells(const std::vector<TOctreeNode<T>* > &nodes,
+                                        unsigned int depth,
+                                        CellScheduler &scheduler)
+{
+    CellIndex cells;
+    cells.initialize(nodes.size());
+    for(size_t i = 0; i < nodes.size(); ++i)
+    {
+      IndexedCell cell;
+      cell.code = mortonEncode(nodes[i]->getXLoc() >> depth,
+                               nodes[i]->getYLoc() >> depth,
+                               nodes[i]->getZLoc() >> depth);
+      cell.node = i;
+      cell.begin = cell.end = 0;
+      cells.insert(cell);
+    }
+    
+    scheduler.initialize(nodes.size());
+    const unsigned int ncells = m_octree->getBinSize() >> depth;
+    for(size_t i = 0; i < nodes.size(); ++i)
+    {
+      TOctreeNode<T> *node = nodes[i];
+      scheduler.setCost(i, node->getNpts());
+      
+      unsigned int x = node->getXLoc() >> depth;
+      unsigned int y = node->getYLoc() >> depth;
+      unsigned int z = node->getZLoc() >> depth;
+      for(int dx = -1; dx <= 1; ++dx)
+        for(int dy = -1; dy <= 1; ++dy)
+          for(int dz = -1; dz <= 1; ++dz)
+          {
+            //unsigned: the cell before 0 wraps beyond ncells
+            unsigned int nx = x + dx, ny = y + dy, nz = z + dz;
+            if(nx >= ncells || ny >= ncells || nz >= ncells)
+              continue;
+            const IndexedCell *neighbor = cells.find(mortonEncode(nx, ny, nz));
+            //adjacent cells have different colours: the smaller goes first
+            if(neighbor != NULL
+               && node->getNChild() < nodes[neighbor->node]->getNChild())
+              scheduler.addDependency(i, neighbor->node);
+          }
     }
 }
 
 
 template<class T>
-void TSampleSelection<T>::performDartThrowingSelection(TOctreeNode< T >* cell,
-                                          std::list<T*> &cell_selected_samples)
+unsigned long TSampleSelection<T>::performDartThrowingSelection(
+                                          TOctreeNode< T >* cell,
+                                          std::vector<size_t> &cell_selected_samples)
 {
   
-  std::vector<TOctreeNode<T>* > leaves;
-  std::set<T*> m_all_samples;
+  std::vector<T*> candidates;
 
-  m_octree->getNodes(0, cell, leaves);
   TOctreeIterator<T> iterator(m_octree);
   iterator.setR(m_radius);
 
-  //get all points stored in the octree
-  typename std::vector<TOctreeNode<T>* >::iterator it_node;
-  for(it_node = leaves.begin(); it_node != leaves.end(); ++it_node)
+  //get all points stored in the cell (contiguous in the octree)
+  typename TOctreeNode<T>::Point_iterator pi;
+  for(pi = cell->points_begin(); pi != cell->points_end(); ++pi)
   {
-    typename std::list<T>::iterator pi;
-    for(pi = (*it_node)->points_begin(); pi != (*it_node)->points_end(); ++pi)
-    {
-      if(!pi->isCovered())
-        m_all_samples.insert(&(*pi));
-    }
+    if(!m_octree->isCovered(m_octree->getId(pi)))
+      candidates.push_back(pi);
   }
-  srand (time(NULL));
-  unsigned int  nuncovered = m_all_samples.size();
-  while(nuncovered > 0)
+  
+  //shuffle the candidates (Fisher-Yates): taking the next uncovered
+  //candidate in this order is a uniform pick among the uncovered samples
+  RandomGenerator generator(m_seed, cell->getXLoc(), cell->getYLoc(),
+                            cell->getZLoc());
+  for(unsigned int i = candidates.size(); i > 1; --i)
+    std::swap(candidates[i - 1], candidates[generator.uniform(i)]);
+
+  CoverVisitor visitor(m_octree);
+  typename std::vector<T*>::iterator it;
+  for(it = candidates.begin(); it != candidates.end(); ++it)
   {
-    unsigned int idx = std::rand() % nuncovered;
-    typename std::set<T*>::iterator it = m_all_samples.begin();
-    for(unsigned int i = 0;i <idx; ++i)
-      ++it;
-
     T *s = *it;
-    m_all_samples.erase(it);
+    size_t id = m_octree->getId(s);
 
-    if(s->isCovered())
+    //covered samples are removed lazily
+    if(m_octree->isCovered(id))
       continue;
 
-
-    Sample_star_list neighbors;
-    iterator.getNeighbors(*s, neighbors);
-    typename Sample_star_list::iterator ni = neighbors.begin();
-    while(ni != neighbors.end())
-    {
-        T* sample = *ni;
-        m_all_samples.erase(sample);
-        sample->setCovered(true);
-        sample->setSelected(false);
-        sample->increaseNCovered();
-        ++ni;
-    }
-    
-    s->setSelected(true);
-    cell_selected_samples.push_back(s);
+    //cover the neighbors (and s itself) as they are found
+    iterator.visitNeighbors(*s, visitor);
     
-    nuncovered = m_all_samples.size();
+    m_octree->setFlags(id, TOctree<T>::FLAG_COVERED | TOctree<T>::FLAG_SELECTED);
+    cell_selected_samples.push_back(id);
   }
+  return visitor.ncovers;
 }
 
 
-
-
+template<class T>
+unsigned long TSampleSelection<T>::performGridSelection(
+                                          TOctreeNode< T >* cell,
+                                          SampleGrid &grid,
+                                          std::vector<size_t> &cell_selected_samples)
+{
+  //same candidates and same order as the dart throwing
+  std::vector<size_t> candidates;
+  typename TOctreeNode<T>::Point_iterator pi;
+  for(pi = cell->points_begin(); pi != cell->points_end(); ++pi)
+  {
+    size_t id = m_octree->getId(pi);
+    if(!m_octree->isCovered(id))
+      candidates.push_back(id);
+  }
+  
+  RandomGenerator generator(m_seed, cell->getXLoc(), cell->getYLoc(),
+                            cell->getZLoc());
+  for(unsigned int i = candidates.size(); i > 1; --i)
+    std::swap(candidates[i - 1], candidates[generator.uniform(i)]);
+
+  const Scalar *xs = m_octree->getX();
+  const Scalar *ys = m_octree->getY();
+  const Scalar *zs = m_octree->getZ();
+  std::vector<size_t>::const_iterator it;
+  for(it = candidates.begin(); it != candidates.end(); ++it)
+  {
+    size_t id = *it;
+    if(grid.isCovered(xs[id], ys[id], zs[id]))
+    {
+      m_octree->setFlags(id, TOctree<T>::FLAG_COVERED);
+      continue;
+    }
+    grid.insert(id);
+    m_octree->setFlags(id, TOctree<T>::FLAG_COVERED | TOctree<T>::FLAG_SELECTED);
+    cell_selected_samples.push_back(id);
+  }
+  return candidates.size();
+}
 
 
 #endif
-
@@ -0,0 +1,115 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file Subsample.cpp
+* @author Julie Digne
+* subsampling of in-memory buffers, see Subsample.h
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Subsample.h"
+
+#include "IndexedSample.h"
+#include "Octree.h"
+#include "OctreeIterator.h"
+#include "SampleSelection.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+/**subsample a buffer of any scalar type
+ * @param xyz coordinates of the first point
+ * @param n number of points
+ * @param radius selection radius
+ * @param seed seed of the dart throwing
+ * @param stride number of values between two consecutive points
+ * @return indices of the selected points
+ */
+template<class V>
+static vector<size_t> subsampleBuffer(const V *xyz, size_t n, double radius,
+                                      uint64_t seed, size_t stride)
+{
+    vector<size_t> selected;
+    if(n == 0)
+      return selected;
+    
+    if(radius <= 0)
+    {
+      selected.resize(n);
+      for(size_t i = 0; i < n; ++i)
+        selected[i] = i;
+      return selected;
+    }
+    
+    //the octree sorts its own array of positions, with the index of each
+    //point in the buffer, stored relative to the first point
+    double origin[3];
+    Point::chooseStorageOrigin(xyz[0], xyz[1], xyz[2], origin);
+    vector<IndexedSample> samples(n);
+    double xmin = HUGE_VAL, ymin = HUGE_VAL, zmin = HUGE_VAL;
+    double xmax = -HUGE_VAL, ymax = -HUGE_VAL, zmax = -HUGE_VAL;
+#ifdef OMP
+    #pragma omp parallel for reduction(min:xmin,ymin,zmin) reduction(max:xmax,ymax,zmax)
+#endif
+    for(long i = 0; i < (long)n; ++i)
+    {
+      const V *p = xyz + i * stride;
+      double x = p[0], y = p[1], z = p[2];
+      samples[i] = IndexedSample(x - origin[0], y - origin[1], z - origin[2], i);
+      xmin = x < xmin ? x : xmin;
+      ymin = y < ymin ? y : ymin;
+      zmin = z < zmin ? z : zmin;
+      xmax = x > xmax ? x : xmax;
+      ymax = y > ymax ? y : ymax;
+      zmax = z > zmax ? z : zmax;
+    }
+    double bbox[6] = {xmin, ymin, zmin, xmax, ymax, zmax};
+    
+    TOctree<IndexedSample> octree;
+    octree.initialize(bbox, radius, origin);
+    octree.setPoints(samples);
+    
+    TOctreeIterator<IndexedSample> iterator(&octree);
+    iterator.setR(radius);
+    
+    TSampleSelection<IndexedSample> selection(radius, &octree, &iterator);
+    selection.setSeed(seed);
+    selection.setVerbose(false);
+    selection.performDartThrowingSelection();
+    
+    const std::vector<size_t> &ids = selection.getSelectedSamples();
+    const IndexedSample *points = octree.points_begin();
+    selected.resize(ids.size());
+    for(size_t i = 0; i < ids.size(); ++i)
+      selected[i] = points[ids[i]].getIndex();
+    std::sort(selected.begin(), selected.end());
+    return selected;
+}
+
+vector<size_t> subsample(const float *xyz, size_t n, double radius,
+                         uint64_t seed, size_t stride)
+{
+    return subsampleBuffer<float>(xyz, n, radius, seed, stride);
+}
+
+vector<size_t> subsample(const double *xyz, size_t n, double radius,
+                         uint64_t seed, size_t stride)
+{
+    return subsampleBuffer<double>(xyz, n, radius, seed, stride);
+}
@@ -0,0 +1,64 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file Subsample.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+ * @file Subsample.h
+ * library interface (pdss_core): Poisson disk subsampling of points held
+ * in memory by the caller. The buffers are only read, the selected points
+ * are returned as indices into them. The selection runs in parallel when
+ * the library is built with OpenMP (the number of threads is the OpenMP
+ * default of the caller, e.g. omp_set_num_threads or OMP_NUM_THREADS).
+ */
+
+#ifndef SUBSAMPLE_H
+#define SUBSAMPLE_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+/**select a subset of points such that any two selected points are at least
+ * radius apart and any point is closer than radius to a selected point
+ * (dart throwing, see TSampleSelection)
+ * @param xyz coordinates of the first point (x y z)
+ * @param n number of points
+ * @param radius selection radius
+ * @param seed seed of the dart throwing, the result does not depend on the
+ * number of threads
+ * @param stride number of values between two consecutive points (3 for
+ * packed positions, e.g. 6 for interleaved positions and normals)
+ * @return indices of the selected points, in increasing order
+ */
+std::vector<size_t> subsample(const float *xyz, size_t n, double radius,
+                              uint64_t seed = 0, size_t stride = 3);
+
+/**select a subset of points (double coordinates)
+ * @param xyz coordinates of the first point (x y z)
+ * @param n number of points
+ * @param radius selection radius
+ * @param seed seed of the dart throwing
+ * @param stride number of values between two consecutive points
+ * @return indices of the selected points, in increasing order
+ */
+std::vector<size_t> subsample(const double *xyz, size_t n, double radius,
+                              uint64_t seed = 0, size_t stride = 3);
+
+#endif
@@ -0,0 +1,438 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file TiledSelection.cpp
+* @author Julie Digne
+* out-of-core selection by tiles, see TiledSelection.h
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TiledSelection.h"
+
+#include "types.h"
+#include "Random.h"
+
+#include <iostream>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef OMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+bool TiledSelection::TileKey::operator<(const TileKey &other) const
+{
+    if(x != other.x)
+      return x < other.x;
+    if(y != other.y)
+      return y < other.y;
+    return z < other.z;
+}
+
+TiledSelection::TiledSelection(double radius, double tile_size, uint64_t seed,
+                               const char *tmp_dir, size_t buffer_size)
+  : m_spilled(1), m_loaded(1), m_subsampled(1)
+{
+    m_radius = radius;
+    m_seed = seed;
+    m_buffer_size = buffer_size;
+    m_buffered = 0;
+    m_writer = NULL;
+    m_voxel_fraction = -1;
+    m_nselected = 0;
+
+    //a tile holds at least two processing cells, so that the halo of a
+    //tile (one radius) only reaches its direct neighbours
+    double min_size = 2.0 * SampleSelection::getProcessingCellSize(radius);
+    m_tile_size = tile_size > min_size ? tile_size : min_size;
+
+    if(tmp_dir == NULL)
+      tmp_dir = getenv("TMPDIR");
+    string dir_template = string(tmp_dir != NULL ? tmp_dir : "/tmp")
+                          + "/pdss_XXXXXX";
+    vector<char> path(dir_template.begin(), dir_template.end());
+    path.push_back('\0');
+    m_ok = (mkdtemp(&path[0]) != NULL);
+    if(m_ok)
+      m_dir = &path[0];
+    else
+      std::cerr<<"Could not create a temporary directory in "
+               <<dir_template<<std::endl;
+}
+
+TiledSelection::~TiledSelection()
+{
+    if(m_dir.empty())
+      return;
+
+    std::map<TileKey, size_t>::const_iterator ti;
+    for(ti = m_tiles.begin(); ti != m_tiles.end(); ++ti)
+    {
+      unlink(getTilePath(ti->first, "pts").c_str());
+      unlink(getTilePath(ti->first, "sel").c_str());
+    }
+    rmdir(m_dir.c_str());
+}
+
+void TiledSelection::setVoxelFraction(double fraction)
+{
+    m_voxel_fraction = fraction;
+}
+
+double TiledSelection::getTileSize() const
+{
+    return m_tile_size;
+}
+
+unsigned int TiledSelection::getNTiles() const
+{
+    return m_tiles.size();
+}
+
+unsigned long TiledSelection::getNSelected() const
+{
+    return m_nselected;
+}
+
+bool TiledSelection::performSelection(const char *filename,
+                                      FileIO::Format format,
+                                      PointWriter &writer)
+{
+    if(!m_ok)
+      return false;
+
+    //first pass: spill the points to the tiles, the full buffers being
+    //written while the next windows are parsed
+    pthread_t spiller;
+    if(pthread_create(&spiller, NULL, spillTiles, this) != 0)
+    {
+      std::cerr<<"Could not start the threads of the tiles"<<std::endl;
+      return false;
+    }
+    bool read = FileIO::streamPoints(filename, format, *this);
+    spillBuffers();
+    m_spilled.close();
+    pthread_join(spiller, NULL);
+    if(!read)
+      return false;
+    if(!m_ok)
+    {
+      std::cerr<<"Could not write the tiles in "<<m_dir<<std::endl;
+      return false;
+    }
+    std::cout<<m_tiles.size()<<" tiles of size "<<m_tile_size<<std::endl;
+
+    //second pass: subsample the tiles in a fixed order, each tile is
+    //constrained by the halos of the neighbouring tiles processed before.
+    //The next tiles are loaded and the previous ones written meanwhile.
+    m_writer = &writer;
+    pthread_t loader, output;
+    if(pthread_create(&loader, NULL, loadTiles, this) != 0)
+    {
+      std::cerr<<"Could not start the threads of the tiles"<<std::endl;
+      return false;
+    }
+    if(pthread_create(&output, NULL, writeTiles, this) != 0)
+    {
+      std::cerr<<"Could not start the threads of the tiles"<<std::endl;
+      m_loaded.close();
+      m_subsampled.close();
+      pthread_join(loader, NULL);
+      return false;
+    }
+
+    bool ok = true;
+    Tile *tile;
+    while(m_loaded.pop(tile))
+    {
+      //after an error, the loader is stopped and the tiles left dropped
+      ok = ok && tile->loaded && selectTile(*tile);
+      if(ok)
+        m_subsampled.push(tile);
+      else
+      {
+        delete tile;
+        m_loaded.close();
+      }
+    }
+    m_subsampled.close();
+    pthread_join(loader, NULL);
+    pthread_join(output, NULL);
+    m_writer = NULL;
+    return ok;
+}
+
+void TiledSelection::process(std::vector<Sample> &samples,
+                             const double origin[3])
+{
+    //the tile files hold absolute coordinates
+    std::vector<Sample>::const_iterator si;
+    for(si = samples.begin(); si != samples.end(); ++si)
+    {
+      double p[3] = {origin[0] + si->x(), origin[1] + si->y(),
+                     origin[2] + si->z()};
+      TileKey key;
+      key.x = (int)floor(p[0] / m_tile_size);
+      key.y = (int)floor(p[1] / m_tile_size);
+      key.z = (int)floor(p[2] / m_tile_size);
+
+      std::vector<double> &buffer = m_buffers[key];
+      buffer.push_back(p[0]);
+      buffer.push_back(p[1]);
+      buffer.push_back(p[2]);
+      buffer.push_back(si->nx());
+      buffer.push_back(si->ny());
+      buffer.push_back(si->nz());
+      m_tiles[key]++;
+      m_buffered += 6 * sizeof(double);
+    }
+
+    if(m_buffered >= m_buffer_size)
+      spillBuffers();
+}
+
+void TiledSelection::spillBuffers()
+{
+    Tile_buffers *buffers = new Tile_buffers;
+    buffers->swap(m_buffers);
+    m_buffered = 0;
+    if(!m_spilled.push(buffers))
+      delete buffers;
+}
+
+bool TiledSelection::writeBuffers(const Tile_buffers &buffers)
+{
+    bool ok = true;
+    Tile_buffers::const_iterator bi;
+    for(bi = buffers.begin(); bi != buffers.end(); ++bi)
+      ok = appendValues(getTilePath(bi->first, "pts"), bi->second) && ok;
+    return ok;
+}
+
+void* TiledSelection::spillTiles(void *selection)
+{
+    TiledSelection *tiles = (TiledSelection*)selection;
+    Tile_buffers *buffers;
+    while(tiles->m_spilled.pop(buffers))
+    {
+      if(!tiles->writeBuffers(*buffers))
+        tiles->m_ok = false;
+      delete buffers;
+    }
+    return NULL;
+}
+
+void* TiledSelection::loadTiles(void *selection)
+{
+    TiledSelection *tiles = (TiledSelection*)selection;
+#ifdef OMP
+    //the threads belong to the selection of the current tile: the next one
+    //is sorted by this thread alone (the setting is local to this thread)
+    omp_set_num_threads(1);
+#endif
+    std::map<TileKey, size_t>::const_iterator ti;
+    for(ti = tiles->m_tiles.begin(); ti != tiles->m_tiles.end(); ++ti)
+    {
+      Tile *tile = new Tile;
+      tile->key = ti->first;
+      tile->loaded = tiles->loadTile(*tile);
+      bool loaded = tile->loaded;
+      //the tile belongs to the consumer once pushed
+      if(!tiles->m_loaded.push(tile))
+      {
+        delete tile;
+        break;
+      }
+      if(!loaded)
+        break;
+    }
+    tiles->m_loaded.close();
+    return NULL;
+}
+
+void* TiledSelection::writeTiles(void *selection)
+{
+    TiledSelection *tiles = (TiledSelection*)selection;
+    Tile *tile;
+    while(tiles->m_subsampled.pop(tile))
+    {
+      tiles->m_nselected += tiles->m_writer->writeSamples(tile->octree,
+                                                          tile->selected);
+      delete tile;
+    }
+    return NULL;
+}
+
+bool TiledSelection::loadTile(Tile &tile)
+{
+    std::vector<Sample> samples;
+    std::string path = getTilePath(tile.key, "pts");
+    double origin[3];
+    getTileOrigin(tile.key, origin);
+    if(!readSamples(path, origin, samples))
+    {
+      std::cerr<<"Could not read the tile "<<path<<std::endl;
+      return false;
+    }
+    unlink(path.c_str());
+
+    //the octree covers the tile and its halo
+    const TileKey &key = tile.key;
+    double bbox[6];
+    bbox[0] = key.x * m_tile_size - m_radius;
+    bbox[1] = key.y * m_tile_size - m_radius;
+    bbox[2] = key.z * m_tile_size - m_radius;
+    bbox[3] = (key.x + 1) * m_tile_size + m_radius;
+    bbox[4] = (key.y + 1) * m_tile_size + m_radius;
+    bbox[5] = (key.z + 1) * m_tile_size + m_radius;
+
+    tile.octree.initialize(bbox, m_radius, origin);
+    tile.octree.setPoints(samples);
+    return true;
+}
+
+bool TiledSelection::selectTile(Tile &tile)
+{
+    const TileKey &key = tile.key;
+    Octree &octree = tile.octree;
+    OctreeIterator iterator(&octree);
+    iterator.setR(m_radius);
+    SampleSelection selection(m_radius, &octree, &iterator);
+    RandomGenerator generator(m_seed, key.x, key.y, key.z);
+    selection.setSeed(generator.next());
+    selection.setVerbose(false);
+    if(m_voxel_fraction > 0)
+      selection.decimate(m_voxel_fraction);
+    double origin[3];
+    octree.getStorageOrigin(origin);
+
+    //cover the points close to the samples selected in the neighbours
+    for(int dx = -1; dx <= 1; ++dx)
+      for(int dy = -1; dy <= 1; ++dy)
+        for(int dz = -1; dz <= 1; ++dz)
+        {
+          if(dx == 0 && dy == 0 && dz == 0)
+            continue;
+          TileKey neighbor = {key.x + dx, key.y + dy, key.z + dz};
+          std::vector<Sample> halo;
+          if(!readSamples(getTilePath(neighbor, "sel"), origin, halo))
+            continue;
+
+          std::vector<Sample>::const_iterator hi;
+          for(hi = halo.begin(); hi != halo.end(); ++hi)
+            if(getDistanceToBorder(*hi, key, origin) > -m_radius)
+              selection.cover(*hi);
+        }
+
+    selection.performDartThrowingSelection();
+
+    //keep the samples that may cover points of the next tiles
+    std::vector<double> halo;
+    Sample *si;
+    for(si = octree.points_begin(); si != octree.points_end(); ++si)
+    {
+      if(!octree.isSelected(octree.getId(si))
+         || getDistanceToBorder(*si, key, origin) >= m_radius)
+        continue;
+      halo.push_back(origin[0] + si->x());
+      halo.push_back(origin[1] + si->y());
+      halo.push_back(origin[2] + si->z());
+      halo.push_back(si->nx());
+      halo.push_back(si->ny());
+      halo.push_back(si->nz());
+    }
+    std::string path = getTilePath(key, "sel");
+    if(!halo.empty() && !appendValues(path, halo))
+    {
+      std::cerr<<"Could not write the halo of the tile "<<path<<std::endl;
+      return false;
+    }
+
+    tile.selected = selection.getSelectedSamples();
+    return true;
+}
+
+std::string TiledSelection::getTilePath(const TileKey &key,
+                                        const char *extension) const
+{
+    char name[96];
+    snprintf(name, sizeof(name), "/tile_%d_%d_%d.%s", key.x, key.y, key.z,
+             extension);
+    return m_dir + name;
+}
+
+bool TiledSelection::appendValues(const std::string &path,
+                                  const std::vector<double> &values)
+{
+    FILE *f = fopen(path.c_str(), "ab");
+    if(f == NULL)
+      return false;
+    bool ok = values.empty()
+      || fwrite(&values[0], sizeof(double), values.size(), f) == values.size();
+    return (fclose(f) == 0) && ok;
+}
+
+bool TiledSelection::readSamples(const std::string &path,
+                                 const double origin[3],
+                                 std::vector<Sample> &samples)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if(f == NULL)
+      return false;
+
+    double values[6 * 4096];
+    size_t n;
+    while((n = fread(values, 6 * sizeof(double), 4096, f)) > 0)
+    {
+      for(size_t i = 0; i < n; ++i)
+      {
+        const double *v = &values[6 * i];
+        samples.push_back(Sample(v[0] - origin[0], v[1] - origin[1],
+                                 v[2] - origin[2], v[3], v[4], v[5]));
+      }
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+void TiledSelection::getTileOrigin(const TileKey &key, double origin[3]) const
+{
+    Point::chooseStorageOrigin(key.x * m_tile_size, key.y * m_tile_size,
+                               key.z * m_tile_size, origin);
+}
+
+double TiledSelection::getDistanceToBorder(const Point &p, const TileKey &key,
+                                           const double origin[3]) const
+{
+    double x[3] = {origin[0] + p.x() - key.x * m_tile_size,
+                   origin[1] + p.y() - key.y * m_tile_size,
+                   origin[2] + p.z() - key.z * m_tile_size};
+    double distance = m_tile_size;
+    for(int k = 0; k < 3; ++k)
+    {
+      double d = x[k] < m_tile_size - x[k] ? x[k] : m_tile_size - x[k];
+      distance = d < distance ? d : distance;
+    }
+    return distance;
+}
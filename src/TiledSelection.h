@@ -0,0 +1,261 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file TiledSelection.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+ * @file TiledSelection.h
+ * declares the out-of-core selection of point clouds larger than the memory.
+ * The space is split into a regular grid of cubic tiles. The input is read
+ * once, window by window, and its points are spilled to one temporary file
+ * per tile. The tiles are then loaded and subsampled one at a time, in a
+ * fixed order. The samples selected close to the border of a tile are kept
+ * in a small halo file, which covers the points of the tiles processed
+ * afterwards before their own selection: the disk constraint holds across
+ * tile borders and the memory only depends on the size of a tile.
+ * Both passes are pipelined: the buffers of the tiles are written to disk by
+ * a thread while the next windows are parsed, and while a tile is
+ * subsampled the next one is loaded and its octree built by a thread, and
+ * the samples of the previous one are written by another. The stages are
+ * connected by queues of one item, so that at most five tiles (one per
+ * stage, one per queue) are held in memory.
+ */
+
+#ifndef TILED_SELECTION_H
+#define TILED_SELECTION_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "FileIO.h"
+#include "Sample.h"
+#include "BoundedQueue.h"
+#include "types.h"
+
+/**@class TiledSelection
+ * out-of-core Poisson disk subsampling by tiles
+ */
+class TiledSelection : public PointHandler
+{
+  public :
+
+  /**constructor
+   * @param radius selection radius
+   * @param tile_size side of the tiles (enlarged to at least two processing
+   * cells of the dart throwing)
+   * @param seed seed of the dart throwing
+   * @param tmp_dir directory of the temporary files (NULL: $TMPDIR or /tmp)
+   * @param buffer_size size of the in-memory buffers of the tiles in bytes
+   * (up to three times the size is held while the buffers are written)
+   */
+  TiledSelection(double radius, double tile_size, uint64_t seed,
+                 const char *tmp_dir = NULL,
+                 size_t buffer_size = 1 << 28);
+
+  /**destructor (removes the temporary files)*/
+  ~TiledSelection();
+
+  /**pre-decimate the points of each tile before its selection (see
+   * TSampleSelection::decimate)
+   * @param fraction side of the voxels relative to the radius (0 or
+   * negative: no decimation, the default)
+   */
+  void setVoxelFraction(double fraction);
+
+  /**read a file, subsample it tile by tile and write the selected points
+   * @param filename name of the file to read points from
+   * @param format format of the file
+   * @param writer opened writer receiving the selected points
+   * @return false if something went wrong
+   */
+  bool performSelection(const char *filename, FileIO::Format format,
+                        PointWriter &writer);
+
+  /**spill the points of a window to the tile files
+   * @param samples points read
+   * @param origin origin the points are stored relative to
+   */
+  void process(std::vector<Sample> &samples, const double origin[3]);
+
+  /**get the side of the tiles
+   * @return tile size
+   */
+  double getTileSize() const;
+
+  /**get the number of non empty tiles
+   * @return number of tiles
+   */
+  unsigned int getNTiles() const;
+
+  /**get the number of selected points
+   * @return number of points
+   */
+  unsigned long getNSelected() const;
+
+  private :
+
+  /**integer coordinates of a tile in the grid*/
+  struct TileKey
+  {
+    int x, y, z;
+
+    bool operator<(const TileKey &other) const;
+  };
+
+  typedef std::map<TileKey, std::vector<double> > Tile_buffers;
+
+  /**tile going through the stages of the second pass*/
+  struct Tile
+  {
+    TileKey key;
+
+    /**octree of the points of the tile*/
+    Octree octree;
+
+    /**ids of the samples selected in the octree*/
+    std::vector<size_t> selected;
+
+    /**false if the points of the tile could not be read*/
+    bool loaded;
+  };
+
+  /**hand the buffered points to the thread writing the tile files*/
+  void spillBuffers();
+
+  /**append buffered points to the tile files
+   * @param buffers points of each tile
+   * @return false if something went wrong
+   */
+  bool writeBuffers(const Tile_buffers &buffers);
+
+  /**first pipeline stage of the first pass: write the buffers handed by
+   * spillBuffers
+   * @param selection TiledSelection
+   * @return NULL
+   */
+  static void* spillTiles(void *selection);
+
+  /**first pipeline stage of the second pass: load the tiles in order and
+   * build their octrees
+   * @param selection TiledSelection
+   * @return NULL
+   */
+  static void* loadTiles(void *selection);
+
+  /**last pipeline stage of the second pass: write the samples of the
+   * subsampled tiles in order
+   * @param selection TiledSelection
+   * @return NULL
+   */
+  static void* writeTiles(void *selection);
+
+  /**read the points of a tile and build its octree
+   * @param[in,out] tile tile whose key is set
+   * @return false if something went wrong
+   */
+  bool loadTile(Tile &tile);
+
+  /**subsample a loaded tile
+   * @param[in,out] tile tile to subsample
+   * @return false if something went wrong
+   */
+  bool selectTile(Tile &tile);
+
+  /**get the name of a temporary file of a tile
+   * @param key tile
+   * @param extension "pts" for the points, "sel" for the halo samples
+   * @return path of the file
+   */
+  std::string getTilePath(const TileKey &key, const char *extension) const;
+
+  /**append samples to a file (6 doubles per sample)
+   * @param path path of the file
+   * @param values packed values
+   * @return false if something went wrong
+   */
+  static bool appendValues(const std::string &path,
+                           const std::vector<double> &values);
+
+  /**read the samples of a file written by appendValues
+   * @param path path of the file
+   * @param origin origin the samples are stored relative to
+   * @param[out] samples samples read
+   * @return false if the file could not be read
+   */
+  static bool readSamples(const std::string &path, const double origin[3],
+                          std::vector<Sample> &samples);
+
+  /**get the origin the points of a tile are stored relative to: its
+   * corner (see Point::chooseStorageOrigin)
+   * @param key tile
+   * @param[out] origin x y z of the origin
+   */
+  void getTileOrigin(const TileKey &key, double origin[3]) const;
+
+  /**get the distance from a point to the outside of a tile
+   * @param p point inside the tile (or its halo)
+   * @param key tile
+   * @param origin origin the point is stored relative to
+   * @return distance to the closest face, negative outside of the tile
+   */
+  double getDistanceToBorder(const Point &p, const TileKey &key,
+                             const double origin[3]) const;
+
+  double m_radius;
+
+  double m_tile_size;
+
+  uint64_t m_seed;
+
+  std::string m_dir;
+
+  size_t m_buffer_size;
+
+  /**number of bytes held in m_buffers*/
+  size_t m_buffered;
+
+  /**points read and not yet spilled*/
+  Tile_buffers m_buffers;
+
+  /**side of the voxels of the decimation relative to the radius*/
+  double m_voxel_fraction;
+
+  /**number of points of each tile*/
+  std::map<TileKey, size_t> m_tiles;
+
+  /**buffers waiting to be written to the tile files*/
+  BoundedQueue<Tile_buffers*> m_spilled;
+
+  /**tiles waiting to be subsampled*/
+  BoundedQueue<Tile*> m_loaded;
+
+  /**tiles waiting to be written*/
+  BoundedQueue<Tile*> m_subsampled;
+
+  /**writer receiving the samples of the tiles*/
+  PointWriter *m_writer;
+
+  unsigned long m_nselected;
+
+  bool m_ok;
+};
+
+#endif
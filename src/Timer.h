@@ -0,0 +1,107 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file Timer.h
+* @author Julie Digne
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/**
+ * @file Timer.h
+ * declares a high resolution wall clock timer and a query of the peak
+ * memory usage of the process
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <time.h>
+#include <sys/resource.h>
+
+/**@class Timer
+ * wall clock timer (monotonic clock, nanosecond resolution)
+ */
+class Timer
+{
+  public :
+  /**constructor, starts the timer*/
+  Timer();
+
+  /**restart the timer*/
+  void start();
+
+  /**get the time elapsed since the last start
+   * @return elapsed time in seconds
+   */
+  double elapsed() const;
+
+  private :
+
+  /**get the current time of the monotonic clock
+   * @return time in seconds
+   */
+  static double now();
+
+  double m_start;
+};
+
+inline Timer::Timer()
+{
+  start();
+}
+
+inline void Timer::start()
+{
+  m_start = now();
+}
+
+inline double Timer::elapsed() const
+{
+  return now() - m_start;
+}
+
+inline double Timer::now()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + 1e-9 * (double)t.tv_nsec;
+}
+
+/**get the peak resident memory of a resource usage
+ * @param usage usage of a process (getrusage, wait4)
+ * @return peak memory in megabytes
+ */
+inline double getPeakMemory(const struct rusage &usage)
+{
+#ifdef __APPLE__
+  return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+  //ru_maxrss is in kilobytes on Linux
+  return usage.ru_maxrss / 1024.0;
+#endif
+}
+
+/**get the peak resident memory of the process so far
+ * @return peak memory in megabytes
+ */
+inline double getPeakMemory()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return getPeakMemory(usage);
+}
+
+#endif
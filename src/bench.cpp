@@ -0,0 +1,318 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file bench.cpp
+* @author Julie Digne
+* benchmark of the octree construction, the selection and the output on
+* synthetic clouds
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "types.h"
+#include "FileIO.h"
+#include "CloudGenerator.h"
+#include "Timer.h"
+#include "DistanceKernel.h"
+
+#ifdef OMP
+#include <omp.h>
+#endif
+
+/**split a comma separated list of numbers
+ * @param list list to split
+ * @return values
+ */
+static std::vector<double> parseList(const char *list)
+{
+  std::vector<double> values;
+  const char *p = list;
+  while(*p != '\0')
+  {
+    char *end;
+    double value = strtod(p, &end);
+    if(end == p)
+      break;
+    values.push_back(value);
+    p = (*end == ',') ? end + 1 : end;
+  }
+  return values;
+}
+
+/**split a comma separated list of names
+ * @param list list to split
+ * @return names
+ */
+static std::vector<std::string> parseNames(const char *list)
+{
+  std::vector<std::string> names;
+  std::string s(list);
+  size_t begin = 0;
+  while(begin <= s.size())
+  {
+    size_t end = s.find(',', begin);
+    if(end == std::string::npos)
+      end = s.size();
+    if(end > begin)
+      names.push_back(s.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  return names;
+}
+
+/**times and result of a configuration, sent by the process that ran it*/
+struct Run_result
+{
+  double build;
+
+  double select;
+
+  double output;
+
+  unsigned int nselected;
+};
+
+/**generate a cloud, build its octree, subsample it and write the samples
+ * @param distribution distribution of the cloud
+ * @param npoints number of points of the cloud
+ * @param seed seed of the cloud and of the dart throwing
+ * @param radius radius of the selection
+ * @param method selection method (dart, grid or scan)
+ * @param outfile output file
+ * @param format output format
+ * @param[out] result times and number of selected samples
+ * @return false if the output could not be written
+ */
+static bool runConfiguration(CloudGenerator::Distribution distribution,
+                             size_t npoints, uint64_t seed, double radius,
+                             const std::string &method,
+                             const std::string &outfile,
+                             FileIO::Format format, Run_result &result)
+{
+  std::vector<Sample> samples;
+  double bbox[6];
+  CloudGenerator::generate(distribution, npoints, seed, samples, bbox);
+  Timer timer;
+
+  timer.start();
+  Octree octree;
+  octree.initialize(bbox, radius);
+  octree.setPoints(samples);
+  result.build = timer.elapsed();
+
+  OctreeIterator iterator(&octree);
+  iterator.setR(radius);
+  timer.start();
+  SampleSelection selection(radius, &octree, &iterator);
+  selection.setSeed(seed);
+  selection.setVerbose(false);
+  if(method == "grid")
+    selection.performGridSelection();
+  else if(method == "scan")
+    selection.performParallelSelection();
+  else
+    selection.performDartThrowingSelection();
+  result.select = timer.elapsed();
+  result.nselected = selection.getNSelected();
+
+  timer.start();
+  PointWriter writer;
+  if(!writer.open(outfile.c_str(), format, selection.getNSelected()))
+  {
+    std::cerr<<"Could not open "<<outfile<<std::endl;
+    return false;
+  }
+  writer.writeSamples(octree, selection.getSelectedSamples());
+  if(!writer.close())
+  {
+    std::cerr<<"Could not write "<<outfile<<std::endl;
+    return false;
+  }
+  result.output = timer.elapsed();
+  return true;
+}
+
+/**run a configuration in a child process, so that its peak memory is its
+ * own and not the largest one of the configurations run before
+ * (the parent must not have started OpenMP threads, which a forked child
+ * could not use); the other parameters are those of runConfiguration
+ * @param nthreads number of threads of the child
+ * @param[out] result times and number of selected samples
+ * @param[out] peak peak memory of the child in megabytes
+ * @return false if the configuration failed
+ */
+static bool forkConfiguration(CloudGenerator::Distribution distribution,
+                              size_t npoints, uint64_t seed, int nthreads,
+                              double radius, const std::string &method,
+                              const std::string &outfile,
+                              FileIO::Format format, Run_result &result,
+                              double &peak)
+{
+  int fds[2];
+  if(pipe(fds) != 0)
+    return false;
+  fflush(stdout);
+  pid_t pid = fork();
+  if(pid < 0)
+  {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  if(pid == 0)
+  {
+    close(fds[0]);
+#ifdef OMP
+    omp_set_num_threads(nthreads);
+#else
+    (void)nthreads;
+#endif
+    bool ok = runConfiguration(distribution, npoints, seed, radius, method,
+                               outfile, format, result)
+              && write(fds[1], &result, sizeof(result)) == sizeof(result);
+    _exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  close(fds[1]);
+  bool ok = read(fds[0], &result, sizeof(result)) == sizeof(result);
+  close(fds[0]);
+  int status;
+  struct rusage usage;
+  if(wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status)
+     || WEXITSTATUS(status) != EXIT_SUCCESS)
+    return false;
+  peak = getPeakMemory(usage);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+
+  std::vector<double> sizes(1, 1e6);
+  std::vector<double> radii(1, 0.01);
+  std::vector<double> threads;
+  std::vector<std::string> distributions;
+  distributions.push_back("cube");
+  distributions.push_back("sphere");
+  distributions.push_back("scan");
+  distributions.push_back("clusters");
+  uint64_t seed = 1;
+  std::string outfile = "/dev/null";
+  std::string outformat = "ascii";
+  std::vector<std::string> methods(1, "dart");
+
+  int c;
+  while( (c = getopt(argc,argv, "n:r:t:d:s:o:f:m:h")) != -1)
+  {
+    switch(c)
+    {
+      case 'n': sizes = parseList(optarg); break;
+      case 'r': radii = parseList(optarg); break;
+      case 't': threads = parseList(optarg); break;
+      case 'd': distributions = parseNames(optarg); break;
+      case 's': seed = strtoull(optarg, NULL, 10); break;
+      case 'o': outfile = optarg; break;
+      case 'f': outformat = optarg; break;
+      case 'm': methods = parseNames(optarg); break;
+      default:
+        std::cerr<<"usage: pdss_bench [-n sizes] [-r radii] [-t threads]"
+                 <<" [-d cube,sphere,scan,clusters] [-s seed] [-o output]"
+                 <<" [-f format] [-m dart,grid,scan]"<<std::endl
+                 <<"lists are comma separated, e.g. -n 1e5,1e6 -r 0.01,0.005"
+                 <<std::endl;
+        return c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+
+  FileIO::Format format = FileIO::parseFormat(outformat.c_str());
+  if(format == FileIO::FORMAT_UNKNOWN)
+  {
+    std::cerr<<"Unknown file format (use ascii, off, ply, raw32 or raw64)"<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+#ifdef OMP
+  if(threads.empty())
+    threads.push_back(omp_get_max_threads());
+#else
+  threads.assign(1, 1);
+#endif
+
+  printf("# distance kernel: %s\n", getDistanceKernelName());
+  //the clouds are in the unit cube, so the radii are relative to its side
+  for(size_t mi = 0; mi < methods.size(); ++mi)
+    if(methods[mi] != "dart" && methods[mi] != "grid" && methods[mi] != "scan")
+    {
+      std::cerr<<"Unknown selection method "<<methods[mi]<<std::endl;
+      return EXIT_FAILURE;
+    }
+  printf("%-9s %10s %4s %9s %9s %11s %9s %11s %9s %11s %9s %9s %6s\n",
+         "cloud", "points", "thr", "radius", "build_s", "build_pt/s",
+         "select_s", "select_pt/s", "output_s", "output_pt/s", "selected",
+         "peak_MB", "method");
+
+  for(size_t di = 0; di < distributions.size(); ++di)
+  {
+    CloudGenerator::Distribution distribution =
+      CloudGenerator::parseDistribution(distributions[di].c_str());
+    if(distribution == CloudGenerator::DISTRIBUTION_UNKNOWN)
+    {
+      std::cerr<<"Unknown cloud "<<distributions[di]<<std::endl;
+      return EXIT_FAILURE;
+    }
+
+    for(size_t ni = 0; ni < sizes.size(); ++ni)
+    {
+      size_t npoints = (size_t)sizes[ni];
+      for(size_t ti = 0; ti < threads.size(); ++ti)
+        for(size_t ri = 0; ri < radii.size(); ++ri)
+        for(size_t mi = 0; mi < methods.size(); ++mi)
+        {
+          double radius = radii[ri];
+          Run_result result;
+          double peak;
+          if(!forkConfiguration(distribution, npoints, seed, (int)threads[ti],
+                                radius, methods[mi], outfile, format,
+                                result, peak))
+          {
+            std::cerr<<"The run of "<<distributions[di]<<" failed"<<std::endl;
+            return EXIT_FAILURE;
+          }
+
+          printf("%-9s %10lu %4d %9g %9.4f %11.4g %9.4f %11.4g %9.4f %11.4g %9u %9.1f %6s\n",
+                 CloudGenerator::getName(distribution),
+                 (unsigned long)npoints, (int)threads[ti], radius,
+                 result.build, npoints / result.build, result.select,
+                 npoints / result.select, result.output,
+                 result.nselected / result.output, result.nselected, peak,
+                 methods[mi].c_str());
+          fflush(stdout);
+        }
+    }
+  }
+
+  return EXIT_SUCCESS;
+}
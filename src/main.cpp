@@ -21,7 +21,10 @@
 */  
 #include <iostream>
 #include <sstream>
+#include <algorithm>
+#include <cstdlib>
 #include <ctime>
+#include <iomanip>
 #include <getopt.h>
 #include <vector>
 
@@ -32,21 +35,114 @@
 
 #include "types.h"
 #include "SampleSelection.h"
+#include "TiledSelection.h"
+#include "Timer.h"
+#include "ResultCache.h"
+#include "OctreeIndex.h"
+#include "Metrics.h"
+
+#ifdef OMP
+#include <omp.h>
+#endif
+
+
+/**split a comma separated list of radii and sort it increasingly
+ * @param list list to split
+ * @return radii
+ */
+static std::vector<double> parseRadii(const char *list)
+{
+  std::vector<double> radii;
+  const char *p = list;
+  while(*p != '\0')
+  {
+    char *end;
+    double value = strtod(p, &end);
+    if(end == p)
+      break;
+    radii.push_back(value);
+    p = (*end == ',') ? end + 1 : end;
+  }
+  std::sort(radii.begin(), radii.end());
+  return radii;
+}
+
+/**write the metrics of the run if asked for
+ * @param filename name of the JSON file, empty if none
+ * @return false if the file could not be written
+ */
+static bool writeMetrics(const std::string &filename)
+{
+  if(filename.empty() || Metrics::write(filename.c_str()))
+    return true;
+  std::cerr<<"Could not write the metrics to "<<filename<<std::endl;
+  return false;
+}
+
+/**get the name of the output file of a level of detail, e.g. out_1.ply
+ * @param outfile output file given on the command line
+ * @param level level of detail (0 for the smallest radius)
+ * @return file name
+ */
+static std::string getLevelFileName(const std::string &outfile, unsigned int level)
+{
+  std::stringstream suffix;
+  suffix<<"_"<<level;
+  size_t dot = outfile.rfind('.');
+  size_t slash = outfile.rfind('/');
+  if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return outfile + suffix.str();
+  return outfile.substr(0, dot) + suffix.str() + outfile.substr(dot);
+}
 
 
 int main(int argc, char **argv) {
   
+  //subcommands: pdss index saves the octree of the input, pdss select
+  //subsamples the octree of an index instead of reading the input
+  string command;
+  if(argc > 1 && (string(argv[1]) == "index" || string(argv[1]) == "select"))
+  {
+    command = argv[1];
+    argv[1] = argv[0];
+    argc--;
+    argv++;
+  }
+  
   //handling command line options
   int c;
   stringstream f;
   string infile, outfile;
   double radius = -1;
+  std::vector<double> radii;
   int radius_flag = -1;
   int infile_flag = -1;
   int outfile_flag = -1;
   int off_flag = -1;
+  int nthreads = -1;
+  uint64_t seed = (uint64_t)std::time(NULL);
+  string informat, outformat;
+  double tile_size = -1;
+  string tmp_dir;
+  string method = "dart";
+  string cache_dir;
+  string metrics_file;
+  double voxel_fraction = -1;
+  
+  static struct option long_options[] =
+  {
+    {"seed", required_argument, NULL, 's'},
+    {"input-format", required_argument, NULL, 'F'},
+    {"tile-size", required_argument, NULL, 'T'},
+    {"tmp-dir", required_argument, NULL, 'D'},
+    {"method", required_argument, NULL, 'm'},
+    {"cache-dir", required_argument, NULL, 'C'},
+    {"metrics", required_argument, NULL, 'M'},
+    {"decimate", required_argument, NULL, 'V'},
+    {NULL, 0, NULL, 0}
+  };
   
-  while( (c = getopt(argc,argv, "i:o:r:a")) != -1)
+  while( (c = getopt_long(argc,argv, "i:o:r:at:s:f:m:", long_options, NULL)) != -1)
   {
     switch(c)
     {
@@ -68,9 +164,8 @@ int main(int argc, char **argv) {
       }
       case 'r': 
       {
-	f.clear();
-	f << optarg;
-	f >> radius;
+	radii = parseRadii(optarg);
+	radius = radii.empty() ? -1 : radii[0];
 	radius_flag = 1;
 	break;
       }
@@ -79,6 +174,69 @@ int main(int argc, char **argv) {
         off_flag = 1;
         break;
       }
+      case 't':
+      {
+	f.clear();
+	f << optarg;
+	f >> nthreads;
+	break;
+      }
+      case 's':
+      {
+	f.clear();
+	f << optarg;
+	f >> seed;
+	break;
+      }
+      case 'f':
+      {
+	outformat = optarg;
+	break;
+      }
+      case 'F':
+      {
+	informat = optarg;
+	break;
+      }
+      case 'T':
+      {
+	f.clear();
+	f << optarg;
+	f >> tile_size;
+	break;
+      }
+      case 'D':
+      {
+	tmp_dir = optarg;
+	break;
+      }
+      case 'm':
+      {
+	method = optarg;
+	break;
+      }
+      case 'C':
+      {
+	cache_dir = optarg;
+	break;
+      }
+      case 'M':
+      {
+	metrics_file = optarg;
+	break;
+      }
+      case 'V':
+      {
+	f.clear();
+	f << optarg;
+	f >> voxel_fraction;
+	if(voxel_fraction < 1.0 / 16)
+	{
+	  std::cerr<<"The voxels of --decimate are at least 1/16 of the radius"<<std::endl;
+	  return EXIT_FAILURE;
+	}
+	break;
+      }
     }    
   }
 
@@ -101,61 +259,293 @@ int main(int argc, char **argv) {
     return EXIT_FAILURE;
   }
   
-  time_t start,end;
+  //file formats are deduced from the extensions unless given explicitly
+  FileIO::Format input_format = informat.empty() ? FileIO::getFormat(infile.c_str())
+                                                 : FileIO::parseFormat(informat.c_str());
+  FileIO::Format output_format = outformat.empty() ? FileIO::getFormat(outfile.c_str())
+                                                   : FileIO::parseFormat(outformat.c_str());
+  if(off_flag == 1)
+    output_format = FileIO::FORMAT_OFF;
+  
+  //the index files have their own format
+  if((input_format == FileIO::FORMAT_UNKNOWN && command != "select")
+     || (output_format == FileIO::FORMAT_UNKNOWN && command != "index"))
+  {
+    std::cerr<<"Unknown file format (use ascii, off, ply, raw32 or raw64)"<<std::endl;
+    return EXIT_FAILURE;
+  }
+  
+  if(method != "dart" && method != "grid" && method != "scan")
+  {
+    std::cerr<<"Unknown selection method (use dart, grid or scan)"<<std::endl;
+    return EXIT_FAILURE;
+  }
+  if(method != "dart" && tile_size > 0)
+  {
+    std::cerr<<"The tiles are subsampled by dart throwing only"<<std::endl;
+    return EXIT_FAILURE;
+  }
+  if(radii.size() > 1 && tile_size > 0)
+  {
+    std::cerr<<"The tiles are subsampled with one radius only"<<std::endl;
+    return EXIT_FAILURE;
+  }
+  if(!command.empty() && tile_size > 0)
+  {
+    std::cerr<<"The tiles are read from the input file only (no index)"<<std::endl;
+    return EXIT_FAILURE;
+  }
+  
+#ifdef OMP
+  if(nthreads > 0)
+    omp_set_num_threads(nthreads);
+  std::cout<<"Running with "<<omp_get_max_threads()<<" threads."<<std::endl;
+#else
+  if(nthreads > 1)
+    std::cerr<<"pdss was built without OpenMP: -t is ignored"<<std::endl;
+#endif
+  
+#ifdef OMP
+  Metrics::setValue("threads", omp_get_max_threads());
+#else
+  Metrics::setValue("threads", 1);
+#endif
+  
+  if(command == "index")
+  {
+    Octree octree;
+    Timer timer;
+    timer.start();
+    if(!FileIO::readAndSort(infile.c_str(), input_format, octree, radius))
+    {
+      std::cerr<<"Pb opening the file; exiting."<<std::endl;
+      return EXIT_FAILURE;
+    }
+    double elapsed = timer.elapsed();
+    std::cout<<"Octree with depth "<<octree.getDepth()<<" created."<<std::endl;
+    std::cout<<"Reading and sorting points in this octree took "<<elapsed<<" s."<<std::endl;
+    Metrics::addStage("read_and_sort", elapsed);
+    
+    timer.start();
+    if(!OctreeIndex::write(outfile.c_str(), octree, radius))
+    {
+      std::cerr<<"Pb saving the index; exiting."<<std::endl;
+      return EXIT_FAILURE;
+    }
+    elapsed = timer.elapsed();
+    std::cout<<"Saving the index took "<<elapsed<<" s."<<std::endl;
+    Metrics::addStage("save_index", elapsed);
+    Metrics::setValue("points", octree.getNpoints());
+    return writeMetrics(metrics_file) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+  
+  //one output per level of detail
+  std::vector<std::string> outputs;
+  for(unsigned int level = 0; level < radii.size(); ++level)
+    outputs.push_back(radii.size() > 1 ? getLevelFileName(outfile, level)
+                                       : outfile);
+  
+  ResultCache cache;
+  if(!cache_dir.empty())
+  {
+    Timer lookup;
+    if(!cache.open(cache_dir.c_str()))
+    {
+      std::cerr<<"Could not create the cache directory "<<cache_dir<<std::endl;
+      return EXIT_FAILURE;
+    }
+    
+    //everything the outputs depend on, besides the input bytes
+    std::stringstream parameters;
+    parameters<<std::setprecision(17)<<"version "<<PDSS_CACHE_VERSION
+              <<" scalar "<<sizeof(Scalar)
+              <<" attributes "<<PDSS_SAMPLE_ATTRIBUTES<<" method "<<method
+              <<" input "<<input_format<<" output "<<output_format
+              <<" tile "<<tile_size<<" decimate "<<voxel_fraction<<" radii";
+    for(unsigned int level = 0; level < radii.size(); ++level)
+      parameters<<" "<<radii[level];
+    if(method != "scan")
+      parameters<<" seed "<<seed;
+    
+    if(!cache.computeKey(infile.c_str(), parameters.str()))
+    {
+      std::cerr<<"Pb opening the file; exiting."<<std::endl;
+      return EXIT_FAILURE;
+    }
+    
+    bool hit = true;
+    for(unsigned int level = 0; level < outputs.size(); ++level)
+      hit = hit && cache.contains(level);
+    for(unsigned int level = 0; hit && level < outputs.size(); ++level)
+      hit = cache.fetch(outputs[level].c_str(), level);
+    Metrics::addStage("cache_lookup", lookup.elapsed());
+    Metrics::setValue("cache_hit", hit);
+    if(hit)
+    {
+      std::cout<<"Output found in the cache (key "<<cache.getKey()<<")."<<std::endl;
+      return writeMetrics(metrics_file) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  }
+  
+  Timer timer;
+  
+  if(tile_size > 0)
+  {
+    //out-of-core selection: the cloud is never loaded as a whole
+    PointWriter writer;
+    if(!writer.open(outfile.c_str(), output_format))
+    {
+      std::cerr<<"Pb saving the seeds; exiting."<<std::endl;
+      return EXIT_FAILURE;
+    }
+    
+    timer.start();
+    TiledSelection tiles(radius, tile_size, seed,
+                         tmp_dir.empty() ? NULL : tmp_dir.c_str());
+    tiles.setVoxelFraction(voxel_fraction);
+    std::cout<<"Random seed "<<seed<<" (use --seed to reproduce)"<<std::endl;
+    bool ok = tiles.performSelection(infile.c_str(), input_format, writer);
+    ok = writer.close() && ok;
+    double elapsed = timer.elapsed();
+    
+    if( !ok )
+    {
+      std::cerr<<"Pb subsampling the tiles; exiting."<<std::endl;
+      return EXIT_FAILURE;
+    }
+    
+    std::cout<<tiles.getNSelected()<<" selected points."<<std::endl;
+    std::cout<<"Subsampling the tiles took "<<elapsed<<" s."<<std::endl;
+    std::cout<<"Cover rate (average number of time a point is covered)"
+             <<((double)writer.getNCovered())/((double)writer.getNPoints())<<std::endl;
+    Metrics::addStage("tiles", elapsed);
+    Metrics::setValue("tiles", tiles.getNTiles());
+    Metrics::setValue("points", writer.getNPoints());
+    Metrics::setValue("selected", tiles.getNSelected());
+    if(cache.isOpen() && !cache.store(outfile.c_str(), 0))
+      std::cerr<<"Could not add the output to the cache"<<std::endl;
+    return writeMetrics(metrics_file) ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
   
   Octree octree;
+  OctreeIndex index;
  
-  std::time(&start);
+  timer.start();
   bool ok;
-  ok = FileIO::readAndSortOrientedPoints(infile.c_str(),octree,radius); 
+  if(command == "select")
+    ok = index.map(infile.c_str(), octree);
+  else
+    ok = FileIO::readAndSort(infile.c_str(), input_format, octree, radius);
   
   if( !ok )
   {
       std::cerr<<"Pb opening the file; exiting."<<std::endl;
       return EXIT_FAILURE;
   }
+  if(command == "select" && radius < index.getRadius())
+  {
+      std::cerr<<"The index is built for radii of at least "<<index.getRadius()
+               <<"; exiting."<<std::endl;
+      return EXIT_FAILURE;
+  }
     
-  std::time(&end);
+  double elapsed = timer.elapsed();
   
   std::cout<<"Octree with depth "<<octree.getDepth()<<" created."<<std::endl;
   std::cout<<"Octree contains "<<octree.getNpoints()<<" points. The bounding box size is "<<octree.getSize()<<std::endl;
-  std::cout<<"Reading and sorting points in this octree took "<<difftime(end,start)<<" s."<<std::endl;
+  if(command == "select")
+  {
+    std::cout<<"Mapping the index took "<<elapsed<<" s."<<std::endl;
+    Metrics::addStage("map_index", elapsed);
+  }
+  else
+  {
+    std::cout<<"Reading and sorting points in this octree took "<<elapsed<<" s."<<std::endl;
+    Metrics::addStage("read_and_sort", elapsed);
+  }
+  Metrics::setValue("points", octree.getNpoints());
+  Metrics::setValue("octree_depth", octree.getDepth());
  
   std::cout<<"Octree statistics"<<std::endl;
   octree.printOctreeStat();
 
   OctreeIterator iterator(&octree);
-
-  if(radius>0)
-    iterator.setR(radius);
   
-  std::time(&start);
-
-  SampleSelection selection(radius, &octree, &iterator);
-  selection.performDartThrowingSelection();
-
-  std::time(&end);
+  if(method != "scan")
+    std::cout<<"Random seed "<<seed<<" (use --seed to reproduce)"<<std::endl;
   
-  std::cout<<selection.getNSelected()<<" selected points."<<std::endl;
-  std::cout<<"Selecting the points took "<<difftime(end,start)<<" s."<<std::endl;
-
-  std::string output = outfile;
-  if(off_flag == 1)
+  //levels of detail: the octree is built once for the smallest radius and
+  //each level is selected among the samples of the previous one
+  for(unsigned int level = 0; level < radii.size(); ++level)
   {
-    if(! FileIO::savePointsOFF(output.c_str(), octree, selection.getNSelected()))
+    radius = radii[level];
+    //setR clamps the active depth of the coarse radii (above half the box
+    //size) to the root of the octree
+    if(!iterator.setR(radius))
     {
-        std::cerr<<"Pb saving the seeds (OFF); exiting."<<std::endl;
-        return EXIT_FAILURE;
+      std::cerr<<"Invalid radius "<<radius<<"; exiting."<<std::endl;
+      return EXIT_FAILURE;
     }
-  }
-  else
-  {
-    if(! FileIO::savePoints(output.c_str(), octree))
+    if(level > 0)
+    {
+      std::cout<<"Level "<<level<<" of radius "<<radius<<std::endl;
+      octree.keepSelected();
+    }
+    
+    SampleSelection selection(radius, &octree, &iterator);
+    if(level == 0 && voxel_fraction > 0)
+    {
+      //the coarser levels are selected among the samples of this one
+      timer.start();
+      selection.decimate(voxel_fraction);
+      elapsed = timer.elapsed();
+      std::cout<<octree.getNpoints()<<" points left by the decimation."<<std::endl;
+      std::cout<<"Decimating the points took "<<elapsed<<" s."<<std::endl;
+      Metrics::addStage("decimate", elapsed);
+      Metrics::setValue("decimated", octree.getNpoints());
+    }
+    
+    timer.start();
+    if(method == "scan")
+    {
+      //deterministic: the points are scanned in order, no seed involved
+      selection.performParallelSelection();
+    }
+    else if(method == "grid")
+    {
+      selection.setSeed(seed);
+      selection.performGridSelection();
+    }
+    else
     {
-        std::cerr<<"Pb saving the seeds (ASCII); exiting."<<std::endl;
+      selection.setSeed(seed);
+      selection.performDartThrowingSelection();
+    }
+
+    elapsed = timer.elapsed();
+    
+    std::cout<<selection.getNSelected()<<" selected points."<<std::endl;
+    std::cout<<"Selecting the points took "<<elapsed<<" s."<<std::endl;
+    Metrics::addStage("select", elapsed);
+    std::stringstream name;
+    name<<"selected";
+    if(radii.size() > 1)
+      name<<"_"<<level;
+    Metrics::setValue(name.str(), selection.getNSelected());
+
+    timer.start();
+    if(! FileIO::save(outputs[level].c_str(), output_format, octree, selection.getSelectedSamples()))
+    {
+        std::cerr<<"Pb saving the seeds; exiting."<<std::endl;
         return EXIT_FAILURE;
     }
+    elapsed = timer.elapsed();
+    std::cout<<"Saving the points took "<<elapsed<<" s."<<std::endl;
+    Metrics::addStage("save", elapsed);
+    
+    if(cache.isOpen() && !cache.store(outputs[level].c_str(), level))
+      std::cerr<<"Could not add the output to the cache"<<std::endl;
   }
   
-  return EXIT_SUCCESS;
+  return writeMetrics(metrics_file) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,191 @@
+/**
+* This file is part of the PoissonDiskSubsampling project
+* @file mpi_main.cpp
+* @author Julie Digne
+* distributed subsampling across the processes of an MPI run, see
+* DistributedSelection.h
+*
+* Copyright (c) 2013-2021 Julie Digne
+* All rights reserved.
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU Lesser General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU Lesser General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <ctime>
+#include <getopt.h>
+
+#include <mpi.h>
+
+#include "FileIO.h"
+#include "DistributedSelection.h"
+#include "Timer.h"
+
+#ifdef OMP
+#include <omp.h>
+#endif
+
+/**get the name of the output file of a process, e.g. out_1.ply
+ * @param outfile output file given on the command line
+ * @param rank rank of the process
+ * @return file name
+ */
+static std::string getPartFileName(const std::string &outfile, int rank)
+{
+  std::stringstream suffix;
+  suffix<<"_"<<rank;
+  size_t dot = outfile.rfind('.');
+  size_t slash = outfile.rfind('/');
+  if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    return outfile + suffix.str();
+  return outfile.substr(0, dot) + suffix.str() + outfile.substr(dot);
+}
+
+/**parse the command line, subsample and write the output
+ * @param argc number of arguments
+ * @param argv arguments
+ * @param rank rank of the process
+ * @return exit status
+ */
+static int run(int argc, char **argv, int rank)
+{
+  int c;
+  std::string infile, outfile;
+  double radius = -1;
+  int nthreads = -1;
+  uint64_t seed = (uint64_t)std::time(NULL);
+  std::string informat, outformat;
+  std::string method = "dart";
+  bool gather = false;
+
+  static struct option long_options[] =
+  {
+    {"seed", required_argument, NULL, 's'},
+    {"input-format", required_argument, NULL, 'F'},
+    {"method", required_argument, NULL, 'm'},
+    {"gather", no_argument, NULL, 'G'},
+    {NULL, 0, NULL, 0}
+  };
+
+  while( (c = getopt_long(argc,argv, "i:o:r:t:s:f:m:", long_options, NULL)) != -1)
+  {
+    switch(c)
+    {
+      case 'i': infile = optarg; break;
+      case 'o': outfile = optarg; break;
+      case 'r': radius = atof(optarg); break;
+      case 't': nthreads = atoi(optarg); break;
+      case 's': seed = strtoull(optarg, NULL, 10); break;
+      case 'f': outformat = optarg; break;
+      case 'F': informat = optarg; break;
+      case 'm': method = optarg; break;
+      case 'G': gather = true; break;
+    }
+  }
+
+  //every process checks the options: they all exit together
+  if(infile.empty() || outfile.empty() || radius <= 0)
+  {
+    if(rank == 0)
+      std::cerr<<"usage: mpirun -n processes pdss_mpi -i input_file -o output"
+               <<" -r radius [-t threads] [--seed seed] [-f format]"
+               <<" [--input-format format] [-m dart|grid|scan] [--gather]"
+               <<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  FileIO::Format input_format = informat.empty() ? FileIO::getFormat(infile.c_str())
+                                                 : FileIO::parseFormat(informat.c_str());
+  FileIO::Format output_format = outformat.empty() ? FileIO::getFormat(outfile.c_str())
+                                                   : FileIO::parseFormat(outformat.c_str());
+  if(input_format == FileIO::FORMAT_UNKNOWN || output_format == FileIO::FORMAT_UNKNOWN)
+  {
+    if(rank == 0)
+      std::cerr<<"Unknown file format (use ascii, off, ply, raw32 or raw64)"<<std::endl;
+    return EXIT_FAILURE;
+  }
+  if(method != "dart" && method != "grid" && method != "scan")
+  {
+    if(rank == 0)
+      std::cerr<<"Unknown selection method (use dart, grid or scan)"<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+#ifdef OMP
+  if(nthreads > 0)
+    omp_set_num_threads(nthreads);
+#else
+  if(nthreads > 1 && rank == 0)
+    std::cerr<<"pdss_mpi was built without OpenMP: -t is ignored"<<std::endl;
+#endif
+
+  Timer timer;
+  timer.start();
+  DistributedSelection selection(radius, seed);
+  if(!selection.performSelection(infile.c_str(), input_format, method))
+  {
+    if(rank == 0)
+      std::cerr<<"Pb opening the file; exiting."<<std::endl;
+    return EXIT_FAILURE;
+  }
+  double elapsed = timer.elapsed();
+
+  unsigned long counts[2] = {selection.getNPoints(), selection.getNSelected()};
+  unsigned long totals[2] = {0, 0};
+  MPI_Reduce(counts, totals, 2, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+  if(rank == 0)
+  {
+    if(method != "scan")
+      std::cout<<"Random seed "<<seed<<" (use --seed to reproduce)"<<std::endl;
+    std::cout<<selection.getNSlabs()<<" slabs, "<<totals[0]<<" points, "
+             <<totals[1]<<" selected points."<<std::endl;
+    std::cout<<"Reading, distributing and selecting the points took "
+             <<elapsed<<" s."<<std::endl;
+  }
+
+  timer.start();
+  bool ok;
+  if(gather)
+    ok = selection.gather(outfile.c_str(), output_format);
+  else
+  {
+    //one part per process, written concurrently
+    int part_ok = selection.save(getPartFileName(outfile, rank).c_str(),
+                                 output_format);
+    int all_ok = 0;
+    MPI_Allreduce(&part_ok, &all_ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    ok = all_ok;
+  }
+  if(!ok)
+  {
+    if(rank == 0)
+      std::cerr<<"Pb saving the seeds; exiting."<<std::endl;
+    return EXIT_FAILURE;
+  }
+  if(rank == 0)
+    std::cout<<"Saving the points took "<<timer.elapsed()<<" s."<<std::endl;
+  return EXIT_SUCCESS;
+}
+
+
+int main(int argc, char **argv) {
+
+  MPI_Init(&argc, &argv);
+  int rank = 0;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  int status = run(argc, argv, rank);
+  MPI_Finalize();
+  return status;
+}
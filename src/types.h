@@ -53,7 +53,7 @@ typedef std::list<Sample>::iterator  Sample_iterator;
 typedef std::list<Sample*> Sample_star_list;
 typedef std::list<Sample*>::iterator Sample_star_iterator;
 
-typedef std::map<double, Sample*> Neighbor_star_map;
+typedef std::multimap<double, Sample*> Neighbor_star_map;
 typedef Neighbor_star_map::iterator Neighbor_iterator;
 
 #include "Octree.h"